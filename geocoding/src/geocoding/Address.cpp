@@ -3,99 +3,133 @@
 #include "FeatureReader.h"
 #include "StringUtils.h"
 
+#include <boost/lexical_cast.hpp>
+
 #include <sqlite3pp.h>
 
 namespace carto { namespace geocoding {
     bool Address::loadFromDB(sqlite3pp::database& db, std::uint64_t encodedId, const std::string& language, const PointConverter& converter) {
-        unsigned int entityId = static_cast<unsigned int>(encodedId & 0xffffffffU);
-        unsigned int elementIndex = static_cast<unsigned int>(encodedId >> 32);
-        
-        sqlite3pp::query query(db, "SELECT type, features, housenumbers FROM entities WHERE id=:id");
-        query.bind(":id", entityId);
+        std::map<std::uint64_t, Address> addresses = loadFromDB(db, std::vector<std::uint64_t> { encodedId }, language, converter);
+        auto it = addresses.find(encodedId);
+        if (it == addresses.end()) {
+            return false;
+        }
+        *this = std::move(it->second);
+        return true;
+    }
+
+    std::map<std::uint64_t, Address> Address::loadFromDB(sqlite3pp::database& db, const std::vector<std::uint64_t>& encodedIds, const std::string& language, const PointConverter& converter) {
+        std::map<unsigned int, std::vector<std::uint64_t>> entityEncodedIds;
+        for (std::uint64_t encodedId : encodedIds) {
+            entityEncodedIds[static_cast<unsigned int>(encodedId & 0xffffffffU)].push_back(encodedId);
+        }
+        if (entityEncodedIds.empty()) {
+            return std::map<std::uint64_t, Address>();
+        }
+
+        std::string entityIds;
+        for (const std::pair<const unsigned int, std::vector<std::uint64_t>>& entityEncodedId : entityEncodedIds) {
+            entityIds += (entityIds.empty() ? "" : ",") + boost::lexical_cast<std::string>(entityEncodedId.first);
+        }
+
+        // Decode features and house numbers of all entities
+        std::map<std::uint64_t, Address> addresses;
+        std::map<std::uint64_t, std::vector<std::uint64_t>> houseNumberEncodedIds;
+        sqlite3pp::query query(db, ("SELECT id, type, features, housenumbers FROM entities WHERE id IN (" + entityIds + ")").c_str());
         for (auto qit = query.begin(); qit != query.end(); qit++) {
-            type = static_cast<EntityType>(qit->get<int>(0));
-
-            // Feature reader
-            EncodingStream featureStream(qit->get<const void*>(1), qit->column_bytes(1));
-            FeatureReader featureReader(featureStream, converter);
-
-            // Decode house number
-            if (elementIndex) {
-                if (qit->get<const void*>(2)) {
-                    EncodingStream houseNumberStream(qit->get<const void*>(2), qit->column_bytes(2));
-                    AddressInterpolator interpolator(houseNumberStream);
-                    
-                    std::pair<std::uint64_t, std::vector<Feature>> result = interpolator.enumerateAddresses(featureReader).at(elementIndex - 1);
-                    sqlite3pp::query query1(db, "SELECT n.name FROM names n WHERE n.id=:id AND (n.lang IS NULL or n.lang=:lang) ORDER BY n.lang ASC");
-                    query1.bind(":id", result.first);
-                    query1.bind(":lang", language.c_str());
-                    for (auto qit1 = query1.begin(); qit1 != query1.end(); qit1++) {
-                        houseNumber = qit1->get<const char*>(0);
-                    }
-                    features = result.second;
-                }
-                else {
-                    return false;
+            auto entityId = qit->get<unsigned int>(0);
+            auto type = static_cast<EntityType>(qit->get<int>(1));
+
+            // Group the requested house number elements, element index 0 refers to the whole entity
+            std::map<std::size_t, std::vector<std::uint64_t>> elementEncodedIds;
+            for (std::uint64_t encodedId : entityEncodedIds[entityId]) {
+                unsigned int elementIndex = static_cast<unsigned int>(encodedId >> 32);
+                if (elementIndex) {
+                    elementEncodedIds[elementIndex - 1].push_back(encodedId);
+                    continue;
                 }
-            }
-            else {
-                houseNumber.clear();
-                features.clear();
+
+                Address address;
+                address.type = type;
+
+                EncodingStream featureStream(qit->get<const void*>(2), qit->column_bytes(2));
+                FeatureReader featureReader(featureStream, converter);
                 while (!featureStream.eof()) {
                     std::vector<Feature> featureCollection = featureReader.readFeatureCollection();
-                    features.insert(features.end(), featureCollection.begin(), featureCollection.end());
+                    address.features.insert(address.features.end(), featureCollection.begin(), featureCollection.end());
+                }
+
+                addresses[encodedId] = std::move(address);
+            }
+
+            // Decode house numbers once per entity and read all requested elements in a single pass over the features
+            if (!elementEncodedIds.empty() && qit->get<const void*>(3)) {
+                EncodingStream houseNumberStream(qit->get<const void*>(3), qit->column_bytes(3));
+                AddressInterpolator interpolator(houseNumberStream);
+
+                std::vector<std::size_t> elementIndices;
+                for (const std::pair<const std::size_t, std::vector<std::uint64_t>>& elementEncodedId : elementEncodedIds) {
+                    elementIndices.push_back(elementEncodedId.first);
+                }
+
+                EncodingStream featureStream(qit->get<const void*>(2), qit->column_bytes(2));
+                FeatureReader featureReader(featureStream, converter);
+                std::vector<std::pair<std::uint64_t, std::vector<Feature>>> results = interpolator.readAddresses(featureReader, elementIndices);
+                for (std::size_t i = 0; i < results.size(); i++) {
+                    for (std::uint64_t encodedId : elementEncodedIds[elementIndices[i]]) {
+                        Address address;
+                        address.type = type;
+                        address.features = results[i].second;
+
+                        houseNumberEncodedIds[results[i].first].push_back(encodedId);
+                        addresses[encodedId] = std::move(address);
+                    }
                 }
             }
+        }
+
+        // Load house numbers
+        if (!houseNumberEncodedIds.empty()) {
+            std::string nameIds;
+            for (const std::pair<const std::uint64_t, std::vector<std::uint64_t>>& houseNumberEncodedId : houseNumberEncodedIds) {
+                nameIds += (nameIds.empty() ? "" : ",") + boost::lexical_cast<std::string>(houseNumberEncodedId.first);
+            }
 
-            // Load names
-            sqlite3pp::query query1(db, "SELECT n.name, n.type FROM entitynames en, names n WHERE en.entity_id=:id AND en.name_id=n.id AND (n.lang IS NULL or n.lang=:lang) ORDER BY n.lang ASC");
-            query1.bind(":id", entityId);
+            sqlite3pp::query query1(db, ("SELECT n.id, n.name FROM names n WHERE n.id IN (" + nameIds + ") AND (n.lang IS NULL or n.lang=:lang) ORDER BY n.lang ASC").c_str());
             query1.bind(":lang", language.c_str());
             for (auto qit1 = query1.begin(); qit1 != query1.end(); qit1++) {
-                std::string value = qit1->get<const char*>(0);
-                switch (static_cast<FieldType>(qit1->get<int>(1))) {
-                case FieldType::NONE:
-                    break;
-                case FieldType::COUNTRY:
-                    country = value;
-                    break;
-                case FieldType::REGION:
-                    region = value;
-                    break;
-                case FieldType::COUNTY:
-                    county = value;
-                    break;
-                case FieldType::LOCALITY:
-                    locality = value;
-                    break;
-                case FieldType::NEIGHBOURHOOD:
-                    neighbourhood = value;
-                    break;
-                case FieldType::STREET:
-                    street = value;
-                    break;
-                case FieldType::POSTCODE:
-                    postcode = value;
-                    break;
-                case FieldType::NAME:
-                    name = value;
-                    break;
-                case FieldType::HOUSENUMBER: // not really used
-                    houseNumber = value;
-                    break;
+                std::string value = qit1->get<const char*>(1);
+                for (std::uint64_t encodedId : houseNumberEncodedIds[qit1->get<std::uint64_t>(0)]) {
+                    addresses[encodedId].houseNumber = value;
                 }
             }
+        }
 
-            // Load categories    
-            categories.clear();
-            sqlite3pp::query query2(db, "SELECT c.category FROM entitycategories ec, categories c WHERE ec.entity_id=:id AND ec.category_id=c.id");
-            query2.bind(":id", entityId);
-            for (auto qit2 = query2.begin(); qit2 != query2.end(); qit2++) {
-                categories.insert(qit2->get<const char*>(0));
+        // Load names
+        sqlite3pp::query query2(db, ("SELECT en.entity_id, n.name, n.type FROM entitynames en, names n WHERE en.entity_id IN (" + entityIds + ") AND en.name_id=n.id AND (n.lang IS NULL or n.lang=:lang) ORDER BY n.lang ASC").c_str());
+        query2.bind(":lang", language.c_str());
+        for (auto qit2 = query2.begin(); qit2 != query2.end(); qit2++) {
+            std::string value = qit2->get<const char*>(1);
+            for (std::uint64_t encodedId : entityEncodedIds[qit2->get<unsigned int>(0)]) {
+                auto it = addresses.find(encodedId);
+                if (it != addresses.end()) {
+                    it->second.setField(static_cast<FieldType>(qit2->get<int>(2)), value);
+                }
             }
-            return true;
         }
-        return false;
+
+        // Load categories
+        sqlite3pp::query query3(db, ("SELECT ec.entity_id, c.category FROM entitycategories ec, categories c WHERE ec.entity_id IN (" + entityIds + ") AND ec.category_id=c.id").c_str());
+        for (auto qit3 = query3.begin(); qit3 != query3.end(); qit3++) {
+            std::string category = qit3->get<const char*>(1);
+            for (std::uint64_t encodedId : entityEncodedIds[qit3->get<unsigned int>(0)]) {
+                auto it = addresses.find(encodedId);
+                if (it != addresses.end()) {
+                    it->second.categories.insert(category);
+                }
+            }
+        }
+        return addresses;
     }
 
     bool Address::merge(const Address& address) {
@@ -113,6 +147,40 @@ namespace carto { namespace geocoding {
         return false;
     }
 
+    void Address::setField(FieldType type, const std::string& value) {
+        switch (type) {
+        case FieldType::NONE:
+            break;
+        case FieldType::COUNTRY:
+            country = value;
+            break;
+        case FieldType::REGION:
+            region = value;
+            break;
+        case FieldType::COUNTY:
+            county = value;
+            break;
+        case FieldType::LOCALITY:
+            locality = value;
+            break;
+        case FieldType::NEIGHBOURHOOD:
+            neighbourhood = value;
+            break;
+        case FieldType::STREET:
+            street = value;
+            break;
+        case FieldType::POSTCODE:
+            postcode = value;
+            break;
+        case FieldType::NAME:
+            name = value;
+            break;
+        case FieldType::HOUSENUMBER: // not really used
+            houseNumber = value;
+            break;
+        }
+    }
+
     std::string Address::toString() const {
         std::string str;
         if (!name.empty()) {
@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
 
 namespace sqlite3pp {
     class database;
@@ -45,8 +46,12 @@ namespace carto { namespace geocoding {
 
         bool loadFromDB(sqlite3pp::database& db, std::uint64_t encodedId, const std::string& language, const PointConverter& converter);
 
+        static std::map<std::uint64_t, Address> loadFromDB(sqlite3pp::database& db, const std::vector<std::uint64_t>& encodedIds, const std::string& language, const PointConverter& converter);
+
         bool merge(const Address& address);
 
+        void setField(FieldType type, const std::string& value);
+
         std::string toString() const;
     };
 } }
@@ -12,6 +12,29 @@ namespace carto { namespace geocoding {
         return (it == _houseNumbers.end() ? -1 : static_cast<int>(it - _houseNumbers.begin()));
     }
     
+    std::pair<std::uint64_t, std::vector<Feature>> AddressInterpolator::readAddress(FeatureReader& featureReader, std::size_t index) const {
+        return readAddresses(featureReader, std::vector<std::size_t> { index }).front();
+    }
+
+    std::vector<std::pair<std::uint64_t, std::vector<Feature>>> AddressInterpolator::readAddresses(FeatureReader& featureReader, const std::vector<std::size_t>& indices) const {
+        // Indices must be in increasing order, all addresses are read in a single pass over the features
+        std::vector<std::pair<std::uint64_t, std::vector<Feature>>> addresses;
+        addresses.reserve(indices.size());
+        std::size_t position = 0;
+        for (std::size_t index : indices) {
+            std::uint64_t id = _houseNumbers.at(index);
+            if (index < position) {
+                throw std::runtime_error("Address indices not sorted");
+            }
+            for (; position < index; position++) {
+                featureReader.skipFeatureCollection();
+            }
+            addresses.emplace_back(id, featureReader.readFeatureCollection());
+            position++;
+        }
+        return addresses;
+    }
+
     std::vector<std::pair<std::uint64_t, std::vector<Feature>>> AddressInterpolator::enumerateAddresses(FeatureReader& featureReader) const {
         std::vector<std::pair<std::uint64_t, std::vector<Feature>>> addresses;
         addresses.reserve(_houseNumbers.size());
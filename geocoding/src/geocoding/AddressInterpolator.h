@@ -19,6 +19,8 @@ namespace carto { namespace geocoding {
         explicit AddressInterpolator(EncodingStream& houseNumberStream);
 
         int findAddress(std::uint64_t id) const;
+        std::pair<std::uint64_t, std::vector<Feature>> readAddress(FeatureReader& featureReader, std::size_t index) const;
+        std::vector<std::pair<std::uint64_t, std::vector<Feature>>> readAddresses(FeatureReader& featureReader, const std::vector<std::size_t>& indices) const;
         std::vector<std::pair<std::uint64_t, std::vector<Feature>>> enumerateAddresses(FeatureReader& featureReader) const;
 
     private:
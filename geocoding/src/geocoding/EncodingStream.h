@@ -73,6 +73,14 @@ namespace carto { namespace geocoding {
             return std::string(reinterpret_cast<const char*>(_data + _offset - len), len);
         }
 
+        void skipString() {
+            std::size_t len = readNumber<std::size_t>();
+            if (_offset + len > _size) {
+                throw std::runtime_error("Offset out of bounds");
+            }
+            _offset += len;
+        }
+
     private:
         long long _prevNum = 0;
         long long _prevX = 0;
@@ -44,6 +44,23 @@ namespace carto { namespace geocoding {
             return features;
         }
 
+        void skipFeature() {
+            _stream.readDeltaNumber<std::uint64_t>();
+            _geometryReader.skipGeometry();
+            std::size_t n = _stream.readNumber<std::size_t>();
+            for (std::size_t i = 0; i < n; i++) {
+                _stream.skipString();
+                skipValue();
+            }
+        }
+
+        void skipFeatureCollection() {
+            std::size_t n = _stream.readNumber<std::size_t>();
+            for (std::size_t i = 0; i < n; i++) {
+                skipFeature();
+            }
+        }
+
     private:
         enum class ValueType : int {
             NONE = 0,
@@ -75,6 +92,28 @@ namespace carto { namespace geocoding {
             }
         }
 
+        void skipValue() {
+            ValueType type = _stream.readNumber<ValueType>();
+            if (type == ValueType::NONE) {
+                return;
+            }
+            else if (type == ValueType::BOOLEAN) {
+                _stream.readNumber<int>();
+            }
+            else if (type == ValueType::INTEGER) {
+                _stream.readNumber<long long>();
+            }
+            else if (type == ValueType::FLOAT) {
+                _stream.readFloat();
+            }
+            else if (type == ValueType::STRING) {
+                _stream.skipString();
+            }
+            else {
+                throw std::runtime_error("Invalid value type");
+            }
+        }
+
         EncodingStream& _stream;
         GeometryReader _geometryReader;
     };
@@ -577,7 +577,7 @@ namespace carto { namespace geocoding {
                         EncodingStream houseNumberStream(entityRow.houseNumbers.data(), entityRow.houseNumbers.size());
                         AddressInterpolator interpolator(houseNumberStream);
 
-                        features = interpolator.enumerateAddresses(featureReader).at(elementIndex - 1).second;
+                        features = interpolator.readAddress(featureReader, elementIndex - 1).second;
                     }
                     else {
                         features = featureReader.readFeatureCollection();
@@ -7,6 +7,9 @@
 #ifndef _CARTO_GEOCODING_GEOMETRY_H_
 #define _CARTO_GEOCODING_GEOMETRY_H_
 
+#include <cstdint>
+#include <cmath>
+#include <limits>
 #include <utility>
 #include <algorithm>
 #include <vector>
@@ -24,10 +27,143 @@ namespace carto { namespace geocoding {
         virtual ~Geometry() = default;
 
         virtual Bounds getBounds() const = 0;
+
+        virtual std::size_t getMemoryUsage() const = 0;
         
         virtual Point calculateNearestPoint(const Point& p) const = 0;
     };
 
+    class SegmentIndex final {
+    public:
+        using Point = Geometry::Point;
+        using Bounds = Geometry::Bounds;
+
+        explicit SegmentIndex(const std::vector<Point>& points, bool closed) : _segmentCount(closed ? points.size() : (points.empty() ? 0 : points.size() - 1)), _minY(0), _bandHeight(0) {
+            // Build chunks of consecutive segments with their bounding boxes
+            for (std::size_t i = 0; i < _segmentCount; i += CHUNK_SIZE) {
+                Bounds bounds = Bounds::smallest();
+                for (std::size_t j = i; j < std::min(i + CHUNK_SIZE, _segmentCount); j++) {
+                    bounds.add(points[j]);
+                    bounds.add(points[(j + 1) % points.size()]);
+                }
+                _chunkBounds.push_back(bounds);
+            }
+
+            // Build Y-sorted band index of segments, only used for closed rings
+            if (closed && _segmentCount > 0) {
+                Bounds bounds = Bounds::smallest();
+                bounds.add(points.begin(), points.end());
+                std::size_t bandCount = std::max(static_cast<std::size_t>(1), static_cast<std::size_t>(std::sqrt(static_cast<double>(_segmentCount))));
+                _minY = bounds.min(1);
+                _bandHeight = (bounds.max(1) - bounds.min(1)) / bandCount;
+                _bandOffsets.assign(bandCount + 1, 0);
+                for (int pass = 0; pass < 2; pass++) {
+                    std::vector<std::size_t> bandSizes(bandCount, 0);
+                    for (std::size_t i = 0; i < _segmentCount; i++) {
+                        double y0 = points[i](1), y1 = points[(i + 1) % points.size()](1);
+                        for (std::size_t band = calculateBand(std::min(y0, y1), bandCount); band <= calculateBand(std::max(y0, y1), bandCount); band++) {
+                            if (pass == 0) {
+                                _bandOffsets[band + 1]++;
+                            }
+                            else {
+                                _bandSegments[_bandOffsets[band] + bandSizes[band]++] = static_cast<std::uint32_t>(i);
+                            }
+                        }
+                    }
+                    if (pass == 0) {
+                        for (std::size_t band = 0; band < bandCount; band++) {
+                            _bandOffsets[band + 1] += _bandOffsets[band];
+                        }
+                        _bandSegments.resize(_bandOffsets.back());
+                    }
+                }
+            }
+        }
+
+        std::size_t getMemoryUsage() const {
+            return sizeof(SegmentIndex) + _chunkBounds.size() * sizeof(Bounds) + _bandOffsets.size() * sizeof(std::size_t) + _bandSegments.size() * sizeof(std::uint32_t);
+        }
+
+        Point calculateNearestPoint(const Point& p, const std::vector<Point>& points) const {
+            // Visit chunks in the order of their bounding box distance and stop once no chunk can contain a closer point.
+            // Ties are resolved towards the lowest segment index, so the result matches the linear scan.
+            std::vector<std::pair<double, std::size_t>> chunkDists;
+            chunkDists.reserve(_chunkBounds.size());
+            for (std::size_t i = 0; i < _chunkBounds.size(); i++) {
+                chunkDists.emplace_back(cglib::length(_chunkBounds[i].nearest_point(p) - p), i);
+            }
+            std::sort(chunkDists.begin(), chunkDists.end());
+
+            double minDist = std::numeric_limits<double>::infinity();
+            std::size_t minIndex = std::numeric_limits<std::size_t>::max();
+            Point nearestPoint = p;
+            for (const std::pair<double, std::size_t>& chunkDist : chunkDists) {
+                if (chunkDist.first > minDist) {
+                    break;
+                }
+                std::size_t chunkEnd = std::min((chunkDist.second + 1) * CHUNK_SIZE, _segmentCount);
+                for (std::size_t i = chunkDist.second * CHUNK_SIZE; i < chunkEnd; i++) {
+                    Point point = calculateNearestSegmentPoint(p, points[i], points[(i + 1) % points.size()]);
+                    double dist = cglib::length(point - p);
+                    if (dist < minDist || (dist == minDist && i < minIndex)) {
+                        minDist = dist;
+                        minIndex = i;
+                        nearestPoint = point;
+                    }
+                }
+            }
+            return nearestPoint;
+        }
+
+        bool isPointInside(const Point& p, const std::vector<Point>& points) const {
+            // Only segments spanning the Y coordinate of the point can cross the ray, and these are all stored in the band containing the point
+            if (_bandOffsets.empty() || p(1) < _minY) {
+                return false;
+            }
+            std::size_t band = calculateBand(p(1), _bandOffsets.size() - 1);
+            bool inside = false;
+            for (std::size_t k = _bandOffsets[band]; k < _bandOffsets[band + 1]; k++) {
+                std::size_t i = _bandSegments[k];
+                std::size_t j = (i + 1) % points.size();
+                if ((points[i](1) >= p(1)) != (points[j](1) >= p(1))) {
+                    if (p(0) <= (points[j](0) - points[i](0)) * (p(1) - points[i](1)) / (points[j](1) - points[i](1)) + points[i](0)) {
+                        inside = !inside;
+                    }
+                }
+            }
+            return inside;
+        }
+
+        static Point calculateNearestSegmentPoint(const Point& p, const Point& a, const Point& b) {
+            if (a == b) {
+                return a;
+            }
+            cglib::vec2<double> dir = b - a;
+            double u = cglib::dot_product(p - a, dir) / cglib::dot_product(dir, dir);
+            return a + dir * std::max(0.0, std::min(1.0, u));
+        }
+
+        static constexpr std::size_t MIN_INDEXED_POINTS = 64;
+
+    private:
+        std::size_t calculateBand(double y, std::size_t bandCount) const {
+            if (!(_bandHeight > 0)) {
+                return 0;
+            }
+            double band = std::floor((y - _minY) / _bandHeight);
+            return static_cast<std::size_t>(std::max(0.0, std::min(static_cast<double>(bandCount - 1), band)));
+        }
+
+        static constexpr std::size_t CHUNK_SIZE = 16;
+
+        std::size_t _segmentCount;
+        std::vector<Bounds> _chunkBounds;
+        double _minY;
+        double _bandHeight;
+        std::vector<std::size_t> _bandOffsets;
+        std::vector<std::uint32_t> _bandSegments;
+    };
+
     class PointGeometry : public Geometry {
     public:
         explicit PointGeometry(const Point& point) : _point(point) { }
@@ -40,6 +176,10 @@ namespace carto { namespace geocoding {
             return Bounds(_point, _point);
         }
 
+        virtual std::size_t getMemoryUsage() const override {
+            return sizeof(PointGeometry);
+        }
+
         virtual Point calculateNearestPoint(const Point& p) const override {
             return _point;
         }
@@ -50,8 +190,11 @@ namespace carto { namespace geocoding {
 
     class LineGeometry : public Geometry {
     public:
-        explicit LineGeometry(std::vector<Point> points) : _points(std::move(points)), _bounds(Bounds::smallest()) {
+        explicit LineGeometry(std::vector<Point> points) : _points(std::move(points)), _bounds(Bounds::smallest()), _segmentIndex() {
             _bounds.add(_points.begin(), _points.end());
+            if (_points.size() >= SegmentIndex::MIN_INDEXED_POINTS) {
+                _segmentIndex = std::make_shared<SegmentIndex>(_points, false);
+            }
         }
 
         const std::vector<Point>& getPoints() const {
@@ -62,18 +205,19 @@ namespace carto { namespace geocoding {
             return _bounds;
         }
 
+        virtual std::size_t getMemoryUsage() const override {
+            return sizeof(LineGeometry) + _points.size() * sizeof(Point) + (_segmentIndex ? _segmentIndex->getMemoryUsage() : 0);
+        }
+
         virtual Point calculateNearestPoint(const Point& p) const override {
+            if (_segmentIndex) {
+                return _segmentIndex->calculateNearestPoint(p, _points);
+            }
+
             double minDist = std::numeric_limits<double>::infinity();
             Point nearestPoint = p;
             for (std::size_t i = 1; i < _points.size(); i++) {
-                const Point& a = _points[i - 1];
-                const Point& b = _points[i];
-                Point point = a;
-                if (a != b) {
-                    cglib::vec2<double> dir = b - a;
-                    double u = cglib::dot_product(p - a, dir) / cglib::dot_product(dir, dir);
-                    point = a + dir * std::max(0.0, std::min(1.0, u));
-                }
+                Point point = SegmentIndex::calculateNearestSegmentPoint(p, _points[i - 1], _points[i]);
                 double dist = cglib::length(point - p);
                 if (dist < minDist) {
                     minDist = dist;
@@ -86,15 +230,25 @@ namespace carto { namespace geocoding {
     private:
         const std::vector<Point> _points;
         Bounds _bounds;
+        std::shared_ptr<SegmentIndex> _segmentIndex;
     };
 
     class PolygonGeometry : public Geometry {
     public:
-        explicit PolygonGeometry(std::vector<Point> points, std::vector<std::vector<Point>> holes) : _points(std::move(points)), _holes(std::move(holes)), _bounds(Bounds::smallest()) {
+        explicit PolygonGeometry(std::vector<Point> points, std::vector<std::vector<Point>> holes) : _points(std::move(points)), _holes(std::move(holes)), _bounds(Bounds::smallest()), _segmentIndices() {
             _bounds.add(_points.begin(), _points.end());
             for (const std::vector<Point>& hole : _holes) {
                 _bounds.add(hole.begin(), hole.end());
             }
+
+            // Build segment indices for large rings, the first index is for the outer ring
+            _segmentIndices.resize(_holes.size() + 1);
+            for (std::size_t i = 0; i < _segmentIndices.size(); i++) {
+                const std::vector<Point>& ring = (i == 0 ? _points : _holes[i - 1]);
+                if (ring.size() >= SegmentIndex::MIN_INDEXED_POINTS) {
+                    _segmentIndices[i] = std::make_shared<SegmentIndex>(ring, true);
+                }
+            }
         }
 
         const std::vector<Point>& getPoints() const {
@@ -109,31 +263,39 @@ namespace carto { namespace geocoding {
             return _bounds;
         }
 
+        virtual std::size_t getMemoryUsage() const override {
+            std::size_t size = sizeof(PolygonGeometry) + _points.size() * sizeof(Point);
+            for (const std::vector<Point>& hole : _holes) {
+                size += sizeof(std::vector<Point>) + hole.size() * sizeof(Point);
+            }
+            for (const std::shared_ptr<SegmentIndex>& segmentIndex : _segmentIndices) {
+                size += sizeof(std::shared_ptr<SegmentIndex>) + (segmentIndex ? segmentIndex->getMemoryUsage() : 0);
+            }
+            return size;
+        }
+
         virtual Point calculateNearestPoint(const Point& p) const override {
-            if (isPointInsideRing(p, _points)) {
-                for (const std::vector<Point>& hole : _holes) {
-                    if (isPointInsideRing(p, hole)) {
-                        return calculateNearestRingPoint(p, hole);
+            if (isPointInsideRing(p, _points, _segmentIndices[0])) {
+                for (std::size_t i = 0; i < _holes.size(); i++) {
+                    if (isPointInsideRing(p, _holes[i], _segmentIndices[i + 1])) {
+                        return calculateNearestRingPoint(p, _holes[i], _segmentIndices[i + 1]);
                     }
                 }
                 return p;
             }
-            return calculateNearestRingPoint(p, _points);
+            return calculateNearestRingPoint(p, _points, _segmentIndices[0]);
         }
 
     private:
-        static Point calculateNearestRingPoint(const Point& p, const std::vector<Point>& points) {
+        static Point calculateNearestRingPoint(const Point& p, const std::vector<Point>& points, const std::shared_ptr<SegmentIndex>& segmentIndex) {
+            if (segmentIndex) {
+                return segmentIndex->calculateNearestPoint(p, points);
+            }
+
             double minDist = std::numeric_limits<double>::infinity();
             Point nearestPoint = p;
             for (std::size_t i = 0; i < points.size(); i++) {
-                const Point& a = points[i];
-                const Point& b = points[(i + 1) % points.size()];
-                Point point = a;
-                if (a != b) {
-                    cglib::vec2<double> dir = b - a;
-                    double u = cglib::dot_product(p - a, dir) / cglib::dot_product(dir, dir);
-                    point = a + dir * std::max(0.0, std::min(1.0, u));
-                }
+                Point point = SegmentIndex::calculateNearestSegmentPoint(p, points[i], points[(i + 1) % points.size()]);
                 double dist = cglib::length(point - p);
                 if (dist < minDist) {
                     minDist = dist;
@@ -143,7 +305,11 @@ namespace carto { namespace geocoding {
             return nearestPoint;
         }
 
-        static bool isPointInsideRing(const Point& p, const std::vector<Point>& points) {
+        static bool isPointInsideRing(const Point& p, const std::vector<Point>& points, const std::shared_ptr<SegmentIndex>& segmentIndex) {
+            if (segmentIndex) {
+                return segmentIndex->isPointInside(p, points);
+            }
+
             bool inside = false;
             for (std::size_t i = 0; i < points.size(); i++) {
                 std::size_t j = (i + 1) % points.size();
@@ -159,6 +325,7 @@ namespace carto { namespace geocoding {
         const std::vector<Point> _points;
         const std::vector<std::vector<Point>> _holes;
         Bounds _bounds;
+        std::vector<std::shared_ptr<SegmentIndex>> _segmentIndices;
     };
 
     class MultiGeometry : public Geometry {
@@ -177,6 +344,14 @@ namespace carto { namespace geocoding {
             return _bounds;
         }
 
+        virtual std::size_t getMemoryUsage() const override {
+            std::size_t size = sizeof(MultiGeometry);
+            for (const std::shared_ptr<Geometry>& geom : _geometries) {
+                size += sizeof(std::shared_ptr<Geometry>) + geom->getMemoryUsage();
+            }
+            return size;
+        }
+
         virtual Point calculateNearestPoint(const Point& p) const override {
             double minDist = std::numeric_limits<double>::infinity();
             Point nearestPoint = p;
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_GEOCODING_GEOMETRYCACHE_H_
+#define _CARTO_GEOCODING_GEOMETRYCACHE_H_
+
+#include "Geometry.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace carto { namespace geocoding {
+    class GeometryCache final {
+    public:
+        using GeometryInfo = std::pair<std::uint64_t, std::shared_ptr<Geometry>>;
+
+        explicit GeometryCache(std::size_t maxMemoryUsage) : _maxMemoryUsage(maxMemoryUsage) { }
+
+        std::size_t getMemoryUsage() const {
+            return _memoryUsage;
+        }
+
+        bool read(const std::string& key, std::vector<GeometryInfo>& geomInfos) {
+            auto it = _entryMap.find(key);
+            if (it == _entryMap.end()) {
+                return false;
+            }
+            _entries.splice(_entries.begin(), _entries, it->second);
+            geomInfos = std::get<1>(*it->second);
+            return true;
+        }
+
+        void put(const std::string& key, const std::vector<GeometryInfo>& geomInfos) {
+            auto it = _entryMap.find(key);
+            if (it != _entryMap.end()) {
+                _memoryUsage -= std::get<2>(*it->second);
+                _entries.erase(it->second);
+                _entryMap.erase(it);
+            }
+
+            std::size_t memoryUsage = key.size();
+            for (const GeometryInfo& geomInfo : geomInfos) {
+                memoryUsage += sizeof(GeometryInfo) + (geomInfo.second ? geomInfo.second->getMemoryUsage() : 0);
+            }
+            if (memoryUsage > _maxMemoryUsage) {
+                return;
+            }
+
+            _entries.emplace_front(key, geomInfos, memoryUsage);
+            _entryMap[key] = _entries.begin();
+            _memoryUsage += memoryUsage;
+            while (_memoryUsage > _maxMemoryUsage) {
+                _memoryUsage -= std::get<2>(_entries.back());
+                _entryMap.erase(std::get<0>(_entries.back()));
+                _entries.pop_back();
+            }
+        }
+
+        void clear() {
+            _entries.clear();
+            _entryMap.clear();
+            _memoryUsage = 0;
+        }
+
+    private:
+        using Entry = std::tuple<std::string, std::vector<GeometryInfo>, std::size_t>;
+
+        std::list<Entry> _entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> _entryMap;
+        std::size_t _memoryUsage = 0;
+        const std::size_t _maxMemoryUsage;
+    };
+} }
+
+#endif
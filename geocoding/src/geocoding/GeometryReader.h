@@ -85,6 +85,43 @@ namespace carto { namespace geocoding {
             }
         }
 
+        void skipGeometry() {
+            GeometryType type = readNumber<GeometryType>();
+            if (type == GeometryType::NONE) {
+                return;
+            }
+            else if (type == GeometryType::POINT) {
+                skipCoord();
+            }
+            else if (type == GeometryType::MULTIPOINT || type == GeometryType::LINESTRING) {
+                skipCoords();
+            }
+            else if (type == GeometryType::MULTILINESTRING) {
+                std::size_t n = readNumber<std::size_t>();
+                for (std::size_t i = 0; i < n; i++) {
+                    skipCoords();
+                }
+            }
+            else if (type == GeometryType::POLYGON) {
+                skipRings();
+            }
+            else if (type == GeometryType::MULTIPOLYGON) {
+                std::size_t n = readNumber<std::size_t>();
+                for (std::size_t i = 0; i < n; i++) {
+                    skipRings();
+                }
+            }
+            else if (type == GeometryType::GEOMETRYCOLLECTION) {
+                std::size_t n = readNumber<std::size_t>();
+                for (std::size_t i = 0; i < n; i++) {
+                    skipGeometry();
+                }
+            }
+            else {
+                throw std::runtime_error("Invalid geometry type");
+            }
+        }
+
     private:
         enum class GeometryType : int {
             NONE               = 0,
@@ -126,6 +163,24 @@ namespace carto { namespace geocoding {
             return rings;
         }
 
+        void skipCoord() {
+            _stream.readDeltaCoord(1.0 / PRECISION); // coordinates are delta encoded, so they must be decoded even when skipped
+        }
+
+        void skipCoords() {
+            std::size_t count = readNumber<std::size_t>();
+            for (std::size_t i = 0; i < count; i++) {
+                skipCoord();
+            }
+        }
+
+        void skipRings() {
+            std::size_t count = readNumber<std::size_t>();
+            for (std::size_t i = 0; i < count; i++) {
+                skipCoords();
+            }
+        }
+
         static constexpr double PRECISION = 1.0e6;
 
         EncodingStream& _stream;
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_GEOCODING_PACKEDRTREE_H_
+#define _CARTO_GEOCODING_PACKEDRTREE_H_
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include <cglib/vec.h>
+#include <cglib/bbox.h>
+
+namespace carto { namespace geocoding {
+    template <typename T>
+    class PackedRTree final {
+    public:
+        using Bounds = cglib::bbox2<double>;
+        using Entry = std::pair<Bounds, T>;
+
+        explicit PackedRTree(std::vector<Entry> entries) {
+            // Sort entries by Hilbert order of their bounding box centers
+            Bounds totalBounds = Bounds::smallest();
+            for (const Entry& entry : entries) {
+                totalBounds.add(entry.first);
+            }
+            std::vector<std::uint32_t> hilbertCodes;
+            hilbertCodes.reserve(entries.size());
+            for (const Entry& entry : entries) {
+                hilbertCodes.push_back(calculateHilbertCode(entry.first.center(), totalBounds));
+            }
+            std::vector<std::size_t> order(entries.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&hilbertCodes](std::size_t i, std::size_t j) {
+                return hilbertCodes[i] < hilbertCodes[j];
+            });
+
+            // Store leaf level, then build upper levels bottom-up. All levels are kept in a single array.
+            _nodeBounds.reserve(entries.size() + entries.size() / (NODE_SIZE - 1) + 1);
+            _values.reserve(entries.size());
+            for (std::size_t index : order) {
+                _nodeBounds.push_back(packBounds(entries[index].first));
+                _values.push_back(std::move(entries[index].second));
+            }
+            _levelOffsets.push_back(0);
+            std::size_t levelSize = _nodeBounds.size();
+            while (levelSize > 1) {
+                std::size_t levelOffset = _levelOffsets.back();
+                _levelOffsets.push_back(_nodeBounds.size());
+                for (std::size_t i = 0; i < levelSize; i += NODE_SIZE) {
+                    cglib::bbox2<float> bounds = cglib::bbox2<float>::smallest();
+                    for (std::size_t j = i; j < std::min(i + NODE_SIZE, levelSize); j++) {
+                        bounds.add(_nodeBounds[levelOffset + j]);
+                    }
+                    _nodeBounds.push_back(bounds);
+                }
+                levelSize = _nodeBounds.size() - _levelOffsets.back();
+            }
+            _levelOffsets.push_back(_nodeBounds.size());
+        }
+
+        std::size_t size() const {
+            return _values.size();
+        }
+
+        template <typename Visitor>
+        void query(const Bounds& bounds, Visitor visitor) const {
+            if (_values.empty()) {
+                return;
+            }
+
+            cglib::bbox2<float> queryBounds = packBounds(bounds);
+            std::vector<std::pair<std::size_t, std::size_t>> stack; // (level, node index) pairs
+            stack.emplace_back(_levelOffsets.size() - 2, 0);
+            while (!stack.empty()) {
+                std::size_t level = stack.back().first;
+                std::size_t index = stack.back().second;
+                stack.pop_back();
+
+                if (!intersects(_nodeBounds[_levelOffsets[level] + index], queryBounds)) {
+                    continue;
+                }
+                if (level == 0) {
+                    visitor(_values[index]);
+                    continue;
+                }
+                std::size_t childCount = _levelOffsets[level] - _levelOffsets[level - 1];
+                for (std::size_t i = std::min((index + 1) * NODE_SIZE, childCount); i-- > index * NODE_SIZE; ) {
+                    stack.emplace_back(level - 1, i);
+                }
+            }
+        }
+
+        static std::uint32_t calculateHilbertCode(const cglib::vec2<double>& pos, const Bounds& totalBounds) {
+            std::uint32_t n = 1U << HILBERT_BITS;
+            std::uint32_t coords[2];
+            for (int i = 0; i < 2; i++) {
+                double size = totalBounds.max(i) - totalBounds.min(i);
+                double t = (size > 0 ? (pos(i) - totalBounds.min(i)) / size : 0.0);
+                coords[i] = static_cast<std::uint32_t>(std::max(0.0, std::min(1.0, t)) * (n - 1));
+            }
+
+            std::uint32_t x = coords[0], y = coords[1], code = 0;
+            for (std::uint32_t s = n / 2; s > 0; s /= 2) {
+                std::uint32_t rx = (x & s) > 0 ? 1 : 0;
+                std::uint32_t ry = (y & s) > 0 ? 1 : 0;
+                code += s * s * ((3 * rx) ^ ry);
+                if (ry == 0) {
+                    if (rx == 1) {
+                        x = n - 1 - x;
+                        y = n - 1 - y;
+                    }
+                    std::swap(x, y);
+                }
+            }
+            return code;
+        }
+
+    private:
+        static constexpr std::size_t NODE_SIZE = 16;
+        static constexpr int HILBERT_BITS = 16;
+
+        static bool intersects(const cglib::bbox2<float>& bounds1, const cglib::bbox2<float>& bounds2) {
+            return bounds1.min(0) <= bounds2.max(0) && bounds2.min(0) <= bounds1.max(0) && bounds1.min(1) <= bounds2.max(1) && bounds2.min(1) <= bounds1.max(1);
+        }
+
+        static cglib::bbox2<float> packBounds(const Bounds& bounds) {
+            // Round outwards, so that packed bounds always contain the original bounds
+            cglib::vec2<float> min, max;
+            for (int i = 0; i < 2; i++) {
+                min(i) = std::nextafter(static_cast<float>(bounds.min(i)), -std::numeric_limits<float>::infinity());
+                max(i) = std::nextafter(static_cast<float>(bounds.max(i)), std::numeric_limits<float>::infinity());
+            }
+            return cglib::bbox2<float>(min, max);
+        }
+
+        std::vector<cglib::bbox2<float>> _nodeBounds;
+        std::vector<std::size_t> _levelOffsets;
+        std::vector<T> _values;
+    };
+} }
+
+#endif
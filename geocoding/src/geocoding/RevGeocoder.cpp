@@ -4,6 +4,9 @@
 #include "AddressInterpolator.h"
 
 #include <functional>
+#include <numeric>
+#include <map>
+#include <unordered_set>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -60,9 +63,47 @@ namespace carto { namespace geocoding {
         }
     }
 
+    bool RevGeocoder::isSpatialIndexEnabled() const {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return _spatialIndexEnabled;
+    }
+
+    void RevGeocoder::setSpatialIndexEnabled(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        _spatialIndexEnabled = enabled;
+    }
+
     std::vector<std::pair<Address, float>> RevGeocoder::findAddresses(double lng, double lat, float radius) const {
         std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return findNearestAddresses(lng, lat, radius, nullptr);
+    }
+
+    std::vector<std::vector<std::pair<Address, float>>> RevGeocoder::findAddresses(const std::vector<cglib::vec2<double>>& lngLats, float radius) const {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
 
+        // Process points in Hilbert order, so that consecutive lookups share most of the loaded tiles and entities
+        cglib::bbox2<double> bounds = cglib::bbox2<double>::smallest();
+        bounds.add(lngLats.begin(), lngLats.end());
+        std::vector<std::uint32_t> hilbertCodes;
+        hilbertCodes.reserve(lngLats.size());
+        for (const cglib::vec2<double>& lngLat : lngLats) {
+            hilbertCodes.push_back(SpatialIndex::calculateHilbertCode(lngLat, bounds));
+        }
+        std::vector<std::size_t> order(lngLats.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&hilbertCodes](std::size_t i, std::size_t j) {
+            return hilbertCodes[i] < hilbertCodes[j];
+        });
+
+        BatchCache batchCache;
+        std::vector<std::vector<std::pair<Address, float>>> addressesList(lngLats.size());
+        for (std::size_t index : order) {
+            addressesList[index] = findNearestAddresses(lngLats[index](0), lngLats[index](1), radius, &batchCache);
+        }
+        return addressesList;
+    }
+
+    std::vector<std::pair<Address, float>> RevGeocoder::findNearestAddresses(double lng, double lat, float radius, BatchCache* batchCache) const {
         std::vector<std::pair<Address, float>> addresses;
         for (const Database& database : _databases) {
             if (database.bounds) {
@@ -77,26 +118,61 @@ namespace carto { namespace geocoding {
             }
 
             _previousEntityQueryCounter = _entityQueryCounter;
-            QuadIndex index(std::bind(&RevGeocoder::findGeometryInfo, this, std::cref(database), std::placeholders::_1, std::placeholders::_2));
-            std::vector<QuadIndex::Result> results = index.findGeometries(lng, lat, radius);
+            std::vector<QuadIndex::Result> results;
+            if (_spatialIndexEnabled) {
+                if (!database.spatialIndex) {
+                    database.spatialIndex = buildSpatialIndex(database);
+                }
+                results = findIndexedGeometries(database, lng, lat, radius, batchCache);
+            }
+            else {
+                QuadIndex index(std::bind(&RevGeocoder::findGeometryInfo, this, std::cref(database), std::placeholders::_1, std::placeholders::_2, batchCache));
+                results = index.findGeometries(lng, lat, radius);
+            }
 
+            // Order candidates by id, so that equally ranked results are returned in the same order regardless of how they were found
+            std::vector<std::pair<std::uint64_t, float>> addressRanks;
             for (const QuadIndex::Result& result : results) {
                 float rank = 1.0f - static_cast<float>(result.second) / radius;
                 if (rank > 0) {
-                    Address address;
-                    std::string addrKey = database.id + "_" + boost::lexical_cast<std::string>(result.first);
-                    if (!_addressCache.read(addrKey, address)) {
-                        address.loadFromDB(*database.db, result.first, _language, [&database](const cglib::vec2<double>& pos) {
-                            return database.origin + pos;
-                        });
-                        _addressCache.put(addrKey, address);
-                    }
-                    addresses.emplace_back(address, rank);
+                    addressRanks.emplace_back(result.first, rank);
+                }
+            }
+            std::sort(addressRanks.begin(), addressRanks.end(), [](const std::pair<std::uint64_t, float>& addressRank1, const std::pair<std::uint64_t, float>& addressRank2) {
+                return addressRank1.first < addressRank2.first;
+            });
+
+            // Load all missing addresses of the result page at once
+            std::map<std::uint64_t, Address> loadedAddresses;
+            std::vector<std::uint64_t> missingEncodedIds;
+            for (const std::pair<std::uint64_t, float>& addressRank : addressRanks) {
+                Address address;
+                if (_addressCache.read(database.id + "_" + boost::lexical_cast<std::string>(addressRank.first), address)) {
+                    loadedAddresses[addressRank.first] = address;
+                }
+                else {
+                    missingEncodedIds.push_back(addressRank.first);
+                }
+            }
+            if (!missingEncodedIds.empty()) {
+                std::map<std::uint64_t, Address> dbAddresses = Address::loadFromDB(*database.db, missingEncodedIds, _language, [&database](const cglib::vec2<double>& pos) {
+                    return database.origin + pos;
+                });
+                for (const std::pair<const std::uint64_t, Address>& dbAddress : dbAddresses) {
+                    _addressCache.put(database.id + "_" + boost::lexical_cast<std::string>(dbAddress.first), dbAddress.second);
+                    loadedAddresses.insert(dbAddress);
+                }
+            }
+            for (const std::pair<std::uint64_t, float>& addressRank : addressRanks) {
+                auto it = loadedAddresses.find(addressRank.first);
+                if (it != loadedAddresses.end()) {
+                    addresses.emplace_back(it->second, addressRank.second);
                 }
             }
         }
 
-        std::sort(addresses.begin(), addresses.end(), [](const std::pair<Address, float>& addrRank1, const std::pair<Address, float>& addrRank2) {
+        // Use stable sort, as candidates are already in deterministic order
+        std::stable_sort(addresses.begin(), addresses.end(), [](const std::pair<Address, float>& addrRank1, const std::pair<Address, float>& addrRank2) {
             return addrRank1.second > addrRank2.second;
         });
 
@@ -107,20 +183,53 @@ namespace carto { namespace geocoding {
         return addresses;
     }
 
-    std::vector<QuadIndex::GeometryInfo> RevGeocoder::findGeometryInfo(const Database& database, const std::vector<std::uint64_t>& quadIndices, const PointConverter& converter) const {
-        std::string sql = "SELECT id, features, housenumbers FROM entities WHERE quadindex in (";
-        for (std::size_t i = 0; i < quadIndices.size(); i++) {
-            sql += (i > 0 ? "," : "") + boost::lexical_cast<std::string>(quadIndices[i]);
-        }
-        sql += ")";
+    std::vector<QuadIndex::GeometryInfo> RevGeocoder::findGeometryInfo(const Database& database, const std::vector<std::uint64_t>& quadIndices, const PointConverter& converter, BatchCache* batchCache) const {
+        std::string typeFilter;
         if (!_enabledFilters.empty()) {
             std::string values;
             for (const Address::EntityType type : _enabledFilters) {
                 values += (values.empty() ? "" : ",") + boost::lexical_cast<std::string>(static_cast<int>(type));
             }
-            sql += " AND (type IN (" + values + "))";
+            typeFilter = " AND (type IN (" + values + "))";
         }
 
+        if (batchCache) {
+            // Load each tile only once per batch. Filters can not change during the batch, so tile key does not need to include them.
+            std::map<std::uint64_t, std::vector<QuadIndex::GeometryInfo>> tileGeomInfos;
+            std::vector<std::uint64_t> missingQuadIndices;
+            std::string sql;
+            for (std::uint64_t quadIndex : quadIndices) {
+                if (!batchCache->geometryInfoCache.read(database.id + "_q" + boost::lexical_cast<std::string>(quadIndex), tileGeomInfos[quadIndex])) {
+                    missingQuadIndices.push_back(quadIndex);
+                    sql += (sql.empty() ? "" : ",") + boost::lexical_cast<std::string>(quadIndex);
+                }
+            }
+
+            if (!missingQuadIndices.empty()) {
+                sql = "SELECT id, features, housenumbers, quadindex FROM entities WHERE quadindex in (" + sql + ")" + typeFilter;
+                sqlite3pp::query query(*database.db, sql.c_str());
+                for (auto qit = query.begin(); qit != query.end(); qit++) {
+                    readGeometryInfo(database, qit->get<unsigned int>(0), qit->get<const void*>(1), qit->column_bytes(1), qit->get<const void*>(2), qit->column_bytes(2), converter, tileGeomInfos[qit->get<std::uint64_t>(3)]);
+                }
+                for (std::uint64_t quadIndex : missingQuadIndices) {
+                    batchCache->geometryInfoCache.put(database.id + "_q" + boost::lexical_cast<std::string>(quadIndex), tileGeomInfos[quadIndex]);
+                }
+                _entityQueryCounter++;
+            }
+
+            std::vector<QuadIndex::GeometryInfo> geomInfos;
+            for (const std::pair<const std::uint64_t, std::vector<QuadIndex::GeometryInfo>>& tileGeomInfo : tileGeomInfos) {
+                geomInfos.insert(geomInfos.end(), tileGeomInfo.second.begin(), tileGeomInfo.second.end());
+            }
+            return geomInfos;
+        }
+
+        std::string sql = "SELECT id, features, housenumbers FROM entities WHERE quadindex in (";
+        for (std::size_t i = 0; i < quadIndices.size(); i++) {
+            sql += (i > 0 ? "," : "") + boost::lexical_cast<std::string>(quadIndices[i]);
+        }
+        sql += ")" + typeFilter;
+
         std::vector<QuadIndex::GeometryInfo> geomInfos;
         std::string queryKey = database.id + "_" + sql;
         if (_queryCache.read(queryKey, geomInfos)) {
@@ -129,43 +238,158 @@ namespace carto { namespace geocoding {
 
         sqlite3pp::query query(*database.db, sql.c_str());
         for (auto qit = query.begin(); qit != query.end(); qit++) {
-            auto entityId = qit->get<unsigned int>(0);
+            readGeometryInfo(database, qit->get<unsigned int>(0), qit->get<const void*>(1), qit->column_bytes(1), qit->get<const void*>(2), qit->column_bytes(2), converter, geomInfos);
+        }
 
-            EncodingStream featureStream(qit->get<const void*>(1), qit->column_bytes(1));
-            FeatureReader featureReader(featureStream, [&database, &converter](const cglib::vec2<double>& pos) {
-                return converter(database.origin + pos);
-            });
+        _entityQueryCounter++;
+        _queryCache.put(queryKey, geomInfos);
+        return geomInfos;
+    }
+
+    std::vector<QuadIndex::Result> RevGeocoder::findIndexedGeometries(const Database& database, double lng, double lat, float radius, BatchCache* batchCache) const {
+        cglib::vec2<double> mercatorPos = wgs84ToWebMercator({ lng, lat });
+        cglib::vec2<double> mercatorMeters = webMercatorMeters({ lng, lat });
+        cglib::vec2<double> mercatorRadius(radius / mercatorMeters(0), radius / mercatorMeters(1));
+
+        // Find candidates using the in-memory index, only candidate entities are loaded from the database
+        std::vector<std::uint64_t> encodedIds;
+        database.spatialIndex->query(cglib::bbox2<double>(mercatorPos - mercatorRadius, mercatorPos + mercatorRadius), [this, &encodedIds](const std::pair<std::uint64_t, Address::EntityType>& value) {
+            if (_enabledFilters.empty() || std::find(_enabledFilters.begin(), _enabledFilters.end(), value.second) != _enabledFilters.end()) {
+                encodedIds.push_back(value.first);
+            }
+        });
+        if (encodedIds.empty()) {
+            return std::vector<QuadIndex::Result>();
+        }
 
-            if (qit->get<const void*>(2)) {
-                EncodingStream houseNumberStream(qit->get<const void*>(2), qit->column_bytes(2));
-                AddressInterpolator interpolator(houseNumberStream);
-
-                std::vector<std::pair<std::uint64_t, std::vector<Feature>>> results = interpolator.enumerateAddresses(featureReader);
-                for (std::size_t i = 0; i < results.size(); i++) {
-                    std::uint64_t encodedId = (results[i].first ? static_cast<std::uint64_t>(i + 1) << 32 : 0) | entityId;
-                    std::vector<std::shared_ptr<Geometry>> geometries;
-                    for (const Feature& feature : results[i].second) {
-                        if (feature.getGeometry()) {
-                            geometries.push_back(feature.getGeometry());
-                        }
+        std::vector<QuadIndex::GeometryInfo> geomInfos = loadGeometryInfo(database, encodedIds, [](const cglib::vec2<double>& pos) {
+            return wgs84ToWebMercator(pos);
+        }, batchCache);
+
+        std::vector<QuadIndex::Result> results;
+        for (const QuadIndex::GeometryInfo& geomInfo : geomInfos) {
+            // TODO: -180/180 wrapping
+            cglib::vec2<double> point = geomInfo.second->calculateNearestPoint(mercatorPos);
+            cglib::vec2<double> diff = point - mercatorPos;
+            double dist = cglib::length(cglib::vec2<double>(diff(0) * mercatorMeters(0), diff(1) * mercatorMeters(1)));
+            if (dist <= radius) {
+                results.emplace_back(geomInfo.first, dist);
+            }
+        }
+        return results;
+    }
+
+    std::vector<QuadIndex::GeometryInfo> RevGeocoder::loadGeometryInfo(const Database& database, const std::vector<std::uint64_t>& encodedIds, const PointConverter& converter, BatchCache* batchCache) const {
+        std::unordered_set<std::uint64_t> encodedIdSet(encodedIds.begin(), encodedIds.end());
+        std::unordered_set<unsigned int> entityIdSet;
+        std::vector<QuadIndex::GeometryInfo> geomInfos;
+        std::string sql;
+        for (std::uint64_t encodedId : encodedIds) {
+            unsigned int entityId = static_cast<unsigned int>(encodedId & 0xffffffffU);
+            if (!entityIdSet.insert(entityId).second) {
+                continue;
+            }
+
+            std::vector<QuadIndex::GeometryInfo> entityGeomInfos;
+            if (batchCache && batchCache->geometryInfoCache.read(database.id + "_e" + boost::lexical_cast<std::string>(entityId), entityGeomInfos)) {
+                for (QuadIndex::GeometryInfo& geomInfo : entityGeomInfos) {
+                    if (encodedIdSet.count(geomInfo.first) > 0) {
+                        geomInfos.push_back(std::move(geomInfo));
                     }
-                    geomInfos.emplace_back(encodedId, std::make_shared<MultiGeometry>(std::move(geometries)));
                 }
+                continue;
             }
-            else {
+            sql += (sql.empty() ? "" : ",") + boost::lexical_cast<std::string>(entityId);
+        }
+        if (sql.empty()) {
+            return geomInfos;
+        }
+
+        sql = "SELECT id, features, housenumbers FROM entities WHERE id IN (" + sql + ")";
+        sqlite3pp::query query(*database.db, sql.c_str());
+        for (auto qit = query.begin(); qit != query.end(); qit++) {
+            auto entityId = qit->get<unsigned int>(0);
+
+            std::vector<QuadIndex::GeometryInfo> entityGeomInfos;
+            readGeometryInfo(database, entityId, qit->get<const void*>(1), qit->column_bytes(1), qit->get<const void*>(2), qit->column_bytes(2), converter, entityGeomInfos);
+            if (batchCache) {
+                batchCache->geometryInfoCache.put(database.id + "_e" + boost::lexical_cast<std::string>(entityId), entityGeomInfos);
+            }
+            for (QuadIndex::GeometryInfo& geomInfo : entityGeomInfos) {
+                if (encodedIdSet.count(geomInfo.first) > 0) {
+                    geomInfos.push_back(std::move(geomInfo));
+                }
+            }
+        }
+
+        _entityQueryCounter++;
+        return geomInfos;
+    }
+
+    void RevGeocoder::readGeometryInfo(const Database& database, unsigned int entityId, const void* features, std::size_t featuresSize, const void* houseNumbers, std::size_t houseNumbersSize, const PointConverter& converter, std::vector<QuadIndex::GeometryInfo>& geomInfos) const {
+        // Decoded geometries only depend on the entity, as all lookups use the same converter
+        std::string entityKey = database.id + "_" + boost::lexical_cast<std::string>(entityId);
+        std::vector<QuadIndex::GeometryInfo> entityGeomInfos;
+        if (!_geometryCache.read(entityKey, entityGeomInfos)) {
+            decodeGeometryInfo(database, entityId, features, featuresSize, houseNumbers, houseNumbersSize, converter, entityGeomInfos);
+            _geometryCache.put(entityKey, entityGeomInfos);
+        }
+        geomInfos.insert(geomInfos.end(), entityGeomInfos.begin(), entityGeomInfos.end());
+    }
+
+    std::shared_ptr<RevGeocoder::SpatialIndex> RevGeocoder::buildSpatialIndex(const Database& database) {
+        PointConverter converter = [](const cglib::vec2<double>& pos) {
+            return wgs84ToWebMercator(pos);
+        };
+
+        std::vector<SpatialIndex::Entry> entries;
+        sqlite3pp::query query(*database.db, "SELECT id, type, features, housenumbers FROM entities");
+        for (auto qit = query.begin(); qit != query.end(); qit++) {
+            auto type = static_cast<Address::EntityType>(qit->get<int>(1));
+
+            std::vector<QuadIndex::GeometryInfo> geomInfos;
+            decodeGeometryInfo(database, qit->get<unsigned int>(0), qit->get<const void*>(2), qit->column_bytes(2), qit->get<const void*>(3), qit->column_bytes(3), converter, geomInfos);
+            for (const QuadIndex::GeometryInfo& geomInfo : geomInfos) {
+                cglib::bbox2<double> bounds = geomInfo.second->getBounds();
+                if (bounds.min(0) <= bounds.max(0) && bounds.min(1) <= bounds.max(1)) {
+                    entries.emplace_back(bounds, std::make_pair(geomInfo.first, type));
+                }
+            }
+        }
+        return std::make_shared<SpatialIndex>(std::move(entries));
+    }
+
+    void RevGeocoder::decodeGeometryInfo(const Database& database, unsigned int entityId, const void* features, std::size_t featuresSize, const void* houseNumbers, std::size_t houseNumbersSize, const PointConverter& converter, std::vector<QuadIndex::GeometryInfo>& geomInfos) {
+        EncodingStream featureStream(features, featuresSize);
+        FeatureReader featureReader(featureStream, [&database, &converter](const cglib::vec2<double>& pos) {
+            return converter(database.origin + pos);
+        });
+
+        if (houseNumbers) {
+            EncodingStream houseNumberStream(houseNumbers, houseNumbersSize);
+            AddressInterpolator interpolator(houseNumberStream);
+
+            std::vector<std::pair<std::uint64_t, std::vector<Feature>>> results = interpolator.enumerateAddresses(featureReader);
+            for (std::size_t i = 0; i < results.size(); i++) {
+                std::uint64_t encodedId = (results[i].first ? static_cast<std::uint64_t>(i + 1) << 32 : 0) | entityId;
                 std::vector<std::shared_ptr<Geometry>> geometries;
-                for (const Feature& feature : featureReader.readFeatureCollection()) {
+                for (const Feature& feature : results[i].second) {
                     if (feature.getGeometry()) {
                         geometries.push_back(feature.getGeometry());
                     }
                 }
-                geomInfos.emplace_back(entityId, std::make_shared<MultiGeometry>(std::move(geometries)));
+                geomInfos.emplace_back(encodedId, std::make_shared<MultiGeometry>(std::move(geometries)));
             }
         }
-
-        _entityQueryCounter++;
-        _queryCache.put(queryKey, geomInfos);
-        return geomInfos;
+        else {
+            std::vector<std::shared_ptr<Geometry>> geometries;
+            for (const Feature& feature : featureReader.readFeatureCollection()) {
+                if (feature.getGeometry()) {
+                    geometries.push_back(feature.getGeometry());
+                }
+            }
+            geomInfos.emplace_back(entityId, std::make_shared<MultiGeometry>(std::move(geometries)));
+        }
     }
 
     cglib::vec2<double> RevGeocoder::getOrigin(sqlite3pp::database& db) {
@@ -10,6 +10,8 @@
 #include "Address.h"
 #include "Geometry.h"
 #include "QuadIndex.h"
+#include "PackedRTree.h"
+#include "GeometryCache.h"
 
 #include <vector>
 #include <memory>
@@ -29,7 +31,7 @@ namespace sqlite3pp {
 namespace carto { namespace geocoding {
     class RevGeocoder final {
     public:
-        RevGeocoder() : _addressCache(ADDRESS_CACHE_SIZE), _queryCache(QUERY_CACHE_SIZE) { }
+        RevGeocoder() : _addressCache(ADDRESS_CACHE_SIZE), _queryCache(QUERY_CACHE_SIZE), _geometryCache(GEOMETRY_CACHE_MEMORY) { }
         
         bool import(const std::shared_ptr<sqlite3pp::database>& db);
 
@@ -42,30 +44,56 @@ namespace carto { namespace geocoding {
         bool isFilterEnabled(Address::EntityType type) const;
         void setFilterEnabled(Address::EntityType type, bool enabled);
 
+        bool isSpatialIndexEnabled() const;
+        void setSpatialIndexEnabled(bool enabled);
+
         std::vector<std::pair<Address, float>> findAddresses(double lng, double lat, float radius) const;
+        std::vector<std::vector<std::pair<Address, float>>> findAddresses(const std::vector<cglib::vec2<double>>& lngLats, float radius) const;
 
     private:
+        using SpatialIndex = PackedRTree<std::pair<std::uint64_t, Address::EntityType>>;
+
         struct Database {
             std::string id;
             std::shared_ptr<sqlite3pp::database> db;
             cglib::vec2<double> origin;
             boost::optional<cglib::bbox2<double>> bounds;
+            mutable std::shared_ptr<SpatialIndex> spatialIndex;
+        };
+
+        struct BatchCache {
+            BatchCache() : geometryInfoCache(BATCH_CACHE_SIZE) { }
+
+            cache::lru_cache<std::string, std::vector<QuadIndex::GeometryInfo>> geometryInfoCache; // keyed by database id and quadindex or entity id
         };
+
+        std::vector<std::pair<Address, float>> findNearestAddresses(double lng, double lat, float radius, BatchCache* batchCache) const;
         
-        std::vector<QuadIndex::GeometryInfo> findGeometryInfo(const Database& database, const std::vector<std::uint64_t>& quadIndices, const PointConverter& converter) const;
+        std::vector<QuadIndex::GeometryInfo> findGeometryInfo(const Database& database, const std::vector<std::uint64_t>& quadIndices, const PointConverter& converter, BatchCache* batchCache) const;
+        std::vector<QuadIndex::Result> findIndexedGeometries(const Database& database, double lng, double lat, float radius, BatchCache* batchCache) const;
+        std::vector<QuadIndex::GeometryInfo> loadGeometryInfo(const Database& database, const std::vector<std::uint64_t>& encodedIds, const PointConverter& converter, BatchCache* batchCache) const;
+
+        void readGeometryInfo(const Database& database, unsigned int entityId, const void* features, std::size_t featuresSize, const void* houseNumbers, std::size_t houseNumbersSize, const PointConverter& converter, std::vector<QuadIndex::GeometryInfo>& geomInfos) const;
+
+        static std::shared_ptr<SpatialIndex> buildSpatialIndex(const Database& database);
+        static void decodeGeometryInfo(const Database& database, unsigned int entityId, const void* features, std::size_t featuresSize, const void* houseNumbers, std::size_t houseNumbersSize, const PointConverter& converter, std::vector<QuadIndex::GeometryInfo>& geomInfos);
 
         static cglib::vec2<double> getOrigin(sqlite3pp::database& db);
         static boost::optional<cglib::bbox2<double>> getBounds(sqlite3pp::database& db);
 
         static constexpr std::size_t ADDRESS_CACHE_SIZE = 1024;
         static constexpr std::size_t QUERY_CACHE_SIZE = 64;
+        static constexpr std::size_t BATCH_CACHE_SIZE = 4096;
+        static constexpr std::size_t GEOMETRY_CACHE_MEMORY = 16 * 1024 * 1024;
         
         std::string _language; // use local language by default
         unsigned int _maxResults = 10; // maximum number of results returned
         std::vector<Address::EntityType> _enabledFilters = { Address::EntityType::ADDRESS, Address::EntityType::POI }; // filters enabled
+        bool _spatialIndexEnabled = false; // use quadindex queries by default
 
         mutable cache::lru_cache<std::string, Address> _addressCache;
         mutable cache::lru_cache<std::string, std::vector<QuadIndex::GeometryInfo>> _queryCache;
+        mutable GeometryCache _geometryCache;
         mutable std::uint64_t _previousEntityQueryCounter = 0;;
         mutable std::uint64_t _entityQueryCounter = 0;
 
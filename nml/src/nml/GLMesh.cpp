@@ -6,11 +6,16 @@
 namespace carto { namespace nml {
 
     GLMesh::GLMesh(const Mesh& mesh) :
+        GLMesh(mesh, false)
+    {
+    }
+    
+    GLMesh::GLMesh(const Mesh& mesh, bool releaseVertexData) :
         _submeshList()
     {
         for (int i = 0; i < mesh.submeshes_size(); i++) {
-            Submesh submesh = mesh.submeshes(i);
-            auto glSubmesh = std::make_shared<GLSubmesh>(submesh);
+            const Submesh& submesh = mesh.submeshes(i);
+            auto glSubmesh = std::make_shared<GLSubmesh>(submesh, releaseVertexData);
             _submeshList.push_back(glSubmesh);
         }
     }
@@ -21,6 +21,7 @@ namespace carto { namespace nml {
     class GLMesh final {
     public:
         explicit GLMesh(const Mesh& mesh);
+        explicit GLMesh(const Mesh& mesh, bool releaseVertexData); // if releaseVertexData is set, the mesh can not be used as a source of mesh ops once it is created
         explicit GLMesh(const GLMesh& glMesh, const MeshOp& meshOp);
 
         void create(GLResourceManager& resourceManager);
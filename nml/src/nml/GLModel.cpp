@@ -24,11 +24,11 @@ namespace carto { namespace nml {
             _textureMap[texture->id()] = glTexture;
         }
         
-        // Build map from meshes to GL mesh objects
+        // Build map from meshes to GL mesh objects. The meshes are not shared outside of the model, so their vertex data can be released after uploading
         std::map<std::string, std::shared_ptr<GLMesh>> meshMap;
         for (int i = 0; i < model.meshes_size(); i++) {
             const Mesh& mesh = model.meshes(i);
-            auto glMesh = std::make_shared<GLMesh>(model.meshes(i));
+            auto glMesh = std::make_shared<GLMesh>(model.meshes(i), true);
             meshMap[mesh.id()] = glMesh;
             _meshMap[mesh.id()] = { glMesh, std::shared_ptr<MeshOp>() };
         }
@@ -3,23 +3,25 @@
 #include "GLResourceManager.h"
 #include "Package.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
 
 namespace carto { namespace nml {
 
-    GLSubmesh::GLSubmesh(const Submesh& submesh) :
+    GLSubmesh::GLSubmesh(const Submesh& submesh, bool releaseVertexData) :
         _glType(-1),
         _vertexCounts(),
         _materialId(),
         _positionBuffer(),
-        _normalBuffer(),
-        _uvBuffer(),
-        _colorBuffer(),
+        _attributeBuffer(),
         _vertexIdBuffer(),
+        _normalsEnabled(false),
+        _releaseVertexData(releaseVertexData),
         _glPositionVBOId(0),
-        _glNormalVBOId(0),
-        _glUVVBOId(0),
-        _glColorVBOId(0)
+        _glAttributeVBOId(0)
     {
         // Translate submesh type
         _glType = convertType(submesh.type());
@@ -31,13 +33,15 @@ namespace carto { namespace nml {
         }
         _materialId = submesh.material_id();
     
-        // Create vertex buffers
+        // Create vertex buffers. Normals, UVs and colors are decoded directly into the interleaved layout used by GL.
         convertToFloatBuffer(submesh.positions(), _positionBuffer);
-        convertToFloatBuffer(submesh.normals(), _normalBuffer);
-        convertToFloatBuffer(submesh.uvs(), _uvBuffer);
-        _uvBuffer.resize(_positionBuffer.size() / 3 * 2, 0.5f);
-        convertToByteBuffer(submesh.colors(), _colorBuffer);
-        _colorBuffer.resize(_positionBuffer.size() / 3 * 4, 255);
+        _normalsEnabled = !submesh.normals().empty();
+        initializeAttributeBuffer(_positionBuffer.size() / 3);
+        if (_normalsEnabled) {
+            copyToAttributeBuffer(submesh.normals(), 3 * sizeof(float), sizeof(float), 0, getAttributeStride(), _attributeBuffer);
+        }
+        copyToAttributeBuffer(submesh.uvs(), 2 * sizeof(float), sizeof(float), getUVOffset(), getAttributeStride(), _attributeBuffer);
+        copyToAttributeBuffer(submesh.colors(), 4 * sizeof(unsigned char), sizeof(unsigned char), getColorOffset(), getAttributeStride(), _attributeBuffer);
     
         // Generate vertex id buffer
         _vertexIdBuffer.clear();
@@ -53,29 +57,31 @@ namespace carto { namespace nml {
         _vertexCounts(),
         _materialId(),
         _positionBuffer(),
-        _normalBuffer(),
-        _uvBuffer(),
-        _colorBuffer(),
+        _attributeBuffer(),
         _vertexIdBuffer(),
+        _normalsEnabled(false),
+        _releaseVertexData(false),
         _glPositionVBOId(0),
-        _glNormalVBOId(0),
-        _glUVVBOId(0),
-        _glColorVBOId(0)
+        _glAttributeVBOId(0)
     {
         _glType = convertType(submeshOpList.type());
         _materialId = submeshOpList.material_id();
     
         int vertexCount = 0;
         for (int i = 0; i < submeshOpList.submesh_ops_size(); i++) {
-            vertexCount += submeshOpList.submesh_ops(i).count();
+            const SubmeshOp& submeshOp = submeshOpList.submesh_ops(i);
+            const GLSubmesh& src = *glMesh.getSubmeshList()[submeshOp.submesh_idx()];
+            assert(!src._releaseVertexData);
+            vertexCount += submeshOp.count();
+            _normalsEnabled = _normalsEnabled || src._normalsEnabled;
         }
         _vertexCounts.assign(1, vertexCount);
     
         _positionBuffer.reserve(vertexCount * 3);
-        _normalBuffer.reserve(vertexCount * 3);
-        _colorBuffer.reserve(vertexCount * 4);
         _vertexIdBuffer.reserve(vertexCount);
-        _uvBuffer.reserve(vertexCount * 2);
+        initializeAttributeBuffer(vertexCount);
+        std::size_t stride = getAttributeStride();
+        unsigned char* attributePtr = _attributeBuffer.data();
         for (int i = 0; i < submeshOpList.submesh_ops_size(); i++) {
             const SubmeshOp& submeshOp = submeshOpList.submesh_ops(i);
             const GLSubmesh& src = *glMesh.getSubmeshList()[submeshOp.submesh_idx()];
@@ -83,25 +89,24 @@ namespace carto { namespace nml {
             int start = submeshOp.offset(), end = submeshOp.offset() + submeshOp.count();
             _positionBuffer.insert(_positionBuffer.end(), src._positionBuffer.begin() + start * 3, src._positionBuffer.begin() + end * 3);
 
-            if (!src._normalBuffer.empty()) {
-                _normalBuffer.insert(_normalBuffer.end(), src._normalBuffer.begin() + start * 3, src._normalBuffer.begin() + end * 3);
-            }
-
-            if (!src._colorBuffer.empty()) {
-                _colorBuffer.insert(_colorBuffer.end(), src._colorBuffer.begin() + start * 4, src._colorBuffer.begin() + end * 4);
-            }
-
             if (!src._vertexIdBuffer.empty()) {
                 _vertexIdBuffer.insert(_vertexIdBuffer.end(), src._vertexIdBuffer.begin() + start, src._vertexIdBuffer.begin() + end);
             }
 
-            if (!src._uvBuffer.empty()) {
-                for (int idx = start; idx < end; idx++) {
-                    float u = src._uvBuffer[idx * 2 + 0] * submeshOp.tex_u_scale() + submeshOp.tex_u_trans();
-                    float v = src._uvBuffer[idx * 2 + 1] * submeshOp.tex_v_scale() + submeshOp.tex_v_trans();
-                    _uvBuffer.push_back(u);
-                    _uvBuffer.push_back(v);
+            std::size_t srcStride = src.getAttributeStride();
+            for (int idx = start; idx < end; idx++, attributePtr += stride) {
+                const unsigned char* srcAttributePtr = &src._attributeBuffer[idx * srcStride];
+                if (src._normalsEnabled) {
+                    std::memcpy(attributePtr, srcAttributePtr, 3 * sizeof(float));
                 }
+
+                float uv[2];
+                std::memcpy(uv, srcAttributePtr + src.getUVOffset(), sizeof(uv));
+                uv[0] = uv[0] * submeshOp.tex_u_scale() + submeshOp.tex_u_trans();
+                uv[1] = uv[1] * submeshOp.tex_v_scale() + submeshOp.tex_v_trans();
+                std::memcpy(attributePtr + getUVOffset(), uv, sizeof(uv));
+
+                std::memcpy(attributePtr + getColorOffset(), srcAttributePtr + src.getColorOffset(), 4 * sizeof(unsigned char));
             }
         }
     }
@@ -134,12 +139,14 @@ namespace carto { namespace nml {
             return;
         }
 
+        std::size_t stride = getAttributeStride();
+        glBindBuffer(GL_ARRAY_BUFFER, _glAttributeVBOId);
+
         GLint normalLocation = glGetAttribLocation(programId, "aVertexNormal");
         if (normalLocation != -1) {
-            if (!_normalBuffer.empty()) {
-                glBindBuffer(GL_ARRAY_BUFFER, _glNormalVBOId);
+            if (_normalsEnabled) {
                 glEnableVertexAttribArray(normalLocation);
-                glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, 0, 0);
+                glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, stride, 0);
             } else {
                 glDisableVertexAttribArray(normalLocation);
                 glVertexAttrib3f(normalLocation, 0, 0, 0);
@@ -148,26 +155,14 @@ namespace carto { namespace nml {
 
         GLint uvLocation = glGetAttribLocation(programId, "aVertexUV");
         if (uvLocation != -1) {
-            if (!_uvBuffer.empty()) {
-                glBindBuffer(GL_ARRAY_BUFFER, _glUVVBOId);
-                glEnableVertexAttribArray(uvLocation);
-                glVertexAttribPointer(uvLocation, 2, GL_FLOAT, GL_FALSE, 0, 0);
-            } else {
-                glDisableVertexAttribArray(uvLocation);
-                glVertexAttrib2f(uvLocation, 0, 0);
-            }
+            glEnableVertexAttribArray(uvLocation);
+            glVertexAttribPointer(uvLocation, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid*>(getUVOffset()));
         }
 
         GLint colorLocation = glGetAttribLocation(programId, "aVertexColor");
         if (colorLocation != -1) {
-            if (!_colorBuffer.empty()) {
-                glBindBuffer(GL_ARRAY_BUFFER, _glColorVBOId);
-                glEnableVertexAttribArray(colorLocation);
-                glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
-            } else {
-                glDisableVertexAttribArray(colorLocation);
-                glVertexAttrib4f(colorLocation, 1, 1, 1, 1);
-            }
+            glEnableVertexAttribArray(colorLocation);
+            glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<const GLvoid*>(getColorOffset()));
         }
     
         // Draw primitives
@@ -185,30 +180,35 @@ namespace carto { namespace nml {
         if (!(_glType == GL_TRIANGLES || _glType == GL_TRIANGLE_FAN || _glType == GL_TRIANGLE_STRIP)) {
             return;
         }
+
+        {
+            std::lock_guard<std::mutex> lock(_bvhMutex);
+            if (_bvhNodes.empty()) {
+                buildBVH();
+            }
+        }
+        if (_bvhNodes.empty()) {
+            return;
+        }
     
-        // Do ray-triangle test for each individual triangles
-        int idx = 0;
-        for (std::size_t i = 0; i < _vertexCounts.size(); i++) {
-            int count = _vertexCounts[i];
-            for (int k = 2; k < count; ) {
-                std::size_t i0, i1, i2;
-                if (_glType == GL_TRIANGLE_FAN) {
-                    i0 = idx;
-                    i1 = idx + k - 1;
-                    i2 = idx + k;
-                    k++;
-                } else if (_glType == GL_TRIANGLE_STRIP) {
-                    i0 = (k & 1) == 0 ? idx + k - 2 : idx + k - 1;
-                    i1 = (k & 1) == 0 ? idx + k - 1 : idx + k - 2;
-                    i2 = idx + k;
-                    k++;
-                } else {
-                    i0 = idx + k - 2;
-                    i1 = idx + k - 1;
-                    i2 = idx + k;
-                    k += 3;
-                }
+        // Traverse the hierarchy and do ray-triangle test for the triangles of the intersected leaf nodes
+        std::vector<std::pair<unsigned int, RayIntersection>> triangleIntersections;
+        std::vector<unsigned int> nodeStack(1, 0);
+        while (!nodeStack.empty()) {
+            const BVHNode& node = _bvhNodes[nodeStack.back()];
+            nodeStack.pop_back();
+            if (!intersectBounds(node.bounds, ray)) {
+                continue;
+            }
+            if (node.count == 0) {
+                nodeStack.push_back(node.index + 1);
+                nodeStack.push_back(node.index);
+                continue;
+            }
 
+            for (unsigned int i = node.index; i < node.index + node.count; i++) {
+                const BVHTriangle& triangle = _bvhTriangles[i];
+                std::size_t i0 = triangle.vertexIndices[0], i1 = triangle.vertexIndices[1], i2 = triangle.vertexIndices[2];
                 cglib::vec3<double> points[] = {
                     cglib::vec3<double>(_positionBuffer[i0 * 3 + 0], _positionBuffer[i0 * 3 + 1], _positionBuffer[i0 * 3 + 2]),
                     cglib::vec3<double>(_positionBuffer[i1 * 3 + 0], _positionBuffer[i1 * 3 + 1], _positionBuffer[i1 * 3 + 2]),
@@ -223,10 +223,17 @@ namespace carto { namespace nml {
                     if (i0 < _vertexIdBuffer.size()) {
                         id = _vertexIdBuffer[i0];
                     }
-                    intersections.push_back(RayIntersection(id, pos, normal));
+                    triangleIntersections.emplace_back(triangle.index, RayIntersection(id, pos, normal));
                 }
             }
-            idx += _vertexCounts[i];
+        }
+
+        // Report the intersections in draw order
+        std::sort(triangleIntersections.begin(), triangleIntersections.end(), [](const std::pair<unsigned int, RayIntersection>& intersection0, const std::pair<unsigned int, RayIntersection>& intersection1) {
+            return intersection0.first < intersection1.first;
+        });
+        for (const std::pair<unsigned int, RayIntersection>& triangleIntersection : triangleIntersections) {
+            intersections.push_back(triangleIntersection.second);
         }
     }
     
@@ -241,13 +248,25 @@ namespace carto { namespace nml {
     int GLSubmesh::getTotalGeometrySize() const {
         std::size_t size = 0;
         size += _positionBuffer.size() * sizeof(float);
-        size += _normalBuffer.size() * sizeof(float);
-        size += _uvBuffer.size() * sizeof(float);
-        size += _colorBuffer.size() * sizeof(unsigned char);
+        size += _positionBuffer.size() / 3 * getAttributeStride();
         size += _vertexIdBuffer.size() * sizeof(unsigned char);
         return static_cast<int>(size);
     }
     
+    void GLSubmesh::initializeAttributeBuffer(std::size_t vertexCount) {
+        // Fill with the defaults used when the submesh does not define the attribute: zero normals, UVs at the texture center and white color
+        std::size_t stride = getAttributeStride();
+        std::vector<unsigned char> defaultAttributes(stride, 0);
+        float defaultUV[2] = { 0.5f, 0.5f };
+        std::memcpy(&defaultAttributes[getUVOffset()], defaultUV, sizeof(defaultUV));
+        std::fill(defaultAttributes.begin() + getColorOffset(), defaultAttributes.end(), 255);
+
+        _attributeBuffer.resize(vertexCount * stride);
+        for (std::size_t i = 0; i < vertexCount; i++) {
+            std::memcpy(&_attributeBuffer[i * stride], defaultAttributes.data(), stride);
+        }
+    }
+    
     void GLSubmesh::uploadSubmesh(GLResourceManager& resourceManager) {
         if (!_positionBuffer.empty()) {
             _glPositionVBOId = resourceManager.allocateBuffer(shared_from_this());
@@ -255,27 +274,200 @@ namespace carto { namespace nml {
             glBufferData(GL_ARRAY_BUFFER, _positionBuffer.size() * sizeof(float), _positionBuffer.data(), GL_STATIC_DRAW);
         }
 
-        if (!_normalBuffer.empty()) {
-            _glNormalVBOId = resourceManager.allocateBuffer(shared_from_this());
-            glBindBuffer(GL_ARRAY_BUFFER, _glNormalVBOId);
-            glBufferData(GL_ARRAY_BUFFER, _normalBuffer.size() * sizeof(float), _normalBuffer.data(), GL_STATIC_DRAW);
-        }
-        
-        if (!_uvBuffer.empty()) {
-            _glUVVBOId = resourceManager.allocateBuffer(shared_from_this());
-            glBindBuffer(GL_ARRAY_BUFFER, _glUVVBOId);
-            glBufferData(GL_ARRAY_BUFFER, _uvBuffer.size() * sizeof(float), _uvBuffer.data(), GL_STATIC_DRAW);
-        }
-        
-        if (!_colorBuffer.empty()) {
-            _glColorVBOId = resourceManager.allocateBuffer(shared_from_this());
-            glBindBuffer(GL_ARRAY_BUFFER, _glColorVBOId);
-            glBufferData(GL_ARRAY_BUFFER, _colorBuffer.size() * sizeof(unsigned char), _colorBuffer.data(), GL_STATIC_DRAW);
+        if (!_attributeBuffer.empty()) {
+            _glAttributeVBOId = resourceManager.allocateBuffer(shared_from_this());
+            glBindBuffer(GL_ARRAY_BUFFER, _glAttributeVBOId);
+            glBufferData(GL_ARRAY_BUFFER, _attributeBuffer.size(), _attributeBuffer.data(), GL_STATIC_DRAW);
         }
     
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // Positions and vertex ids are still needed for ray intersections, other attributes are only needed by GL
+        if (_releaseVertexData) {
+            std::vector<unsigned char>().swap(_attributeBuffer);
+        }
     }
     
+    void GLSubmesh::buildBVH() const {
+        static constexpr int BIN_COUNT = 16;
+        static constexpr unsigned int MIN_LEAF_TRIANGLES = 4;
+        static constexpr unsigned int MAX_LEAF_TRIANGLES = 16;
+
+        // Collect the triangles in draw order
+        std::vector<BVHTriangle> triangles;
+        int idx = 0;
+        for (std::size_t i = 0; i < _vertexCounts.size(); i++) {
+            int count = _vertexCounts[i];
+            for (int k = 2; k < count; ) {
+                unsigned int i0, i1, i2;
+                if (_glType == GL_TRIANGLE_FAN) {
+                    i0 = idx;
+                    i1 = idx + k - 1;
+                    i2 = idx + k;
+                    k++;
+                } else if (_glType == GL_TRIANGLE_STRIP) {
+                    i0 = (k & 1) == 0 ? idx + k - 2 : idx + k - 1;
+                    i1 = (k & 1) == 0 ? idx + k - 1 : idx + k - 2;
+                    i2 = idx + k;
+                    k++;
+                } else {
+                    i0 = idx + k - 2;
+                    i1 = idx + k - 1;
+                    i2 = idx + k;
+                    k += 3;
+                }
+                triangles.push_back({ {{ i0, i1, i2 }}, static_cast<unsigned int>(triangles.size()) });
+            }
+            idx += _vertexCounts[i];
+        }
+        if (triangles.empty()) {
+            return;
+        }
+
+        std::vector<cglib::bbox3<float>> triangleBounds;
+        std::vector<cglib::vec3<float>> triangleCenters;
+        triangleBounds.reserve(triangles.size());
+        triangleCenters.reserve(triangles.size());
+        for (const BVHTriangle& triangle : triangles) {
+            cglib::bbox3<float> bounds = cglib::bbox3<float>::smallest();
+            for (unsigned int vertexIndex : triangle.vertexIndices) {
+                bounds.add(cglib::vec3<float>(_positionBuffer[vertexIndex * 3 + 0], _positionBuffer[vertexIndex * 3 + 1], _positionBuffer[vertexIndex * 3 + 2]));
+            }
+            triangleBounds.push_back(bounds);
+            triangleCenters.push_back(bounds.center());
+        }
+
+        auto calculateArea = [](const cglib::bbox3<float>& bounds) {
+            cglib::vec3<float> size = bounds.size();
+            return bounds.empty() ? 0.0f : 2 * (size(0) * size(1) + size(1) * size(2) + size(2) * size(0));
+        };
+
+        // Build the hierarchy top-down, splitting the nodes using the surface area heuristic evaluated at bin boundaries
+        std::vector<unsigned int> order(triangles.size());
+        for (std::size_t i = 0; i < order.size(); i++) {
+            order[i] = static_cast<unsigned int>(i);
+        }
+        std::vector<BVHNode> nodes(1, BVHNode { cglib::bbox3<float>::smallest(), 0, static_cast<unsigned int>(triangles.size()) });
+        std::vector<unsigned int> nodeStack(1, 0);
+        while (!nodeStack.empty()) {
+            unsigned int nodeIndex = nodeStack.back();
+            nodeStack.pop_back();
+            unsigned int begin = nodes[nodeIndex].index, end = begin + nodes[nodeIndex].count;
+
+            cglib::bbox3<float> bounds = cglib::bbox3<float>::smallest();
+            cglib::bbox3<float> centerBounds = cglib::bbox3<float>::smallest();
+            for (unsigned int i = begin; i < end; i++) {
+                bounds.add(triangleBounds[order[i]]);
+                centerBounds.add(triangleCenters[order[i]]);
+            }
+            nodes[nodeIndex].bounds = bounds;
+            if (end - begin <= MIN_LEAF_TRIANGLES) {
+                continue;
+            }
+
+            cglib::vec3<float> centerSize = centerBounds.size();
+            int axis = (centerSize(0) >= centerSize(1) && centerSize(0) >= centerSize(2) ? 0 : (centerSize(1) >= centerSize(2) ? 1 : 2));
+            unsigned int mid = begin + (end - begin) / 2;
+            if (centerSize(axis) > 0) {
+                auto calculateBin = [&](unsigned int triangleIndex) {
+                    return std::min(BIN_COUNT - 1, static_cast<int>((triangleCenters[triangleIndex](axis) - centerBounds.min(axis)) / centerSize(axis) * BIN_COUNT));
+                };
+
+                std::array<cglib::bbox3<float>, BIN_COUNT> binBounds;
+                std::array<unsigned int, BIN_COUNT> binCounts;
+                binBounds.fill(cglib::bbox3<float>::smallest());
+                binCounts.fill(0);
+                for (unsigned int i = begin; i < end; i++) {
+                    int bin = calculateBin(order[i]);
+                    binBounds[bin].add(triangleBounds[order[i]]);
+                    binCounts[bin]++;
+                }
+
+                // Sweep from both sides to get the cost of each split, relative to the cost of a triangle test
+                std::array<float, BIN_COUNT> rightCosts;
+                cglib::bbox3<float> rightBounds = cglib::bbox3<float>::smallest();
+                unsigned int rightCount = 0;
+                for (int bin = BIN_COUNT - 1; bin > 0; bin--) {
+                    rightBounds.add(binBounds[bin]);
+                    rightCount += binCounts[bin];
+                    rightCosts[bin] = calculateArea(rightBounds) * rightCount;
+                }
+                cglib::bbox3<float> leftBounds = cglib::bbox3<float>::smallest();
+                unsigned int leftCount = 0;
+                int bestBin = -1;
+                float bestCost = std::numeric_limits<float>::infinity();
+                for (int bin = 1; bin < BIN_COUNT; bin++) {
+                    leftBounds.add(binBounds[bin - 1]);
+                    leftCount += binCounts[bin - 1];
+                    float cost = calculateArea(leftBounds) * leftCount + rightCosts[bin];
+                    if (leftCount > 0 && leftCount < end - begin && cost < bestCost) {
+                        bestBin = bin;
+                        bestCost = cost;
+                    }
+                }
+
+                float area = calculateArea(bounds);
+                if (bestBin != -1 && (area <= 0 || 1 + bestCost / area < end - begin || end - begin > MAX_LEAF_TRIANGLES)) {
+                    mid = static_cast<unsigned int>(std::partition(order.begin() + begin, order.begin() + end, [&](unsigned int triangleIndex) {
+                        return calculateBin(triangleIndex) < bestBin;
+                    }) - order.begin());
+                } else if (end - begin <= MAX_LEAF_TRIANGLES) {
+                    continue;
+                } else {
+                    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](unsigned int triangleIndex0, unsigned int triangleIndex1) {
+                        return triangleCenters[triangleIndex0](axis) < triangleCenters[triangleIndex1](axis);
+                    });
+                }
+            } else if (end - begin <= MAX_LEAF_TRIANGLES) {
+                continue; // all triangles have the same center
+            }
+
+            unsigned int childIndex = static_cast<unsigned int>(nodes.size());
+            nodes[nodeIndex].index = childIndex;
+            nodes[nodeIndex].count = 0;
+            nodes.push_back(BVHNode { cglib::bbox3<float>::smallest(), begin, mid - begin });
+            nodes.push_back(BVHNode { cglib::bbox3<float>::smallest(), mid, end - mid });
+            nodeStack.push_back(childIndex + 1);
+            nodeStack.push_back(childIndex);
+        }
+
+        // Pad the bounds, so that rounding in the box test never rejects a triangle touching the box
+        const cglib::bbox3<float>& rootBounds = nodes.front().bounds;
+        float scale = 0;
+        for (int i = 0; i < 3; i++) {
+            scale = std::max(scale, std::max(rootBounds.max(i) - rootBounds.min(i), std::max(std::abs(rootBounds.min(i)), std::abs(rootBounds.max(i)))));
+        }
+        cglib::vec3<float> padding(scale * 1.0e-5f, scale * 1.0e-5f, scale * 1.0e-5f);
+        for (BVHNode& node : nodes) {
+            node.bounds = cglib::bbox3<float>(node.bounds.min - padding, node.bounds.max + padding);
+        }
+
+        _bvhTriangles.clear();
+        _bvhTriangles.reserve(triangles.size());
+        for (unsigned int triangleIndex : order) {
+            _bvhTriangles.push_back(triangles[triangleIndex]);
+        }
+        _bvhNodes = std::move(nodes);
+    }
+
+    bool GLSubmesh::intersectBounds(const cglib::bbox3<float>& bounds, const cglib::ray3<double>& ray) {
+        // Slab test against the whole line, so that culling never rejects a triangle accepted by the triangle test
+        double tMin = -std::numeric_limits<double>::infinity(), tMax = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < 3; i++) {
+            if (ray.direction(i) == 0) {
+                if (ray.origin(i) < bounds.min(i) || ray.origin(i) > bounds.max(i)) {
+                    return false;
+                }
+                continue;
+            }
+            double t0 = (bounds.min(i) - ray.origin(i)) / ray.direction(i);
+            double t1 = (bounds.max(i) - ray.origin(i)) / ray.direction(i);
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        return tMin <= tMax;
+    }
+
     GLint GLSubmesh::convertType(int type) {
         GLint glType = -1;
         switch (type) {
@@ -323,13 +515,25 @@ namespace carto { namespace nml {
         }
     }
     
-    void GLSubmesh::convertToByteBuffer(const std::string& str, std::vector<unsigned char>& buf) {
-        if (str.empty()) {
-            buf.clear();
-            return;
+    void GLSubmesh::copyToAttributeBuffer(const std::string& str, std::size_t elementSize, std::size_t componentSize, std::size_t offset, std::size_t stride, std::vector<unsigned char>& buf) {
+        // Copy whole components only, the last element may be incomplete
+        std::size_t size = std::min(str.size() / componentSize * componentSize, buf.size() / stride * elementSize);
+        std::size_t count = (size + elementSize - 1) / elementSize;
+        const unsigned char* srcPtr = reinterpret_cast<const unsigned char*>(str.data());
+        for (std::size_t i = 0; i < count; i++) {
+            std::memcpy(&buf[i * stride + offset], srcPtr + i * elementSize, std::min(elementSize, size - i * elementSize));
+        }
+
+        // Detect if the host is big-endian - swap bytes of the components in that case
+        int num = 1;
+        if (*(char*)&num != 1 && componentSize > 1) {
+            for (std::size_t i = 0; i < count; i++) {
+                unsigned char* bytePtr = &buf[i * stride + offset];
+                for (std::size_t j = 0; j < elementSize && i * elementSize + j < size; j += componentSize) {
+                    std::reverse(bytePtr + j, bytePtr + j + componentSize);
+                }
+            }
         }
-    
-        buf.assign(reinterpret_cast<const unsigned char*>(str.data()), reinterpret_cast<const unsigned char *>(str.data()) + str.size() / sizeof(unsigned char));
     }
     
 } }
@@ -9,7 +9,9 @@
 
 #include "GLBase.h"
 
+#include <array>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -21,7 +23,7 @@ namespace carto { namespace nml {
 
     class GLSubmesh final : public std::enable_shared_from_this<GLSubmesh> {
     public:
-        explicit GLSubmesh(const Submesh& submesh);
+        explicit GLSubmesh(const Submesh& submesh, bool releaseVertexData);
         explicit GLSubmesh(const GLMesh& glMesh, const SubmeshOpList& submeshOpList);
 
         void create(GLResourceManager& resourceManager);
@@ -36,26 +38,46 @@ namespace carto { namespace nml {
         int getTotalGeometrySize() const;
 
     private:
+        struct BVHNode {
+            cglib::bbox3<float> bounds;
+            unsigned int index; // first child node for inner nodes, first triangle for leaf nodes
+            unsigned int count; // number of triangles for leaf nodes, 0 for inner nodes
+        };
+
+        struct BVHTriangle {
+            std::array<unsigned int, 3> vertexIndices;
+            unsigned int index; // index of the triangle in draw order
+        };
+
+        std::size_t getUVOffset() const { return _normalsEnabled ? 3 * sizeof(float) : 0; }
+        std::size_t getColorOffset() const { return getUVOffset() + 2 * sizeof(float); }
+        std::size_t getAttributeStride() const { return getColorOffset() + 4 * sizeof(unsigned char); }
+
+        void initializeAttributeBuffer(std::size_t vertexCount);
         void uploadSubmesh(GLResourceManager& resourceManager);
+        void buildBVH() const;
         
+        static bool intersectBounds(const cglib::bbox3<float>& bounds, const cglib::ray3<double>& ray);
         static GLint convertType(int type);
         static void convertToFloatBuffer(const std::string& str, std::vector<float>& buf);
-        static void convertToByteBuffer(const std::string& str, std::vector<unsigned char>& buf);
+        static void copyToAttributeBuffer(const std::string& str, std::size_t elementSize, std::size_t componentSize, std::size_t offset, std::size_t stride, std::vector<unsigned char>& buf);
 
         GLint _glType;
         std::vector<int> _vertexCounts;
         std::string _materialId;
 
-        std::vector<float> _positionBuffer;
-        std::vector<float> _normalBuffer;
-        std::vector<float> _uvBuffer;
-        std::vector<unsigned char> _colorBuffer;
+        std::vector<float> _positionBuffer; // kept after uploading for ray intersections
+        std::vector<unsigned char> _attributeBuffer; // interleaved normals (if enabled), UVs and colors
         std::vector<unsigned int> _vertexIdBuffer;
+        bool _normalsEnabled;
+        bool _releaseVertexData; // release the attribute buffer once it is uploaded
+
+        mutable std::mutex _bvhMutex;
+        mutable std::vector<BVHNode> _bvhNodes; // built lazily on the first ray query, children of inner nodes are stored next to each other
+        mutable std::vector<BVHTriangle> _bvhTriangles;
 
         GLuint _glPositionVBOId;
-        GLuint _glNormalVBOId;
-        GLuint _glUVVBOId;
-        GLuint _glColorVBOId;
+        GLuint _glAttributeVBOId;
     };
 } }
 
@@ -34,12 +34,17 @@
 #define GL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG 0x8C03
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <mutex>
 #include <memory>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 namespace carto { namespace nml {
 
@@ -117,6 +122,17 @@ namespace carto { namespace nml {
         }
     }
 
+    bool GLTexture::isCompressedFormatSupported(const Texture& texture) {
+        switch (texture.format()) {
+        case Texture::ETC1:
+            return hasGLExtension("GL_OES_compressed_ETC1_RGB8_texture");
+        case Texture::PVRTC:
+            return hasGLExtension("GL_IMG_texture_compression_pvrtc") && texture.width() == texture.height();
+        default:
+            return true;
+        }
+    }
+
     bool GLTexture::hasGLExtension(const char* ext) {
         std::lock_guard<std::mutex> lock(_mutex);
         return _extensions.find(ext) != _extensions.end();
@@ -226,6 +242,16 @@ namespace carto { namespace nml {
     }
     
     void GLTexture::updateMipMaps(const Texture& texture) {
+        // Uncompress the whole mip chain once, instead of uncompressing a copy of the texture for each level
+        if (!isCompressedFormatSupported(texture)) {
+            Texture textureCopy(texture);
+            uncompressTexture(textureCopy);
+            for (int i = 0; i < textureCopy.mipmaps_size(); i++) {
+                updateMipLevel(i, textureCopy);
+            }
+            return;
+        }
+
         for (int i = 0; i < texture.mipmaps_size(); i++) {
             updateMipLevel(i, texture);
         }
@@ -249,60 +275,71 @@ namespace carto { namespace nml {
     }
     
     void GLTexture::uncompressTexture(Texture& texture) {
-        switch (texture.format()) {
-        case Texture::ETC1:
-            for (int i = 0; i < texture.mipmaps_size(); i++) {
-                std::string textureData = texture.mipmaps(i);
-                int etc1Width = (texture.width() + 3) & ~3, etc1Height = (texture.height() + 3) & ~3;
-                std::vector<unsigned int> etc1Image(texture.width() * texture.height());
-                std::size_t offset = 16;
-                for (int y = 0; y + 4 <= etc1Height; y += 4) {
-                    for (int x = 0; x + 4 <= etc1Width; x += 4) {
+        static constexpr int MIN_TASK_BLOCKS = 4096; // minimum number of ETC1 blocks decoded by a single task
+
+        if (texture.format() != Texture::ETC1 && texture.format() != Texture::PVRTC) {
+            return;
+        }
+
+        // Decode all mip levels into a single buffer. ETC1 blocks are independent, so ETC1 levels are split into tasks by rows of blocks.
+        // PVRTC blocks are interpolated with their neighbours, so each PVRTC level is a single task.
+        int width = texture.width(), height = texture.height();
+        std::size_t levelSize = static_cast<std::size_t>(std::max(0, width)) * std::max(0, height);
+        std::vector<std::uint32_t> image(levelSize * texture.mipmaps_size());
+        int blockColumns = (width + 3) >> 2, blockRows = (height + 3) >> 2;
+        int taskBlockRows = (texture.format() == Texture::ETC1 ? std::max(1, MIN_TASK_BLOCKS / std::max(1, blockColumns)) : std::max(1, blockRows));
+        std::size_t levelTaskCount = (levelSize > 0 ? (blockRows + taskBlockRows - 1) / taskBlockRows : 0);
+        std::size_t taskCount = levelTaskCount * texture.mipmaps_size();
+
+        auto decodeTask = [&](std::size_t index) {
+            int level = static_cast<int>(index / levelTaskCount);
+            const std::string& textureData = texture.mipmaps(level);
+            std::uint32_t* levelImage = image.data() + level * levelSize;
+            if (texture.format() == Texture::ETC1) {
+                int firstBlockRow = static_cast<int>(index % levelTaskCount) * taskBlockRows;
+                int lastBlockRow = std::min(firstBlockRow + taskBlockRows, blockRows);
+                std::size_t offset = 16 + static_cast<std::size_t>(firstBlockRow) * blockColumns * (4 * 4 / 2);
+                for (int y = firstBlockRow * 4; y < lastBlockRow * 4; y += 4) {
+                    for (int x = 0; x < blockColumns * 4; x += 4) {
                         unsigned int block[4 * 4];
                         rg_etc1::unpack_etc1_block(&textureData[offset], block);
                         offset += 4 * 4 / 2;
-                        for (int yb = 0; yb < 4; yb++) {
-                            if (y + yb >= texture.height()) {
-                                continue;
-                            }
-                            for (int xb = 0; xb < 4; xb++) {
-                                if (x + xb >= texture.width()) {
-                                    continue;
-                                }
-                                etc1Image[(y + yb) * texture.width() + x + xb] = block[yb * 4 + xb];
+                        for (int yb = 0; yb < 4 && y + yb < height; yb++) {
+                            for (int xb = 0; xb < 4 && x + xb < width; xb++) {
+                                levelImage[(y + yb) * width + x + xb] = block[yb * 4 + xb];
                             }
                         }
                     }
                 }
-                textureData.clear();
-                if (!etc1Image.empty()) {
-                    textureData.assign(reinterpret_cast<const char*>(etc1Image.data()), reinterpret_cast<const char*>(etc1Image.data() + etc1Image.size()));
-                }
-                texture.set_mipmaps(i, textureData);
-            }
-            texture.set_format(Texture::RGBA8);
-            break;
-        
-        case Texture::PVRTC:
-            for (int i = 0; i < texture.mipmaps_size(); i++) {
-                std::string textureData = texture.mipmaps(i);
+            } else {
                 const PVRTextureHeaderV3* header = reinterpret_cast<const PVRTextureHeaderV3*>(textureData.data());
                 bool bpp2 = header->u64PixelFormat == ePVRTPF_PVRTCI_2bpp_RGB || header->u64PixelFormat == ePVRTPF_PVRTCI_2bpp_RGBA;
-                std::vector<unsigned long> pvrtcImage(texture.width() * texture.height());
-                PVRTDecompressPVRTC(&textureData[PVRTEX3_HEADERSIZE], bpp2, texture.width(), texture.height(), reinterpret_cast<unsigned char*>(&pvrtcImage[0]));
-    
-                textureData.clear();
-                if (!pvrtcImage.empty()) {
-                    textureData.assign(reinterpret_cast<const char*>(pvrtcImage.data()), reinterpret_cast<const char*>(pvrtcImage.data() + pvrtcImage.size()));
-                }
-                texture.set_mipmaps(i, textureData);
+                PVRTDecompressPVRTC(&textureData[PVRTEX3_HEADERSIZE], bpp2, width, height, reinterpret_cast<unsigned char*>(levelImage));
             }
-            texture.set_format(Texture::RGBA8);
-            break;
-        
-        default:
-            break;
+        };
+
+        // Workers take tasks in order and write to disjoint parts of the buffer
+        unsigned int threadCount = static_cast<unsigned int>(std::min(static_cast<std::size_t>(std::max(1U, std::thread::hardware_concurrency())), taskCount));
+        std::atomic<std::size_t> nextIndex(0);
+        auto worker = [&]() {
+            for (std::size_t index = nextIndex++; index < taskCount; index = nextIndex++) {
+                decodeTask(index);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        for (int i = 0; i < texture.mipmaps_size(); i++) {
+            const std::uint32_t* levelImage = image.data() + i * levelSize;
+            texture.set_mipmaps(i, std::string(reinterpret_cast<const char*>(levelImage), reinterpret_cast<const char*>(levelImage + levelSize)));
         }
+        texture.set_format(Texture::RGBA8);
     }
 
     std::mutex GLTexture::_mutex;
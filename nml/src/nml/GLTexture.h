@@ -36,6 +36,7 @@ namespace carto { namespace nml {
 
     private:
         static GLuint getSamplerWrapMode(int wrapMode);
+        static bool isCompressedFormatSupported(const Texture& texture);
         static bool hasGLExtension(const char* ext);
         static void uncompressTexture(Texture& texture);
 
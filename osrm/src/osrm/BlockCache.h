@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_OSRM_BLOCKCACHE_H_
+#define _CARTO_OSRM_BLOCKCACHE_H_
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+namespace carto { namespace osrm {
+    template <typename Key, typename Block, typename Hash>
+    class BlockCache final {
+    public:
+        explicit BlockCache(std::size_t maxMemoryUsage) {
+            for (Shard& shard : _shards) {
+                shard.maxMemoryUsage = maxMemoryUsage / SHARD_COUNT;
+            }
+        }
+
+        std::size_t getMemoryUsage() const {
+            std::size_t memoryUsage = 0;
+            for (const Shard& shard : _shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                memoryUsage += shard.memoryUsage;
+            }
+            return memoryUsage;
+        }
+
+        bool read(const Key& key, std::shared_ptr<const Block>& block) {
+            Shard& shard = getShard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entryMap.find(key);
+            if (it == shard.entryMap.end()) {
+                return false;
+            }
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            block = std::get<1>(*it->second);
+            return true;
+        }
+
+        void put(const Key& key, const std::shared_ptr<const Block>& block) {
+            std::size_t memoryUsage = block->getMemoryUsage();
+
+            Shard& shard = getShard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entryMap.find(key);
+            if (it != shard.entryMap.end()) {
+                shard.memoryUsage -= std::get<2>(*it->second);
+                shard.entries.erase(it->second);
+                shard.entryMap.erase(it);
+            }
+
+            // Always keep the latest block, even if it exceeds the budget alone
+            shard.entries.emplace_front(key, block, memoryUsage);
+            shard.entryMap[key] = shard.entries.begin();
+            shard.memoryUsage += memoryUsage;
+            while (shard.memoryUsage > shard.maxMemoryUsage && shard.entries.size() > 1) {
+                shard.memoryUsage -= std::get<2>(shard.entries.back());
+                shard.entryMap.erase(std::get<0>(shard.entries.back()));
+                shard.entries.pop_back();
+            }
+        }
+
+        void clear() {
+            for (Shard& shard : _shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.entries.clear();
+                shard.entryMap.clear();
+                shard.memoryUsage = 0;
+            }
+        }
+
+    private:
+        static constexpr std::size_t SHARD_COUNT = 16;
+
+        using Entry = std::tuple<Key, std::shared_ptr<const Block>, std::size_t>;
+
+        struct Shard {
+            std::list<Entry> entries;
+            std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> entryMap;
+            std::size_t memoryUsage = 0;
+            std::size_t maxMemoryUsage = 0;
+            mutable std::mutex mutex;
+        };
+
+        Shard& getShard(const Key& key) {
+            std::size_t hash = Hash()(key);
+            return _shards[(hash ^ (hash >> 7)) % SHARD_COUNT];
+        }
+
+        std::array<Shard, SHARD_COUNT> _shards;
+    };
+} }
+
+#endif
@@ -2,9 +2,13 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <list>
+#include <numeric>
+#include <algorithm>
 #include <queue>
 #include <unordered_set>
+#include <atomic>
 
 #include <boost/math/constants/constants.hpp>
 
@@ -12,13 +16,15 @@
 
 namespace carto { namespace osrm {
     Graph::Graph(const Settings& settings) :
-        _packages(),
-        _nodeBlockCache(settings.nodeBlockCacheSize),
-        _geometryBlockCache(settings.geometryBlockCacheSize),
-        _nameBlockCache(settings.nameBlockCacheSize),
-        _globalNodeBlockCache(settings.globalNodeBlockCacheSize),
-        _rtreeNodeBlockCache(settings.rtreeNodeBlockCacheSize),
-        _mutex()
+        _packages(std::make_shared<std::vector<Package>>()),
+        _packageCount(0),
+        _nodeBlockCache(settings.nodeBlockCacheMemory),
+        _nodeGeometryBoundsBlockCache(settings.nodeGeometryBoundsBlockCacheMemory),
+        _geometryBlockCache(settings.geometryBlockCacheMemory),
+        _nameBlockCache(settings.nameBlockCacheMemory),
+        _globalNodeBlockCache(settings.globalNodeBlockCacheMemory),
+        _rtreeNodeBlockCache(settings.rtreeNodeBlockCacheMemory),
+        _importMutex()
     {
     }
     
@@ -36,10 +42,12 @@ namespace carto { namespace osrm {
     }
 
     bool Graph::import(const std::shared_ptr<std::ifstream>& file) {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        std::lock_guard<std::mutex> lock(_importMutex);
 
+        auto packages = std::make_shared<std::vector<Package>>(*getPackages());
         Package package;
-        package.packageId = static_cast<int>(_packages.size());
+        package.packageId = static_cast<int>(packages->size());
+        package.fileMutex = std::make_shared<std::mutex>();
         
         auto graphChunk = std::dynamic_pointer_cast<eiff::form_chunk>(eiff::read_chunk(file, true));
         if (!graphChunk) {
@@ -78,30 +86,28 @@ namespace carto { namespace osrm {
         if (!package.nodeChunk || !package.geometryChunk || !package.nameChunk || !package.globalNodeChunk || !package.rtreeNodeChunk) {
             throw std::runtime_error("Graph sections missing");
         }
-        _packages.push_back(std::move(package));
-
-        // Invalidate caches whose contents may depend on other packages
-        _nodeBlockCache.clear();
-        _globalNodeBlockCache.clear();
+        package.nodeBlockOffsets = readBlockOffsets(package.nodeChunk);
+        package.geometryBlockOffsets = readBlockOffsets(package.geometryChunk);
+        package.nameBlockOffsets = readBlockOffsets(package.nameChunk);
+        package.globalNodeBlockOffsets = readBlockOffsets(package.globalNodeChunk);
+        package.rtreeNodeBlockOffsets = readBlockOffsets(package.rtreeNodeChunk);
+        packages->push_back(std::move(package));
+        std::size_t packageCount = packages->size();
+        std::atomic_store(&_packages, std::shared_ptr<const std::vector<Package>>(std::move(packages)));
+
+        // Node and global node blocks resolve references to other packages. Instead of clearing the caches, which would race
+        // with queries still decoding blocks against the previous snapshot, blocks decoded against fewer packages are reloaded on access.
+        _packageCount.store(packageCount);
         return true;
     }
 
     Graph::NodePtr Graph::getNode(NodeId nodeId) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
-
-        std::shared_ptr<NodeBlock> nodeBlock;
-        if (!_nodeBlockCache.read(nodeId.blockId, nodeBlock)) {
-            nodeBlock = loadNodeBlock(nodeId.blockId);
-            _nodeBlockCache.put(nodeId.blockId, nodeBlock);
-        }
-        return NodePtr(nodeBlock, nodeId.elementIndex);
+        return NodePtr(getNodeBlock(nodeId.blockId), nodeId.elementIndex);
     }
 
     std::string Graph::getNodeName(const Node& node) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
-
         NameId nameId = node.nodeData.nameId;
-        std::shared_ptr<NameBlock> nameBlock;
+        std::shared_ptr<const NameBlock> nameBlock;
         if (!_nameBlockCache.read(nameId.blockId, nameBlock)) {
             nameBlock = loadNameBlock(nameId.blockId);
             _nameBlockCache.put(nameId.blockId, nameBlock);
@@ -110,34 +116,37 @@ namespace carto { namespace osrm {
     }
 
     std::vector<WGSPos> Graph::getNodeGeometry(const Node& node) const {
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        std::vector<WGSPos> geometry;
+        getNodeGeometry(node, geometry);
+        return geometry;
+    }
 
+    void Graph::getNodeGeometry(const Node& node, std::vector<WGSPos>& geometry) const {
         GeometryId geometryId = node.nodeData.geometryId;
-        std::shared_ptr<GeometryBlock> geometryBlock;
-        if (!_geometryBlockCache.read(geometryId.blockId, geometryBlock)) {
-            geometryBlock = loadGeometryBlock(geometryId.blockId);
-            _geometryBlockCache.put(geometryId.blockId, geometryBlock);
-        }
+        std::shared_ptr<const GeometryBlock> geometryBlock = getGeometryBlock(geometryId.blockId);
 
-        std::vector<WGSPos> geometry;
-        geometry.reserve(geometryBlock->geometries.at(geometryId.elementIndex).size());
-        for (const Point& point : geometryBlock->geometries.at(geometryId.elementIndex)) {
+        const std::vector<Point>& points = geometryBlock->geometries.at(geometryId.elementIndex);
+        geometry.clear();
+        geometry.reserve(points.size());
+        for (const Point& point : points) {
             geometry.emplace_back(fromPoint(point));
         }
         if (node.nodeData.geometryReversed) {
             std::reverse(geometry.begin(), geometry.end());
         }
-        return geometry;
+    }
+
+    std::size_t Graph::getNodeGeometrySize(const Node& node) const {
+        GeometryId geometryId = node.nodeData.geometryId;
+        return getGeometryBlock(geometryId.blockId)->geometries.at(geometryId.elementIndex).size();
     }
 
     std::vector<Graph::NearestNode> Graph::findNearestNode(const WGSPos& pos) const {
         static const double DIST_THRESHOLD = 1.01;
         
-        std::lock_guard<std::recursive_mutex> lock(_mutex);
-
         // First build a priority queue of the packages, based on distance from package bounding box
         std::priority_queue<SearchRTreeNode> searchRTreeNodeQueue;
-        for (const Package& package : _packages) {
+        for (const Package& package : *getPackages()) {
             double dist = getBBoxDistance(pos, package.bbox);
             searchRTreeNodeQueue.emplace(RTreeNodeId(BlockId(package.packageId, 0), 0), dist);
         }
@@ -165,26 +174,19 @@ namespace carto { namespace osrm {
                 }
 
                 BlockId blockId = nodeBlockId.second;
-                std::shared_ptr<NodeBlock> nodeBlock;
-                if (!_nodeBlockCache.read(blockId, nodeBlock)) {
-                    nodeBlock = loadNodeBlock(blockId);
-                    _nodeBlockCache.put(blockId, nodeBlock);
-                }
+                std::shared_ptr<const NodeBlock> nodeBlock = getNodeBlock(blockId);
 
-                // Fill bounds cache for the node block, if not yet created
-                if (nodeBlock->nodeGeometryBoundsCache.empty()) {
-                    nodeBlock->nodeGeometryBoundsCache.reserve(nodeBlock->nodes.size());
-                    for (unsigned int i = 0; i < nodeBlock->nodes.size(); i++) {
-                        const Node& node = nodeBlock->nodes[i];
-                        std::vector<WGSPos> geometry = getNodeGeometry(node);
-                        nodeBlock->nodeGeometryBoundsCache.push_back(WGSBounds::make_union(geometry.begin(), geometry.end()));
-                    }
+                // Get node geometry bounds of the block, these are kept in a separate cache
+                std::shared_ptr<const NodeGeometryBoundsBlock> nodeGeometryBoundsBlock;
+                if (!_nodeGeometryBoundsBlockCache.read(blockId, nodeGeometryBoundsBlock)) {
+                    nodeGeometryBoundsBlock = loadNodeGeometryBoundsBlock(blockId);
+                    _nodeGeometryBoundsBlockCache.put(blockId, nodeGeometryBoundsBlock);
                 }
 
                 // Build priority queue of the nodes within the block, using distance to geometry bounding box
                 std::priority_queue<SearchGeometry> searchGeometryQueue;
-                for (unsigned int i = 0; i < nodeBlock->nodeGeometryBoundsCache.size(); i++) {
-                    double dist = getBBoxDistance(pos, nodeBlock->nodeGeometryBoundsCache[i]);
+                for (unsigned int i = 0; i < nodeGeometryBoundsBlock->nodeGeometryBounds.size(); i++) {
+                    double dist = getBBoxDistance(pos, nodeGeometryBoundsBlock->nodeGeometryBounds[i]);
                     if (dist <= bestDist * DIST_THRESHOLD) {
                         searchGeometryQueue.emplace(NodeId(blockId, i), dist);
                     }
@@ -228,24 +230,59 @@ namespace carto { namespace osrm {
         }
         return bestNodes;
     }
+
+    std::vector<Graph::NearestNode> Graph::findNearestNodes(const WGSPos& pos, std::size_t count) const {
+        return findNearestNodes(std::vector<WGSPos> { pos }, count).front();
+    }
+
+    std::vector<std::vector<Graph::NearestNode>> Graph::findNearestNodes(const std::vector<WGSPos>& positions, std::size_t count) const {
+        std::vector<NearestNodeSearch> searches;
+        searches.reserve(positions.size());
+        for (const WGSPos& pos : positions) {
+            searches.emplace_back(pos, std::cos(pos(0) * boost::math::constants::pi<double>() / 180.0), count);
+        }
+
+        // Traverse all package trees once, passing down only the searches that can still improve their results
+        if (count > 0) {
+            std::vector<std::size_t> searchIndices(searches.size());
+            std::iota(searchIndices.begin(), searchIndices.end(), 0);
+            std::shared_ptr<const std::vector<Package>> packages = getPackages();
+            std::vector<std::pair<WGSBounds, RTreeNodeId>> rootNodes;
+            for (const Package& package : *packages) {
+                rootNodes.emplace_back(package.bbox, RTreeNodeId(BlockId(package.packageId, 0), 0));
+            }
+            for (const std::pair<std::size_t, std::vector<std::size_t>>& child : filterNearestNodeSearches(rootNodes, searchIndices, searches)) {
+                searchNearestNodes(rootNodes[child.first].second, child.second, searches);
+            }
+        }
+
+        std::vector<std::vector<NearestNode>> nearestNodes;
+        nearestNodes.reserve(searches.size());
+        for (NearestNodeSearch& search : searches) {
+            std::sort_heap(search.heap.begin(), search.heap.end(), NearestNodeSearch::Compare());
+            nearestNodes.emplace_back();
+            nearestNodes.back().reserve(search.heap.size());
+            for (const std::pair<double, NearestNode>& entry : search.heap) {
+                nearestNodes.back().push_back(entry.second);
+            }
+        }
+        return nearestNodes;
+    }
     
-    std::shared_ptr<Graph::NodeBlock> Graph::loadNodeBlock(BlockId blockId) const {
+    std::shared_ptr<const Graph::NodeBlock> Graph::loadNodeBlock(BlockId blockId) const {
         if (blockId.packageId == -1) {
             throw std::runtime_error("Bad package id");
         }
 
-        const Package& package = _packages.at(blockId.packageId);
+        std::shared_ptr<const std::vector<Package>> packages = getPackages();
+        const Package& package = packages->at(blockId.packageId);
 
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.nodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
-
-        std::vector<unsigned char> block;
-        package.nodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        std::vector<unsigned char> block = readBlock(package, package.nodeChunk, package.nodeBlockOffsets, blockId.blockIndex);
 
         bitstreams::input_bitstream bs(std::move(block));
 
         auto nodeBlock = std::make_shared<NodeBlock>();
+        nodeBlock->packageCount = packages->size();
 
         // Read block header
         auto maxInternalNodeIndexBits = bs.read_bits<int>(6);
@@ -366,19 +403,15 @@ namespace carto { namespace osrm {
         return nodeBlock;
     }
 
-    std::shared_ptr<Graph::GeometryBlock> Graph::loadGeometryBlock(BlockId blockId) const {
+    std::shared_ptr<const Graph::GeometryBlock> Graph::loadGeometryBlock(BlockId blockId) const {
         if (blockId.packageId == -1) {
             throw std::runtime_error("Bad package id");
         }
 
-        const Package& package = _packages.at(blockId.packageId);
-
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.geometryChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
+        std::shared_ptr<const std::vector<Package>> packages = getPackages();
+        const Package& package = packages->at(blockId.packageId);
 
-        std::vector<unsigned char> block;
-        package.geometryChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        std::vector<unsigned char> block = readBlock(package, package.geometryChunk, package.geometryBlockOffsets, blockId.blockIndex);
 
         bitstreams::input_bitstream bs(std::move(block));
 
@@ -416,19 +449,15 @@ namespace carto { namespace osrm {
         return geometryBlock;
     }
 
-    std::shared_ptr<Graph::NameBlock> Graph::loadNameBlock(BlockId blockId) const {
+    std::shared_ptr<const Graph::NameBlock> Graph::loadNameBlock(BlockId blockId) const {
         if (blockId.packageId == -1) {
             throw std::runtime_error("Bad package id");
         }
 
-        const Package& package = _packages.at(blockId.packageId);
-
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.nameChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
+        std::shared_ptr<const std::vector<Package>> packages = getPackages();
+        const Package& package = packages->at(blockId.packageId);
 
-        std::vector<unsigned char> block;
-        package.nameChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        std::vector<unsigned char> block = readBlock(package, package.nameChunk, package.nameBlockOffsets, blockId.blockIndex);
 
         bitstreams::input_bitstream bs(std::move(block));
 
@@ -453,23 +482,20 @@ namespace carto { namespace osrm {
         return nameBlock;
     }
     
-    std::shared_ptr<Graph::GlobalNodeBlock> Graph::loadGlobalNodeBlock(BlockId blockId) const {
+    std::shared_ptr<const Graph::GlobalNodeBlock> Graph::loadGlobalNodeBlock(BlockId blockId) const {
         if (blockId.packageId == -1) {
             throw std::runtime_error("Bad package id");
         }
         
-        const Package& package = _packages.at(blockId.packageId);
+        std::shared_ptr<const std::vector<Package>> packages = getPackages();
+        const Package& package = packages->at(blockId.packageId);
         
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.globalNodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
-        
-        std::vector<unsigned char> block;
-        package.globalNodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        std::vector<unsigned char> block = readBlock(package, package.globalNodeChunk, package.globalNodeBlockOffsets, blockId.blockIndex);
         
         bitstreams::input_bitstream bs(std::move(block));
         
         auto globalNodeBlock = std::make_shared<GlobalNodeBlock>();
+        globalNodeBlock->packageCount = packages->size();
         
         auto maxPackageNameBits = bs.read_bits<int>(6);
         auto maxPackagesPerNodeBits = bs.read_bits<int>(6);
@@ -487,7 +513,7 @@ namespace carto { namespace osrm {
                 packageName.append(1, bs.read_bits<char>(8));
             }
             int packageId = -1;
-            for (const Package& package : _packages) {
+            for (const Package& package : *packages) {
                 if (package.packageName == packageName) {
                     packageId = package.packageId;
                     break;
@@ -515,19 +541,15 @@ namespace carto { namespace osrm {
         return globalNodeBlock;
     }
     
-    std::shared_ptr<Graph::RTreeNodeBlock> Graph::loadRTreeNodeBlock(BlockId blockId) const {
+    std::shared_ptr<const Graph::RTreeNodeBlock> Graph::loadRTreeNodeBlock(BlockId blockId) const {
         if (blockId.packageId == -1) {
             throw std::runtime_error("Bad package id");
         }
         
-        const Package& package = _packages.at(blockId.packageId);
+        std::shared_ptr<const std::vector<Package>> packages = getPackages();
+        const Package& package = packages->at(blockId.packageId);
 
-        std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
-        package.rtreeNodeChunk->read(blockOffsetData, sizeof(std::uint32_t) + blockId.blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
-        const std::uint64_t* blockOffsets = reinterpret_cast<std::uint64_t*>(blockOffsetData.data());
-        
-        std::vector<unsigned char> block;
-        package.rtreeNodeChunk->read(block, blockOffsets[0], blockOffsets[1] - blockOffsets[0]);
+        std::vector<unsigned char> block = readBlock(package, package.rtreeNodeChunk, package.rtreeNodeBlockOffsets, blockId.blockIndex);
         
         bitstreams::input_bitstream bs(std::move(block));
         
@@ -579,17 +601,166 @@ namespace carto { namespace osrm {
         return rtreeNodeBlock;
     }
     
+    std::shared_ptr<const Graph::NodeGeometryBoundsBlock> Graph::loadNodeGeometryBoundsBlock(BlockId blockId) const {
+        std::shared_ptr<const NodeBlock> nodeBlock = getNodeBlock(blockId);
+
+        auto nodeGeometryBoundsBlock = std::make_shared<NodeGeometryBoundsBlock>();
+        nodeGeometryBoundsBlock->nodeGeometryBounds.reserve(nodeBlock->nodes.size());
+        for (const Node& node : nodeBlock->nodes) {
+            std::vector<WGSPos> geometry = getNodeGeometry(node);
+            nodeGeometryBoundsBlock->nodeGeometryBounds.push_back(WGSBounds::make_union(geometry.begin(), geometry.end()));
+        }
+        return nodeGeometryBoundsBlock;
+    }
+
+    std::shared_ptr<const Graph::NodeBlock> Graph::getNodeBlock(BlockId blockId) const {
+        std::shared_ptr<const NodeBlock> nodeBlock;
+        if (!_nodeBlockCache.read(blockId, nodeBlock) || nodeBlock->packageCount < _packageCount.load()) {
+            nodeBlock = loadNodeBlock(blockId);
+            _nodeBlockCache.put(blockId, nodeBlock);
+        }
+        return nodeBlock;
+    }
+
+    std::shared_ptr<const Graph::GeometryBlock> Graph::getGeometryBlock(BlockId blockId) const {
+        std::shared_ptr<const GeometryBlock> geometryBlock;
+        if (!_geometryBlockCache.read(blockId, geometryBlock)) {
+            geometryBlock = loadGeometryBlock(blockId);
+            _geometryBlockCache.put(blockId, geometryBlock);
+        }
+        return geometryBlock;
+    }
+
+    std::shared_ptr<const std::vector<Graph::Package>> Graph::getPackages() const {
+        return std::atomic_load(&_packages);
+    }
+
     Graph::NodeId Graph::resolveGlobalNodeId(GlobalNodeId globalNodeId) const {
-        std::shared_ptr<GlobalNodeBlock> globalNodeBlock;
-        if (!_globalNodeBlockCache.read(globalNodeId.blockId, globalNodeBlock)) {
+        std::shared_ptr<const GlobalNodeBlock> globalNodeBlock;
+        if (!_globalNodeBlockCache.read(globalNodeId.blockId, globalNodeBlock) || globalNodeBlock->packageCount < _packageCount.load()) {
             globalNodeBlock = loadGlobalNodeBlock(globalNodeId.blockId);
             _globalNodeBlockCache.put(globalNodeId.blockId, globalNodeBlock);
         }
         return globalNodeBlock->globalNodeIds.at(globalNodeId.elementIndex);
     }
 
+    void Graph::searchNearestNodes(RTreeNodeId rtreeNodeId, const std::vector<std::size_t>& searchIndices, std::vector<NearestNodeSearch>& searches) const {
+        std::shared_ptr<const RTreeNodeBlock> rtreeNodeBlock;
+        if (!_rtreeNodeBlockCache.read(rtreeNodeId.blockId, rtreeNodeBlock)) {
+            rtreeNodeBlock = loadRTreeNodeBlock(rtreeNodeId.blockId);
+            _rtreeNodeBlockCache.put(rtreeNodeId.blockId, rtreeNodeBlock);
+        }
+        const RTreeNode& rtreeNode = rtreeNodeBlock->rtreeNodes.at(rtreeNodeId.elementIndex);
+
+        // Process node blocks first, as these tighten the search bounds before descending into subtrees
+        for (const std::pair<std::size_t, std::vector<std::size_t>>& nodeBlock : filterNearestNodeSearches(rtreeNode.nodeBlockIds, searchIndices, searches)) {
+            searchNearestNodes(rtreeNode.nodeBlockIds[nodeBlock.first].second, nodeBlock.second, searches);
+        }
+        for (const std::pair<std::size_t, std::vector<std::size_t>>& child : filterNearestNodeSearches(rtreeNode.children, searchIndices, searches)) {
+            searchNearestNodes(rtreeNode.children[child.first].second, child.second, searches);
+        }
+    }
+
+    void Graph::searchNearestNodes(BlockId blockId, const std::vector<std::size_t>& searchIndices, std::vector<NearestNodeSearch>& searches) const {
+        std::shared_ptr<const NodeBlock> nodeBlock = getNodeBlock(blockId);
+        std::shared_ptr<const NodeGeometryBoundsBlock> nodeGeometryBoundsBlock;
+        if (!_nodeGeometryBoundsBlockCache.read(blockId, nodeGeometryBoundsBlock)) {
+            nodeGeometryBoundsBlock = loadNodeGeometryBoundsBlock(blockId);
+            _nodeGeometryBoundsBlockCache.put(blockId, nodeGeometryBoundsBlock);
+        }
+
+        // Node geometries are decoded lazily and shared between the searches
+        std::vector<std::vector<WGSPos>> geometries(nodeBlock->nodes.size());
+        for (std::size_t searchIndex : searchIndices) {
+            NearestNodeSearch& search = searches[searchIndex];
+            for (std::size_t i = 0; i < nodeBlock->nodes.size(); i++) {
+                const WGSBounds& nodeGeometryBounds = nodeGeometryBoundsBlock->nodeGeometryBounds[i];
+                if (getBBoxDistance(search.pos, nodeGeometryBounds) > search.getPruneDistance()) {
+                    continue;
+                }
+
+                std::vector<WGSPos>& geometry = geometries[i];
+                if (geometry.empty()) {
+                    getNodeGeometry(nodeBlock->nodes[i], geometry);
+                }
+
+                // Find the closest segment, use segment bounding boxes to skip exact distance calculations. The exact distance uses
+                // the longitude scale of the mean latitude of the query and projected points, so bound it by the scale farthest from the equator.
+                double maxLat = std::max(std::abs(nodeGeometryBounds.min(0)), std::abs(nodeGeometryBounds.max(0)));
+                double lonFactor = std::min(search.lonFactor, std::cos(maxLat * boost::math::constants::pi<double>() / 180.0));
+                double bestDist = search.getMaxDistance();
+                unsigned int bestIndex = 0;
+                WGSPos bestPosProj;
+                for (unsigned int j = 1; j < geometry.size(); j++) {
+                    const WGSPos& p0 = geometry[j - 1];
+                    const WGSPos& p1 = geometry[j];
+                    double bboxDist = std::max(std::min(p0(0), p1(0)) - search.pos(0), search.pos(0) - std::max(p0(0), p1(0)));
+                    bboxDist = std::max(bboxDist, lonFactor * std::max(std::min(p0(1), p1(1)) - search.pos(1), search.pos(1) - std::max(p0(1), p1(1))));
+                    if (bboxDist > bestDist) {
+                        continue;
+                    }
+                    WGSPos posProj = getClosestSegmentPoint(search.pos, p0, p1);
+                    double dist = getPointDistance(search.pos, posProj);
+                    if (dist < bestDist || (bestIndex == 0 && dist <= bestDist)) {
+                        bestDist = dist;
+                        bestIndex = j;
+                        bestPosProj = posProj;
+                    }
+                }
+                if (bestIndex == 0) {
+                    continue;
+                }
+
+                double len = 0, t = 0;
+                for (unsigned int j = 1; j < geometry.size(); j++) {
+                    if (j == bestIndex) {
+                        t = len;
+                    }
+                    len += cglib::length(geometry[j] - geometry[j - 1]);
+                }
+
+                NearestNode nearestNode;
+                nearestNode.nodePos = bestPosProj;
+                nearestNode.nodeId = NodeId(blockId, static_cast<int>(i));
+                nearestNode.geometrySegmentIndex = bestIndex;
+                nearestNode.geometryRelPos = static_cast<float>(len > 0 ? (t + cglib::length(bestPosProj - geometry[bestIndex - 1])) / len : 0.0);
+                search.add(bestDist, nearestNode);
+            }
+        }
+    }
+
+    template <typename T>
+    std::vector<std::pair<std::size_t, std::vector<std::size_t>>> Graph::filterNearestNodeSearches(const std::vector<std::pair<WGSBounds, T>>& children, const std::vector<std::size_t>& searchIndices, const std::vector<NearestNodeSearch>& searches) {
+        // For each child, find the searches that may contain results within the child. Order children by the closest search distance.
+        std::vector<std::pair<double, std::pair<std::size_t, std::vector<std::size_t>>>> filteredChildren;
+        for (std::size_t i = 0; i < children.size(); i++) {
+            double minDist = std::numeric_limits<double>::infinity();
+            std::vector<std::size_t> childSearchIndices;
+            for (std::size_t searchIndex : searchIndices) {
+                double dist = getBBoxDistance(searches[searchIndex].pos, children[i].first);
+                if (dist <= searches[searchIndex].getPruneDistance()) {
+                    minDist = std::min(minDist, dist);
+                    childSearchIndices.push_back(searchIndex);
+                }
+            }
+            if (!childSearchIndices.empty()) {
+                filteredChildren.emplace_back(minDist, std::make_pair(i, std::move(childSearchIndices)));
+            }
+        }
+        std::stable_sort(filteredChildren.begin(), filteredChildren.end(), [](const std::pair<double, std::pair<std::size_t, std::vector<std::size_t>>>& child1, const std::pair<double, std::pair<std::size_t, std::vector<std::size_t>>>& child2) {
+            return child1.first < child2.first;
+        });
+
+        std::vector<std::pair<std::size_t, std::vector<std::size_t>>> result;
+        result.reserve(filteredChildren.size());
+        for (std::pair<double, std::pair<std::size_t, std::vector<std::size_t>>>& child : filteredChildren) {
+            result.push_back(std::move(child.second));
+        }
+        return result;
+    }
+
     Graph::RTreeNode Graph::loadRTreeNode(RTreeNodeId rtreeNodeId) const {
-        std::shared_ptr<RTreeNodeBlock> rtreeNodeBlock;
+        std::shared_ptr<const RTreeNodeBlock> rtreeNodeBlock;
         if (!_rtreeNodeBlockCache.read(rtreeNodeId.blockId, rtreeNodeBlock)) {
             rtreeNodeBlock = loadRTreeNodeBlock(rtreeNodeId.blockId);
             _rtreeNodeBlockCache.put(rtreeNodeId.blockId, rtreeNodeBlock);
@@ -597,6 +768,45 @@ namespace carto { namespace osrm {
         return rtreeNodeBlock->rtreeNodes.at(rtreeNodeId.elementIndex);
     }
     
+    std::vector<std::uint64_t> Graph::readBlockOffsets(const std::shared_ptr<eiff::data_chunk>& chunk) {
+        // The chunk starts with the block count, followed by the block offset table. Keep the table in memory if it looks consistent,
+        // so that loading a block requires a single read.
+        std::vector<unsigned char> headerData(sizeof(std::uint32_t) + sizeof(std::uint64_t));
+        chunk->read(headerData, 0, headerData.size());
+        std::uint32_t blockCount = 0;
+        std::uint64_t firstBlockOffset = 0;
+        std::memcpy(&blockCount, headerData.data(), sizeof(std::uint32_t));
+        std::memcpy(&firstBlockOffset, headerData.data() + sizeof(std::uint32_t), sizeof(std::uint64_t));
+        if (firstBlockOffset != sizeof(std::uint32_t) + (static_cast<std::uint64_t>(blockCount) + 1) * sizeof(std::uint64_t)) {
+            return std::vector<std::uint64_t>();
+        }
+
+        std::vector<unsigned char> blockOffsetData((blockCount + 1) * sizeof(std::uint64_t));
+        chunk->read(blockOffsetData, sizeof(std::uint32_t), blockOffsetData.size());
+        const std::uint64_t* blockOffsets = reinterpret_cast<const std::uint64_t*>(blockOffsetData.data());
+        return std::vector<std::uint64_t>(blockOffsets, blockOffsets + blockCount + 1);
+    }
+
+    std::vector<unsigned char> Graph::readBlock(const Package& package, const std::shared_ptr<eiff::data_chunk>& chunk, const std::vector<std::uint64_t>& blockOffsets, int blockIndex) {
+        std::lock_guard<std::mutex> lock(*package.fileMutex);
+
+        std::uint64_t blockOffset0 = 0, blockOffset1 = 0;
+        if (blockIndex >= 0 && static_cast<std::size_t>(blockIndex) + 1 < blockOffsets.size()) {
+            blockOffset0 = blockOffsets[blockIndex];
+            blockOffset1 = blockOffsets[blockIndex + 1];
+        }
+        else {
+            std::vector<unsigned char> blockOffsetData(2 * sizeof(std::uint64_t));
+            chunk->read(blockOffsetData, sizeof(std::uint32_t) + blockIndex * sizeof(std::uint64_t), blockOffsetData.size());
+            blockOffset0 = reinterpret_cast<const std::uint64_t*>(blockOffsetData.data())[0];
+            blockOffset1 = reinterpret_cast<const std::uint64_t*>(blockOffsetData.data())[1];
+        }
+
+        std::vector<unsigned char> block;
+        chunk->read(block, blockOffset0, blockOffset1 - blockOffset0);
+        return block;
+    }
+
     WGSPos Graph::getClosestSegmentPoint(const WGSPos& pos, const WGSPos& p0, const WGSPos& p1) {
         // TODO: questionable approximation, we should project all positions to EPSG3857 and the result back
         double lonFactor = std::cos((p0(0) + p1(0)) * 0.5 * boost::math::constants::pi<double>() / 180.0);
@@ -8,7 +8,12 @@
 #define _CARTO_OSRM_GRAPH_H_
 
 #include "Base.h"
+#include "BlockCache.h"
 
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <array>
@@ -17,7 +22,6 @@
 #include <utility>
 #include <functional>
 
-#include <stdext/lru_cache.h>
 #include <stdext/eiff_file.h>
 #include <stdext/bitstream.h>
 
@@ -113,44 +117,87 @@ namespace carto { namespace osrm {
             std::vector<std::vector<Point>> geometries;
 
             GeometryBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                std::size_t size = sizeof(GeometryBlock) + geometries.capacity() * sizeof(std::vector<Point>);
+                for (const std::vector<Point>& geometry : geometries) {
+                    size += geometry.capacity() * sizeof(Point);
+                }
+                return size;
+            }
         };
 
         struct NameBlock {
             std::vector<std::string> names;
 
             NameBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                std::size_t size = sizeof(NameBlock) + names.capacity() * sizeof(std::string);
+                for (const std::string& name : names) {
+                    size += name.capacity();
+                }
+                return size;
+            }
         };
 
         struct NodeBlock {
             std::vector<Node> nodes;
             std::vector<Edge> edges;
-            std::vector<WGSBounds> nodeGeometryBoundsCache;
+            std::size_t packageCount = 0; // number of packages imported when the block was decoded, edges to later packages are unresolved
 
             NodeBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                return sizeof(NodeBlock) + nodes.capacity() * sizeof(Node) + edges.capacity() * sizeof(Edge);
+            }
+        };
+
+        struct NodeGeometryBoundsBlock {
+            std::vector<WGSBounds> nodeGeometryBounds;
+
+            NodeGeometryBoundsBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                return sizeof(NodeGeometryBoundsBlock) + nodeGeometryBounds.capacity() * sizeof(WGSBounds);
+            }
         };
         
         struct GlobalNodeBlock {
             std::vector<NodeId> globalNodeIds;
+            std::size_t packageCount = 0; // number of packages imported when the block was decoded, nodes in later packages are unresolved
             
             GlobalNodeBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                return sizeof(GlobalNodeBlock) + globalNodeIds.capacity() * sizeof(NodeId);
+            }
         };
         
         struct RTreeNodeBlock {
             std::vector<RTreeNode> rtreeNodes;
             
             RTreeNodeBlock() = default;
+
+            std::size_t getMemoryUsage() const {
+                std::size_t size = sizeof(RTreeNodeBlock) + rtreeNodes.capacity() * sizeof(RTreeNode);
+                for (const RTreeNode& rtreeNode : rtreeNodes) {
+                    size += rtreeNode.children.capacity() * sizeof(std::pair<WGSBounds, RTreeNodeId>) + rtreeNode.nodeBlockIds.capacity() * sizeof(std::pair<WGSBounds, BlockId>);
+                }
+                return size;
+            }
         };
         
         struct NodePtr {
             NodePtr() = default;
-            explicit NodePtr(const std::shared_ptr<NodeBlock>& nodeBlock, int elementIndex) : _node(&nodeBlock->nodes.at(elementIndex)), _nodeBlock(nodeBlock) { }
+            explicit NodePtr(const std::shared_ptr<const NodeBlock>& nodeBlock, int elementIndex) : _node(&nodeBlock->nodes.at(elementIndex)), _nodeBlock(nodeBlock) { }
 
             const Node* operator -> () const { return _node; }
             const Node& operator * () const { return *_node; }
 
         private:
             const Node* _node = nullptr;
-            std::shared_ptr<NodeBlock> _nodeBlock; // keep the node pointer valid by holding reference to the node block
+            std::shared_ptr<const NodeBlock> _nodeBlock; // keep the node pointer valid by holding reference to the node block
         };
 
         struct NearestNode {
@@ -163,11 +210,12 @@ namespace carto { namespace osrm {
         };
 
         struct Settings {
-            std::size_t nodeBlockCacheSize = 512;
-            std::size_t geometryBlockCacheSize = 512;
-            std::size_t nameBlockCacheSize = 64;
-            std::size_t globalNodeBlockCacheSize = 64;
-            std::size_t rtreeNodeBlockCacheSize = 16;
+            std::size_t nodeBlockCacheMemory = 16 * 1024 * 1024; // cache budgets in bytes, based on estimated memory usage of decoded blocks
+            std::size_t nodeGeometryBoundsBlockCacheMemory = 2 * 1024 * 1024;
+            std::size_t geometryBlockCacheMemory = 16 * 1024 * 1024;
+            std::size_t nameBlockCacheMemory = 1024 * 1024;
+            std::size_t globalNodeBlockCacheMemory = 1024 * 1024;
+            std::size_t rtreeNodeBlockCacheMemory = 512 * 1024;
 
             Settings() = default;
         };
@@ -178,11 +226,20 @@ namespace carto { namespace osrm {
         bool import(const std::string& fileName);
         bool import(const std::shared_ptr<std::ifstream>& file);
 
+        // Number of imported packages. Data derived from the graph while it had fewer packages may be stale.
+        std::size_t getPackageCount() const { return _packageCount.load(); }
+
         NodePtr getNode(NodeId nodeId) const;
         std::string getNodeName(const Node& node) const;
         std::vector<WGSPos> getNodeGeometry(const Node& node) const;
+        void getNodeGeometry(const Node& node, std::vector<WGSPos>& geometry) const; // replaces contents of the given vector, reusing its storage
+        std::size_t getNodeGeometrySize(const Node& node) const;
         std::vector<NearestNode> findNearestNode(const WGSPos& pos) const;
 
+        // Find up to count closest nodes to the given position(s), ordered by distance. Batch version traverses the tree only once.
+        std::vector<NearestNode> findNearestNodes(const WGSPos& pos, std::size_t count) const;
+        std::vector<std::vector<NearestNode>> findNearestNodes(const std::vector<WGSPos>& positions, std::size_t count) const;
+
     private:
         constexpr static int VERSION = 0;
 
@@ -197,6 +254,12 @@ namespace carto { namespace osrm {
             std::shared_ptr<eiff::data_chunk> nameChunk;
             std::shared_ptr<eiff::data_chunk> globalNodeChunk;
             std::shared_ptr<eiff::data_chunk> rtreeNodeChunk;
+            std::vector<std::uint64_t> nodeBlockOffsets;
+            std::vector<std::uint64_t> geometryBlockOffsets;
+            std::vector<std::uint64_t> nameBlockOffsets;
+            std::vector<std::uint64_t> globalNodeBlockOffsets;
+            std::vector<std::uint64_t> rtreeNodeBlockOffsets;
+            std::shared_ptr<std::mutex> fileMutex; // chunks of the package share the same file stream
             
             Package() = default;
         };
@@ -225,20 +288,72 @@ namespace carto { namespace osrm {
             }
         };
         
-        std::shared_ptr<NodeBlock> loadNodeBlock(BlockId blockId) const;
+        struct NearestNodeSearch {
+            struct Compare {
+                bool operator() (const std::pair<double, NearestNode>& entry1, const std::pair<double, NearestNode>& entry2) const { return entry1.first < entry2.first; }
+            };
+
+            WGSPos pos;
+            double lonFactor = 1;
+            std::size_t count = 0;
+            std::vector<std::pair<double, NearestNode>> heap; // bounded max-heap of the closest nodes found so far
 
-        std::shared_ptr<GeometryBlock> loadGeometryBlock(BlockId blockId) const;
+            explicit NearestNodeSearch(const WGSPos& pos, double lonFactor, std::size_t count) : pos(pos), lonFactor(lonFactor), count(count) { }
 
-        std::shared_ptr<NameBlock> loadNameBlock(BlockId blockId) const;
+            double getMaxDistance() const {
+                return heap.size() < count ? std::numeric_limits<double>::infinity() : heap.front().first;
+            }
+
+            double getPruneDistance() const {
+                // Bounding box distances use the longitude scale of the query latitude only, allow the same slack as findNearestNode
+                return getMaxDistance() * DIST_THRESHOLD;
+            }
+
+            void add(double dist, const NearestNode& nearestNode) {
+                heap.emplace_back(dist, nearestNode);
+                std::push_heap(heap.begin(), heap.end(), Compare());
+                if (heap.size() > count) {
+                    std::pop_heap(heap.begin(), heap.end(), Compare());
+                    heap.pop_back();
+                }
+            }
+
+        private:
+            static constexpr double DIST_THRESHOLD = 1.01;
+        };
+
+        void searchNearestNodes(RTreeNodeId rtreeNodeId, const std::vector<std::size_t>& searchIndices, std::vector<NearestNodeSearch>& searches) const;
+        void searchNearestNodes(BlockId blockId, const std::vector<std::size_t>& searchIndices, std::vector<NearestNodeSearch>& searches) const;
+
+        template <typename T>
+        static std::vector<std::pair<std::size_t, std::vector<std::size_t>>> filterNearestNodeSearches(const std::vector<std::pair<WGSBounds, T>>& children, const std::vector<std::size_t>& searchIndices, const std::vector<NearestNodeSearch>& searches);
+
+        std::shared_ptr<const NodeBlock> loadNodeBlock(BlockId blockId) const;
+
+        std::shared_ptr<const GeometryBlock> loadGeometryBlock(BlockId blockId) const;
+
+        std::shared_ptr<const NameBlock> loadNameBlock(BlockId blockId) const;
         
-        std::shared_ptr<GlobalNodeBlock> loadGlobalNodeBlock(BlockId blockId) const;
+        std::shared_ptr<const GlobalNodeBlock> loadGlobalNodeBlock(BlockId blockId) const;
         
-        std::shared_ptr<RTreeNodeBlock> loadRTreeNodeBlock(BlockId blockId) const;
+        std::shared_ptr<const RTreeNodeBlock> loadRTreeNodeBlock(BlockId blockId) const;
+        
+        std::shared_ptr<const NodeGeometryBoundsBlock> loadNodeGeometryBoundsBlock(BlockId blockId) const;
+
+        std::shared_ptr<const NodeBlock> getNodeBlock(BlockId blockId) const;
+
+        std::shared_ptr<const GeometryBlock> getGeometryBlock(BlockId blockId) const;
+
+        std::shared_ptr<const std::vector<Package>> getPackages() const;
         
         NodeId resolveGlobalNodeId(GlobalNodeId globalNodeId) const;
         
         RTreeNode loadRTreeNode(RTreeNodeId rtreeNodeId) const;
 
+        static std::vector<std::uint64_t> readBlockOffsets(const std::shared_ptr<eiff::data_chunk>& chunk);
+
+        static std::vector<unsigned char> readBlock(const Package& package, const std::shared_ptr<eiff::data_chunk>& chunk, const std::vector<std::uint64_t>& blockOffsets, int blockIndex);
+
         static WGSPos getClosestSegmentPoint(const WGSPos& pos, const WGSPos& p0, const WGSPos& p1);
         
         static double getPointDistance(const WGSPos& pos0, const WGSPos& pos1);
@@ -250,14 +365,16 @@ namespace carto { namespace osrm {
         static WGSPos fromPoint(const Point& point);
         static Point toPoint(const WGSPos& pos);
 
-        std::vector<Package> _packages;
+        std::shared_ptr<const std::vector<Package>> _packages; // immutable snapshot, replaced atomically on import
+        std::atomic<std::size_t> _packageCount; // size of the latest package snapshot, cached blocks decoded against fewer packages are stale
 
-        mutable cache::lru_cache<BlockId, std::shared_ptr<NodeBlock>, BlockId::Hash> _nodeBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<GeometryBlock>, BlockId::Hash> _geometryBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<NameBlock>, BlockId::Hash> _nameBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<GlobalNodeBlock>, BlockId::Hash> _globalNodeBlockCache;
-        mutable cache::lru_cache<BlockId, std::shared_ptr<RTreeNodeBlock>, BlockId::Hash> _rtreeNodeBlockCache;
-        mutable std::recursive_mutex _mutex;
+        mutable BlockCache<BlockId, NodeBlock, BlockId::Hash> _nodeBlockCache;
+        mutable BlockCache<BlockId, NodeGeometryBoundsBlock, BlockId::Hash> _nodeGeometryBoundsBlockCache;
+        mutable BlockCache<BlockId, GeometryBlock, BlockId::Hash> _geometryBlockCache;
+        mutable BlockCache<BlockId, NameBlock, BlockId::Hash> _nameBlockCache;
+        mutable BlockCache<BlockId, GlobalNodeBlock, BlockId::Hash> _globalNodeBlockCache;
+        mutable BlockCache<BlockId, RTreeNodeBlock, BlockId::Hash> _rtreeNodeBlockCache;
+        std::mutex _importMutex;
     };
 } }
 
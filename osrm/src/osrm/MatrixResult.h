@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_OSRM_MATRIXRESULT_H_
+#define _CARTO_OSRM_MATRIXRESULT_H_
+
+#include "Base.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace carto { namespace osrm {
+    class MatrixResult final {
+    public:
+        enum class Status {
+            FAILED,
+            SUCCESS
+        };
+
+        MatrixResult() = default;
+        explicit MatrixResult(std::size_t sourceCount, std::size_t targetCount, std::vector<double> times, std::vector<double> distances) : _status(Status::SUCCESS), _sourceCount(sourceCount), _targetCount(targetCount), _times(std::move(times)), _distances(std::move(distances)) { }
+
+        Status getStatus() const { return _status; }
+
+        std::size_t getSourceCount() const { return _sourceCount; }
+        std::size_t getTargetCount() const { return _targetCount; }
+
+        // Travel time in seconds, infinity if the target is not reachable from the source
+        double getTime(std::size_t sourceIndex, std::size_t targetIndex) const { return _times.at(sourceIndex * _targetCount + targetIndex); }
+
+        // Travel distance in meters, infinity if the target is not reachable and NaN if distances were not calculated
+        double getDistance(std::size_t sourceIndex, std::size_t targetIndex) const { return _distances.at(sourceIndex * _targetCount + targetIndex); }
+
+    private:
+        Status _status = Status::FAILED;
+        std::size_t _sourceCount = 0;
+        std::size_t _targetCount = 0;
+        std::vector<double> _times;
+        std::vector<double> _distances;
+    };
+} }
+
+#endif
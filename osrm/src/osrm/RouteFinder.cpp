@@ -1,15 +1,78 @@
 #include "RouteFinder.h"
 
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+
 #include <boost/math/constants/constants.hpp>
 
 namespace carto { namespace osrm {
     Result RouteFinder::find(const Query& query) const {
         std::array<std::vector<Graph::NearestNode>, 2> nearestNodes;
-        std::array<std::priority_queue<SearchNode>, 2> heaps;
+        for (int i = 0; i < 2; i++) {
+            nearestNodes[i] = _graph->findNearestNode(query.getPos(i));
+        }
+        return findRoute(nearestNodes);
+    }
+
+    std::vector<Result> RouteFinder::findRoutes(const std::vector<Query>& queries, unsigned int threadCount) const {
+        if (threadCount == 0) {
+            threadCount = std::max(1U, std::thread::hardware_concurrency());
+        }
+        threadCount = static_cast<unsigned int>(std::min(static_cast<std::size_t>(threadCount), queries.size()));
+
+        // Workers take tasks in input order and write results to fixed slots, so output does not depend on scheduling
+        auto runTasks = [threadCount](std::size_t taskCount, const std::function<void(std::size_t)>& task) {
+            std::atomic<std::size_t> nextIndex(0);
+            std::vector<std::exception_ptr> exceptions(taskCount);
+            auto worker = [&]() {
+                for (std::size_t index = nextIndex++; index < taskCount; index = nextIndex++) {
+                    try {
+                        task(index);
+                    }
+                    catch (...) {
+                        exceptions[index] = std::current_exception();
+                    }
+                }
+            };
+            std::vector<std::thread> threads;
+            for (unsigned int i = 1; i < threadCount; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+            for (const std::exception_ptr& exception : exceptions) {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+        // First resolve the end points of all queries. This also prefetches the end point node blocks into graph caches.
+        std::vector<std::array<std::vector<Graph::NearestNode>, 2>> nearestNodes(queries.size());
+        runTasks(queries.size() * 2, [&](std::size_t index) {
+            nearestNodes[index / 2][index % 2] = _graph->findNearestNode(queries[index / 2].getPos(static_cast<int>(index % 2)));
+        });
+
+        // Now route, each worker thread uses its own search workspace
+        std::vector<Result> results(queries.size());
+        runTasks(queries.size(), [&](std::size_t index) {
+            results[index] = findRoute(nearestNodes[index]);
+        });
+        return results;
+    }
+
+    Result RouteFinder::findRoute(const std::array<std::vector<Graph::NearestNode>, 2>& nearestNodes) const {
+        std::array<SearchSpace, 2>& searchSpaces = getSearchWorkspace().searchSpaces;
+        for (SearchSpace& searchSpace : searchSpaces) {
+            searchSpace.clear();
+        }
         std::unordered_map<Graph::NodeId, PathNode, Graph::NodeId::Hash> pathSuffixMap;
         float minWeight = 0.0f;
         for (int i = 0; i < 2; i++) {
-            nearestNodes[i] = _graph->findNearestNode(query.getPos(i));
             if (nearestNodes[i].empty()) {
                 return Result();
             }
@@ -22,106 +85,80 @@ namespace carto { namespace osrm {
                 minWeight = std::min(minWeight, weight);
 
                 // Special case: we have already added same node but the node is inaccessible along the current direction
-                if (i == 1 && nearestNodes[0].size() == 1 && nearestNodes[1].size() == 1) {
-                    const Graph::NearestNode& otherNearestNode = nearestNodes[1 - i][0];
-                    if (nearestNode.nodeId == otherNearestNode.nodeId && nearestNode.geometryRelPos < otherNearestNode.geometryRelPos) {
-                        // Add all backward edges "leading" to current node
-                        for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
-                            if (edge->backward) {
-                                heaps[i].emplace(edge->targetNodeId, Graph::NodeId(), weight + edge->edgeData.weight);
-                                pathSuffixMap[edge->targetNodeId] = PathNode(edge->targetNodeId, *edge, nearestNode.nodeId);
-                            }
+                if (i == 1 && isTargetBehindSource(nearestNodes[0], nearestNodes[1])) {
+                    // Add all backward edges "leading" to current node
+                    for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
+                        if (edge->backward) {
+                            searchSpaces[i].update(edge->targetNodeId, -1, weight + edge->edgeData.weight);
+                            pathSuffixMap[edge->targetNodeId] = PathNode(edge->targetNodeId, *edge, nearestNode.nodeId);
                         }
+                    }
 
-                        // Here comes the tricky part: we must perform another spatial query to find INCOMING edges pointing to current edge
-                        std::vector<WGSPos> geometry = _graph->getNodeGeometry(*node);
-                        std::vector<Graph::NearestNode> nearestNodes2 = _graph->findNearestNode(geometry.front());
-                        for (const Graph::NearestNode& nearestNode2 : nearestNodes2) {
-                            Graph::NodePtr node2 = _graph->getNode(nearestNode2.nodeId);
-                            for (auto edge2 = node2->firstEdge; edge2 != node2->lastEdge; edge2++) {
-                                if (edge2->forward && edge2->targetNodeId == nearestNode.nodeId) {
-                                    heaps[i].emplace(nearestNode2.nodeId, Graph::NodeId(), weight + edge2->edgeData.weight);
-                                    pathSuffixMap[nearestNode2.nodeId] = PathNode(nearestNode2.nodeId, *edge2, nearestNode.nodeId);
-                                }
+                    // Here comes the tricky part: we must perform another spatial query to find INCOMING edges pointing to current edge
+                    std::vector<WGSPos> geometry = _graph->getNodeGeometry(*node);
+                    std::vector<Graph::NearestNode> nearestNodes2 = _graph->findNearestNode(geometry.front());
+                    for (const Graph::NearestNode& nearestNode2 : nearestNodes2) {
+                        Graph::NodePtr node2 = _graph->getNode(nearestNode2.nodeId);
+                        for (auto edge2 = node2->firstEdge; edge2 != node2->lastEdge; edge2++) {
+                            if (edge2->forward && edge2->targetNodeId == nearestNode.nodeId) {
+                                searchSpaces[i].update(nearestNode2.nodeId, -1, weight + edge2->edgeData.weight);
+                                pathSuffixMap[nearestNode2.nodeId] = PathNode(nearestNode2.nodeId, *edge2, nearestNode.nodeId);
                             }
                         }
-
-                        continue;
                     }
+
+                    continue;
                 }
 
                 // Add the node to heap, if other nodes were not already added
-                heaps[i].emplace(nearestNode.nodeId, Graph::NodeId(), weight);
+                searchSpaces[i].update(nearestNode.nodeId, -1, weight);
             }
         }
 
-        // Apply bidirectional Dijkstra
+        // Apply bidirectional Dijkstra. Search spaces use indexed heaps, so each node is settled at most once.
         Graph::NodeId bestNodeId;
         float bestWeight = std::numeric_limits<float>::infinity();
-        std::array<std::unordered_map<Graph::NodeId, SearchNode, Graph::NodeId::Hash>, 2> settledNodes;
-        for (int i = 0; !(heaps[0].empty() && heaps[1].empty()); i = 1 - i) {
-            if (heaps[i].empty()) {
-                continue;
-            }
-            SearchNode searchNode = heaps[i].top();
-            heaps[i].pop();
-            
-            // Skip all invalid nodes
-            if (searchNode.nodeId.blockId.packageId == -1) {
+        for (int i = 0; !(searchSpaces[0].empty() && searchSpaces[1].empty()); i = 1 - i) {
+            if (searchSpaces[i].empty()) {
                 continue;
             }
 
             // Already shorter path found? In that case we can stop searching in the given direction
-            if (searchNode.weight + minWeight > bestWeight) {
-                while (!heaps[i].empty()) {
-                    heaps[i].pop();
-                }
+            if (searchSpaces[i].getEntry(searchSpaces[i].top()).weight + minWeight > bestWeight) {
+                searchSpaces[i].clearHeap();
                 continue;
             }
-            
-            // Best path to give node?
-            auto it0 = settledNodes[i].find(searchNode.nodeId);
-            if (it0 != settledNodes[i].end()) {
-                if (searchNode.weight >= it0->second.weight) { // not sure if the check is required
-                    continue;
-                }
-            }
 
             // Settle the node
-            settledNodes[i][searchNode.nodeId] = searchNode;
-            
-            // Stalling optimization. This implementation is not optimal, we should also look at non-settled heap nodes
-            Graph::NodePtr node = _graph->getNode(searchNode.nodeId);
-            bool stall = false;
-            for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
-                if ((i == 0 && edge->backward) || (i != 0 && edge->forward)) {
-                    auto it = settledNodes[i].find(edge->targetNodeId);
-                    if (it != settledNodes[i].end()) {
-                        if (it->second.weight + edge->edgeData.weight < searchNode.weight) {
-                            stall = true;
-                            break;
-                        }
-                    }
-                }
+            int index = searchSpaces[i].pop();
+            Graph::NodeId nodeId = searchSpaces[i].getEntry(index).nodeId;
+            float weight = searchSpaces[i].getEntry(index).weight;
+
+            // Skip all invalid nodes
+            if (nodeId.blockId.packageId == -1) {
+                continue;
             }
-            if (stall) {
+
+            // Stalling optimization
+            Graph::NodePtr node = _graph->getNode(nodeId);
+            if (isStalled(searchSpaces[i], *node, i, weight)) {
                 continue;
             }
 
             // Recalculate shortest path and middle node
-            auto it1 = settledNodes[1 - i].find(searchNode.nodeId);
-            if (it1 != settledNodes[1 - i].end()) {
-                float totalWeight = searchNode.weight + it1->second.weight;
+            int otherIndex = searchSpaces[1 - i].find(nodeId);
+            if (otherIndex != -1 && searchSpaces[1 - i].getEntry(otherIndex).settled) {
+                float totalWeight = weight + searchSpaces[1 - i].getEntry(otherIndex).weight;
                 if (totalWeight >= 0 && totalWeight < bestWeight) {
                     bestWeight = totalWeight;
-                    bestNodeId = searchNode.nodeId;
+                    bestNodeId = nodeId;
                 }
             }
 
-            // Add target nodes to heap
+            // Add target nodes to heap or decrease their weights
             for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
                 if ((i == 0 && edge->forward) || (i != 0 && edge->backward)) {
-                    heaps[i].emplace(edge->targetNodeId, searchNode.nodeId, searchNode.weight + edge->edgeData.weight);
+                    searchSpaces[i].update(edge->targetNodeId, index, weight + edge->edgeData.weight);
                 }
             }
         }
@@ -134,106 +171,36 @@ namespace carto { namespace osrm {
         // Unpack path
         std::array<std::vector<PathNode>, 2> paths;
         for (int i = 0; i < 2; i++) {
-            std::stack<std::pair<Graph::NodeId, Graph::NodeId>> stack;
-            Graph::NodeId nodeId = bestNodeId;
-            while (true) {
-                auto it = settledNodes[i].find(nodeId);
-                assert(it != settledNodes[i].end());
-                Graph::NodeId prevNodeId = it->second.prevNodeId;
-                if (prevNodeId.blockId.packageId == -1) {
-                    break;
-                }
-                stack.emplace(prevNodeId, nodeId);
-                nodeId = prevNodeId;
-            }
-
-            while (!stack.empty()) {
-                std::pair<Graph::NodeId, Graph::NodeId> nodeIds = stack.top();
-                stack.pop();
-
-                Graph::NodePtr matchedNode;
-                const Graph::Edge* matchedEdge = nullptr;
-
-                // Find the edge between prevNodeId and nodeId. Do matching based on node ids.
-                Graph::NodeId prevNodeId = nodeIds.first;
-                Graph::NodeId nodeId = nodeIds.second;
-                for (int j = 0; j < 2 && !matchedEdge; j++) {
-                    Graph::NodePtr prevNode = _graph->getNode(prevNodeId);
-                    for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
-                        if (edge->targetNodeId == nodeId && ((j == i && edge->forward) || (j != i && edge->backward))) {
-                            matchedNode = prevNode;
-                            matchedEdge = edge;
-                            break;
-                        }
-                    }
-                    std::swap(nodeId, prevNodeId);
-                }
-                
-                // If the edge was not found, then we have a link between packages with different node encodings. Do slow matching, based on geometry, not node ids
-                for (int j = 0; j < 2 && !matchedEdge; j++) {
-                    Graph::NodePtr prevNode = _graph->getNode(prevNodeId);
-                    Graph::NodePtr node = _graph->getNode(nodeId);
-                    std::vector<WGSPos> nodeGeometry = _graph->getNodeGeometry(*node);
-                    for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
-                        if (edge->targetNodeId.blockId.packageId == -1) {
-                            continue;
-                        }
-                        Graph::NodePtr targetNode = _graph->getNode(edge->targetNodeId);
-                        std::vector<WGSPos> targetNodeGeometry = _graph->getNodeGeometry(*targetNode);
-                        if (nodeGeometry == targetNodeGeometry && ((j == i && edge->forward) || (j != i && edge->backward))) {
-                            matchedNode = prevNode;
-                            matchedEdge = edge;
-                            break;
-                        }
-                    }
-                    std::swap(nodeId, prevNodeId);
-                }
-                
-                // Unpack the matched edge
-                if (matchedEdge) {
-                    if (matchedEdge->contracted) {
-                        if (matchedEdge->contractedNodeId.blockId.packageId == -1) {
-                            return Result(); // Contracted node is not available, packing failed
-                        }
-                        stack.emplace(matchedEdge->contractedNodeId, nodeIds.second);
-                        stack.emplace(nodeIds.first, matchedEdge->contractedNodeId);
-                    }
-                    else {
-                        paths[i].emplace_back(nodeIds.first, *matchedEdge, nodeIds.second);
-                    }
-                } else {
-                    return Result(); // NOTE: this should not happen, unless the graph is broken
-                }
+            if (!unpackPath(searchSpaces[i], searchSpaces[i].find(bestNodeId), i, paths[i])) {
+                return Result();
             }
         }
 
-        // Build joined path. Add pseudo-node at the beginning to simplify processing and add final node, if rerouting in case of one-way street
-        std::vector<PathNode> path;
-        path = paths[0];
-        for (auto it = paths[1].rbegin(); it != paths[1].rend(); it++) {
-            path.emplace_back(it->nextNodeId, it->edge, it->prevNodeId);
-        }
-        if (path.empty()) {
-            path.emplace(path.begin(), bestNodeId, Graph::Edge(), bestNodeId);
-        }
-        else {
-            Graph::NodeId firstNodeId = path.front().prevNodeId;
-            path.emplace(path.begin(), firstNodeId, Graph::Edge(), firstNodeId);
-        }
-
+        // Build joined path and add final node, if rerouting in case of one-way street
+        std::vector<PathNode> path = joinPaths(paths, bestNodeId);
         auto finalNodeIt = pathSuffixMap.find(path.back().nextNodeId);
         if (finalNodeIt != pathSuffixMap.end()) {
             path.push_back(finalNodeIt->second);
         }
 
-        // Construct query result
+        // Construct query result. Reserve the route geometry once and decode node geometries into a single reused buffer.
+        std::vector<Graph::NodePtr> nodes;
+        nodes.reserve(path.size());
+        std::size_t vertexCount = 2;
+        for (const PathNode& pathNode : path) {
+            nodes.push_back(_graph->getNode(pathNode.nextNodeId));
+            vertexCount += _graph->getNodeGeometrySize(*nodes.back());
+        }
         std::vector<Instruction> instructions;
+        instructions.reserve(path.size() + 2);
         std::vector<WGSPos> routeVertices;
+        routeVertices.reserve(vertexCount);
+        std::vector<WGSPos> geometry;
         for (std::size_t j = 0; j < path.size(); j++) {
             Graph::NodeId nodeId = path[j].nextNodeId;
-            Graph::NodePtr node = _graph->getNode(nodeId);
+            const Graph::NodePtr& node = nodes[j];
             
-            std::vector<WGSPos> geometry = _graph->getNodeGeometry(*node);
+            _graph->getNodeGeometry(*node, geometry);
             std::pair<std::size_t, std::size_t> geometryIndex(0, geometry.size());
             std::pair<float, float> geometryRelPos(0.0f, 1.0f);
 
@@ -295,6 +262,326 @@ namespace carto { namespace osrm {
         return Result(std::move(instructions), std::move(routeVertices));
     }
 
+    MatrixResult RouteFinder::findMatrix(const std::vector<WGSPos>& sources, const std::vector<WGSPos>& targets, bool calculateDistances) const {
+        std::vector<double> times(sources.size() * targets.size(), std::numeric_limits<double>::infinity());
+        std::vector<double> distances(sources.size() * targets.size(), calculateDistances ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN());
+        std::array<SearchSpace, 2>& searchSpaces = getSearchWorkspace().searchSpaces;
+
+        // Run backward upward searches from all targets and store the settled nodes in buckets.
+        // If distances are needed, keep only the parent links of the settled nodes for unpacking the paths.
+        std::vector<std::vector<Graph::NearestNode>> targetNearestNodes(targets.size());
+        std::vector<SearchTreeNode> targetSearchTrees;
+        std::vector<int> searchTreeIndices;
+        std::unordered_map<Graph::NodeId, std::vector<BucketEntry>, Graph::NodeId::Hash> buckets;
+        for (std::size_t j = 0; j < targets.size(); j++) {
+            targetNearestNodes[j] = _graph->findNearestNode(targets[j]);
+            initializeSearchSpace(searchSpaces[1], targetNearestNodes[j], 1);
+            searchUpward(searchSpaces[1], 1, [&](int index, const Graph::NodeId& nodeId, float weight) {
+                int treeIndex = -1;
+                if (calculateDistances) {
+                    // Parents are always settled before their children, so their tree indices are already known
+                    int prevIndex = searchSpaces[1].getEntry(index).prevIndex;
+                    treeIndex = static_cast<int>(targetSearchTrees.size());
+                    targetSearchTrees.emplace_back(nodeId, prevIndex == -1 ? -1 : searchTreeIndices[prevIndex]);
+                    if (static_cast<std::size_t>(index) >= searchTreeIndices.size()) {
+                        searchTreeIndices.resize(index + 1, -1);
+                    }
+                    searchTreeIndices[index] = treeIndex;
+                }
+                buckets[nodeId].emplace_back(static_cast<int>(j), treeIndex, weight);
+            });
+        }
+
+        // Run forward upward searches from all sources, scanning the buckets of the settled nodes
+        std::unordered_map<Graph::NodeId, double, Graph::NodeId::Hash> nodeLengthCache;
+        for (std::size_t i = 0; i < sources.size(); i++) {
+            std::vector<Graph::NearestNode> sourceNearestNodes = _graph->findNearestNode(sources[i]);
+            initializeSearchSpace(searchSpaces[0], sourceNearestNodes, 0);
+
+            std::vector<float> bestWeights(targets.size(), std::numeric_limits<float>::infinity());
+            std::vector<std::pair<int, int>> bestIndices(targets.size(), std::pair<int, int>(-1, -1));
+            searchUpward(searchSpaces[0], 0, [&](int index, const Graph::NodeId& nodeId, float weight) {
+                auto it = buckets.find(nodeId);
+                if (it == buckets.end()) {
+                    return;
+                }
+                for (const BucketEntry& bucketEntry : it->second) {
+                    float totalWeight = weight + bucketEntry.weight;
+                    if (totalWeight >= 0 && totalWeight < bestWeights[bucketEntry.targetIndex]) {
+                        bestWeights[bucketEntry.targetIndex] = totalWeight;
+                        bestIndices[bucketEntry.targetIndex] = std::pair<int, int>(index, bucketEntry.index);
+                    }
+                }
+            });
+
+            std::vector<std::size_t> loopTargetIndices;
+            for (std::size_t j = 0; j < targets.size(); j++) {
+                if (isTargetBehindSource(sourceNearestNodes, targetNearestNodes[j])) {
+                    loopTargetIndices.push_back(j);
+                    continue;
+                }
+                if (bestIndices[j].first == -1) {
+                    continue;
+                }
+                times[i * targets.size() + j] = bestWeights[j] / 10.0;
+
+                if (calculateDistances) {
+                    std::array<std::vector<PathNode>, 2> paths;
+                    if (unpackPath(searchSpaces[0], bestIndices[j].first, 0, paths[0]) && unpackPath(targetSearchTrees, bestIndices[j].second, 1, paths[1])) {
+                        std::vector<PathNode> path = joinPaths(paths, searchSpaces[0].getEntry(bestIndices[j].first).nodeId);
+                        distances[i * targets.size() + j] = calculatePathDistance(path, sourceNearestNodes, targetNearestNodes[j], nodeLengthCache);
+                    }
+                }
+            }
+
+            // Targets behind the source on the same node can only be reached by leaving the node and looping back to it.
+            // Bucket searches can not represent this, so route these pairs like single queries. This reuses the search workspace, so it must be done last.
+            for (std::size_t j : loopTargetIndices) {
+                Result result = findRoute(std::array<std::vector<Graph::NearestNode>, 2> {{ sourceNearestNodes, targetNearestNodes[j] }});
+                if (result.getStatus() == Result::Status::SUCCESS) {
+                    times[i * targets.size() + j] = result.getTotalTime();
+                    if (calculateDistances) {
+                        distances[i * targets.size() + j] = result.getTotalDistance();
+                    }
+                }
+            }
+        }
+
+        return MatrixResult(sources.size(), targets.size(), std::move(times), std::move(distances));
+    }
+
+    void RouteFinder::initializeSearchSpace(SearchSpace& searchSpace, const std::vector<Graph::NearestNode>& nearestNodes, int direction) const {
+        searchSpace.clear();
+        for (const Graph::NearestNode& nearestNode : nearestNodes) {
+            Graph::NodePtr node = _graph->getNode(nearestNode.nodeId);
+            float weight = (direction == 0 ? -nearestNode.geometryRelPos : nearestNode.geometryRelPos) * node->nodeData.weight;
+            searchSpace.update(nearestNode.nodeId, -1, weight);
+        }
+    }
+
+    template <typename Visitor>
+    void RouteFinder::searchUpward(SearchSpace& searchSpace, int direction, Visitor visitor) const {
+        while (!searchSpace.empty()) {
+            int index = searchSpace.pop();
+            Graph::NodeId nodeId = searchSpace.getEntry(index).nodeId;
+            float weight = searchSpace.getEntry(index).weight;
+            if (nodeId.blockId.packageId == -1) {
+                continue;
+            }
+
+            Graph::NodePtr node = _graph->getNode(nodeId);
+            if (isStalled(searchSpace, *node, direction, weight)) {
+                continue;
+            }
+
+            visitor(index, nodeId, weight);
+
+            for (auto edge = node->firstEdge; edge != node->lastEdge; edge++) {
+                if ((direction == 0 && edge->forward) || (direction != 0 && edge->backward)) {
+                    searchSpace.update(edge->targetNodeId, index, weight + edge->edgeData.weight);
+                }
+            }
+        }
+    }
+
+    double RouteFinder::calculatePathDistance(const std::vector<PathNode>& path, const std::vector<Graph::NearestNode>& sourceNearestNodes, const std::vector<Graph::NearestNode>& targetNearestNodes, std::unordered_map<Graph::NodeId, double, Graph::NodeId::Hash>& nodeLengthCache) const {
+        // Use same end-point handling as route instructions, so that the distances match the routing results
+        double dist = 0;
+        std::vector<WGSPos> geometry;
+        for (std::size_t j = 0; j < path.size(); j++) {
+            Graph::NodeId nodeId = path[j].nextNodeId;
+            std::pair<float, float> geometryRelPos(0.0f, 1.0f);
+            if (j == 0) {
+                for (const Graph::NearestNode& nearestNode : sourceNearestNodes) {
+                    if (nearestNode.nodeId == nodeId) {
+                        geometryRelPos.first = nearestNode.geometryRelPos;
+                        break;
+                    }
+                }
+            }
+            if (j == path.size() - 1) {
+                for (const Graph::NearestNode& nearestNode : targetNearestNodes) {
+                    if (nearestNode.nodeId == nodeId) {
+                        geometryRelPos.second = nearestNode.geometryRelPos;
+                        break;
+                    }
+                }
+            }
+
+            if (geometryRelPos.first == 0.0f && geometryRelPos.second == 1.0f) {
+                auto it = nodeLengthCache.find(nodeId);
+                if (it == nodeLengthCache.end()) {
+                    _graph->getNodeGeometry(*_graph->getNode(nodeId), geometry);
+                    it = nodeLengthCache.emplace(nodeId, calculateGeometryLength(geometry, 0, 1)).first;
+                }
+                dist += it->second;
+            }
+            else {
+                _graph->getNodeGeometry(*_graph->getNode(nodeId), geometry);
+                dist += calculateGeometryLength(geometry, geometryRelPos.first, geometryRelPos.second);
+            }
+        }
+        return dist;
+    }
+
+    bool RouteFinder::isTargetBehindSource(const std::vector<Graph::NearestNode>& sourceNearestNodes, const std::vector<Graph::NearestNode>& targetNearestNodes) {
+        // True if both end points are on the same node and the target is before the source along the node direction
+        if (sourceNearestNodes.size() != 1 || targetNearestNodes.size() != 1) {
+            return false;
+        }
+        return targetNearestNodes[0].nodeId == sourceNearestNodes[0].nodeId && targetNearestNodes[0].geometryRelPos < sourceNearestNodes[0].geometryRelPos;
+    }
+
+    bool RouteFinder::isStalled(const SearchSpace& searchSpace, const Graph::Node& node, int direction, float weight) {
+        // This implementation is not optimal, we should also look at non-settled heap nodes
+        for (auto edge = node.firstEdge; edge != node.lastEdge; edge++) {
+            if ((direction == 0 && edge->backward) || (direction != 0 && edge->forward)) {
+                int targetIndex = searchSpace.find(edge->targetNodeId);
+                if (targetIndex != -1) {
+                    const SearchSpace::Entry& targetEntry = searchSpace.getEntry(targetIndex);
+                    if (targetEntry.settled && targetEntry.weight + edge->edgeData.weight < weight) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<RouteFinder::PathNode> RouteFinder::joinPaths(const std::array<std::vector<PathNode>, 2>& paths, Graph::NodeId middleNodeId) {
+        // Add pseudo-node at the beginning to simplify processing
+        std::vector<PathNode> path;
+        path.reserve(paths[0].size() + paths[1].size() + 1);
+        if (paths[0].empty() && paths[1].empty()) {
+            path.emplace_back(middleNodeId, Graph::Edge(), middleNodeId);
+            return path;
+        }
+        Graph::NodeId firstNodeId = (paths[0].empty() ? paths[1].back().nextNodeId : paths[0].front().prevNodeId);
+        path.emplace_back(firstNodeId, Graph::Edge(), firstNodeId);
+        path.insert(path.end(), paths[0].begin(), paths[0].end());
+        for (auto it = paths[1].rbegin(); it != paths[1].rend(); it++) {
+            path.emplace_back(it->nextNodeId, it->edge, it->prevNodeId);
+        }
+        return path;
+    }
+
+    bool RouteFinder::unpackPath(const SearchSpace& searchSpace, int index, int direction, std::vector<PathNode>& path) const {
+        std::vector<std::pair<Graph::NodeId, Graph::NodeId>> packedPath;
+        assert(index != -1);
+        while (searchSpace.getEntry(index).prevIndex != -1) {
+            int prevIndex = searchSpace.getEntry(index).prevIndex;
+            packedPath.emplace_back(searchSpace.getEntry(prevIndex).nodeId, searchSpace.getEntry(index).nodeId);
+            index = prevIndex;
+        }
+        return unpackEdges(packedPath, direction, path);
+    }
+
+    bool RouteFinder::unpackPath(const std::vector<SearchTreeNode>& searchTree, int index, int direction, std::vector<PathNode>& path) const {
+        std::vector<std::pair<Graph::NodeId, Graph::NodeId>> packedPath;
+        assert(index != -1);
+        while (searchTree[index].prevIndex != -1) {
+            int prevIndex = searchTree[index].prevIndex;
+            packedPath.emplace_back(searchTree[prevIndex].nodeId, searchTree[index].nodeId);
+            index = prevIndex;
+        }
+        return unpackEdges(packedPath, direction, path);
+    }
+
+    bool RouteFinder::unpackEdges(const std::vector<std::pair<Graph::NodeId, Graph::NodeId>>& packedPath, int direction, std::vector<PathNode>& path) const {
+        // Packed path is ordered from the last edge to the first one
+        for (auto it = packedPath.rbegin(); it != packedPath.rend(); it++) {
+            if (!unpackEdge(it->first, it->second, direction, path)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool RouteFinder::unpackEdge(Graph::NodeId prevNodeId, Graph::NodeId nodeId, int direction, std::vector<PathNode>& path) const {
+        // Unpacked edges are cached, as the same shortcuts tend to appear in many routes and matching edges across packages is slow
+        // Edges unpacked before the last package import are unpacked again, as the geometry based matching depends on the loaded packages
+        std::size_t packageCount = _graph->getPackageCount();
+        PackedEdge packedEdge(prevNodeId, nodeId, direction);
+        std::shared_ptr<const UnpackedEdge> unpackedEdge;
+        if (_unpackedEdgeCache.read(packedEdge, unpackedEdge) && unpackedEdge->packageCount >= packageCount) {
+            path.insert(path.end(), unpackedEdge->pathNodes.begin(), unpackedEdge->pathNodes.end());
+            return true;
+        }
+
+        auto newUnpackedEdge = std::make_shared<UnpackedEdge>();
+        newUnpackedEdge->packageCount = packageCount;
+        std::vector<PathNode>& pathNodes = newUnpackedEdge->pathNodes;
+        std::stack<std::pair<Graph::NodeId, Graph::NodeId>> stack;
+        stack.emplace(prevNodeId, nodeId);
+        while (!stack.empty()) {
+            std::pair<Graph::NodeId, Graph::NodeId> nodeIds = stack.top();
+            stack.pop();
+
+            Graph::NodePtr matchedNode;
+            const Graph::Edge* matchedEdge = nullptr;
+
+            // Find the edge between prevNodeId and nodeId. Do matching based on node ids.
+            Graph::NodeId prevNodeId = nodeIds.first;
+            Graph::NodeId nodeId = nodeIds.second;
+            for (int j = 0; j < 2 && !matchedEdge; j++) {
+                Graph::NodePtr prevNode = _graph->getNode(prevNodeId);
+                for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
+                    if (edge->targetNodeId == nodeId && ((j == direction && edge->forward) || (j != direction && edge->backward))) {
+                        matchedNode = prevNode;
+                        matchedEdge = edge;
+                        break;
+                    }
+                }
+                std::swap(nodeId, prevNodeId);
+            }
+            
+            // If the edge was not found, then we have a link between packages with different node encodings. Do slow matching, based on geometry, not node ids
+            for (int j = 0; j < 2 && !matchedEdge; j++) {
+                Graph::NodePtr prevNode = _graph->getNode(prevNodeId);
+                Graph::NodePtr node = _graph->getNode(nodeId);
+                std::vector<WGSPos> nodeGeometry = _graph->getNodeGeometry(*node);
+                for (auto edge = prevNode->firstEdge; edge != prevNode->lastEdge; edge++) {
+                    if (edge->targetNodeId.blockId.packageId == -1) {
+                        continue;
+                    }
+                    Graph::NodePtr targetNode = _graph->getNode(edge->targetNodeId);
+                    std::vector<WGSPos> targetNodeGeometry = _graph->getNodeGeometry(*targetNode);
+                    if (nodeGeometry == targetNodeGeometry && ((j == direction && edge->forward) || (j != direction && edge->backward))) {
+                        matchedNode = prevNode;
+                        matchedEdge = edge;
+                        break;
+                    }
+                }
+                std::swap(nodeId, prevNodeId);
+            }
+            
+            // Unpack the matched edge
+            if (matchedEdge) {
+                if (matchedEdge->contracted) {
+                    if (matchedEdge->contractedNodeId.blockId.packageId == -1) {
+                        return false; // Contracted node is not available, packing failed
+                    }
+                    stack.emplace(matchedEdge->contractedNodeId, nodeIds.second);
+                    stack.emplace(nodeIds.first, matchedEdge->contractedNodeId);
+                }
+                else {
+                    pathNodes.emplace_back(nodeIds.first, *matchedEdge, nodeIds.second);
+                }
+            } else {
+                return false; // NOTE: this should not happen, unless the graph is broken
+            }
+        }
+
+        _unpackedEdgeCache.put(packedEdge, newUnpackedEdge);
+        path.insert(path.end(), pathNodes.begin(), pathNodes.end());
+        return true;
+    }
+
+    RouteFinder::SearchWorkspace& RouteFinder::getSearchWorkspace() {
+        static thread_local SearchWorkspace workspace;
+        return workspace;
+    }
+
     double RouteFinder::calculateGeometryLength(const std::vector<WGSPos>& geometry, double t0, double t1) {
         double totalLen = 0;
         for (unsigned int j = 1; j < geometry.size(); j++) {
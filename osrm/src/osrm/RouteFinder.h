@@ -10,34 +10,52 @@
 #include "Query.h"
 #include "Instruction.h"
 #include "Result.h"
+#include "MatrixResult.h"
 #include "Graph.h"
+#include "SearchSpace.h"
 
+#include <array>
 #include <queue>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <stack>
 
 namespace carto { namespace osrm {
     class RouteFinder final {
     public:
-        explicit RouteFinder(std::shared_ptr<Graph> graph) : _graph(std::move(graph)) { }
+        explicit RouteFinder(std::shared_ptr<Graph> graph) : _graph(std::move(graph)), _unpackedEdgeCache(UNPACKED_EDGE_CACHE_MEMORY) { }
 
         Result find(const Query& query) const;
 
+        // Routes the queries concurrently using the given number of threads (0 means hardware concurrency). Results are in query order.
+        std::vector<Result> findRoutes(const std::vector<Query>& queries, unsigned int threadCount) const;
+
+        MatrixResult findMatrix(const std::vector<WGSPos>& sources, const std::vector<WGSPos>& targets, bool calculateDistances) const;
+
     private:
         constexpr static double EARTH_RADIUS = 6372797.560856;
+        constexpr static std::size_t UNPACKED_EDGE_CACHE_MEMORY = 4 * 1024 * 1024;
+
+        struct BucketEntry {
+            int targetIndex;
+            int index; // index of the node in the backward search trees, -1 if distances are not calculated
+            float weight;
+
+            explicit BucketEntry(int targetIndex, int index, float weight) : targetIndex(targetIndex), index(index), weight(weight) { }
+        };
 
-        struct SearchNode {
+        struct SearchTreeNode {
             Graph::NodeId nodeId;
-            Graph::NodeId prevNodeId;
-            float weight = 0.0f;
+            int prevIndex;
+
+            explicit SearchTreeNode(Graph::NodeId nodeId, int prevIndex) : nodeId(nodeId), prevIndex(prevIndex) { }
+        };
 
-            SearchNode() = default;
-            SearchNode(Graph::NodeId nodeId, Graph::NodeId prevNodeId, float weight) : nodeId(nodeId), prevNodeId(prevNodeId), weight(weight) { }
+        struct SearchWorkspace {
+            std::array<SearchSpace, 2> searchSpaces; // forward and backward search spaces, reused between queries of the same thread
 
-            bool operator < (const SearchNode& searchNode) const {
-                return weight > searchNode.weight;
-            }
+            SearchWorkspace() = default;
         };
 
         struct PathNode {
@@ -49,11 +67,64 @@ namespace carto { namespace osrm {
             PathNode(Graph::NodeId prevNodeId, const Graph::Edge& edge, Graph::NodeId nextNodeId) : prevNodeId(prevNodeId), edge(edge), nextNodeId(nextNodeId) { }
         };
 
+        struct PackedEdge {
+            Graph::NodeId prevNodeId;
+            Graph::NodeId nodeId;
+            int direction = 0;
+
+            PackedEdge() = default;
+            explicit PackedEdge(Graph::NodeId prevNodeId, Graph::NodeId nodeId, int direction) : prevNodeId(prevNodeId), nodeId(nodeId), direction(direction) { }
+
+            bool operator == (const PackedEdge& packedEdge) const { return prevNodeId == packedEdge.prevNodeId && nodeId == packedEdge.nodeId && direction == packedEdge.direction; }
+
+            struct Hash {
+                std::size_t operator() (const PackedEdge& packedEdge) const { return (Graph::NodeId::Hash()(packedEdge.prevNodeId) * 31 ^ Graph::NodeId::Hash()(packedEdge.nodeId)) * 2 + packedEdge.direction; }
+            };
+        };
+
+        struct UnpackedEdge {
+            std::vector<PathNode> pathNodes;
+            std::size_t packageCount = 0; // number of graph packages when the edge was unpacked, links between packages may resolve differently later
+
+            UnpackedEdge() = default;
+
+            std::size_t getMemoryUsage() const {
+                return sizeof(UnpackedEdge) + pathNodes.capacity() * sizeof(PathNode);
+            }
+        };
+
+        Result findRoute(const std::array<std::vector<Graph::NearestNode>, 2>& nearestNodes) const;
+
+        void initializeSearchSpace(SearchSpace& searchSpace, const std::vector<Graph::NearestNode>& nearestNodes, int direction) const;
+
+        template <typename Visitor>
+        void searchUpward(SearchSpace& searchSpace, int direction, Visitor visitor) const;
+
+        bool unpackPath(const SearchSpace& searchSpace, int index, int direction, std::vector<PathNode>& path) const;
+
+        bool unpackPath(const std::vector<SearchTreeNode>& searchTree, int index, int direction, std::vector<PathNode>& path) const;
+
+        bool unpackEdges(const std::vector<std::pair<Graph::NodeId, Graph::NodeId>>& packedPath, int direction, std::vector<PathNode>& path) const;
+
+        bool unpackEdge(Graph::NodeId prevNodeId, Graph::NodeId nodeId, int direction, std::vector<PathNode>& path) const;
+
+        double calculatePathDistance(const std::vector<PathNode>& path, const std::vector<Graph::NearestNode>& sourceNearestNodes, const std::vector<Graph::NearestNode>& targetNearestNodes, std::unordered_map<Graph::NodeId, double, Graph::NodeId::Hash>& nodeLengthCache) const;
+
+        static bool isTargetBehindSource(const std::vector<Graph::NearestNode>& sourceNearestNodes, const std::vector<Graph::NearestNode>& targetNearestNodes);
+
+        static bool isStalled(const SearchSpace& searchSpace, const Graph::Node& node, int direction, float weight);
+
+        static std::vector<PathNode> joinPaths(const std::array<std::vector<PathNode>, 2>& paths, Graph::NodeId middleNodeId);
+
+        static SearchWorkspace& getSearchWorkspace();
+
         static double calculateGeometryLength(const std::vector<WGSPos>& geometry, double t0, double t1);
 
         static double calculateGreatCircleDistance(const WGSPos& p0, const WGSPos& p1);
 
         const std::shared_ptr<Graph> _graph;
+
+        mutable BlockCache<PackedEdge, UnpackedEdge, PackedEdge::Hash> _unpackedEdgeCache;
     };
 } }
 
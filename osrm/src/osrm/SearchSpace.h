@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_OSRM_SEARCHSPACE_H_
+#define _CARTO_OSRM_SEARCHSPACE_H_
+
+#include "Graph.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+namespace carto { namespace osrm {
+    class SearchSpace final {
+    public:
+        struct Entry {
+            Graph::NodeId nodeId;
+            int prevIndex = -1;
+            float weight = 0.0f;
+            bool settled = false;
+
+            Entry() = default;
+            explicit Entry(Graph::NodeId nodeId, int prevIndex, float weight) : nodeId(nodeId), prevIndex(prevIndex), weight(weight) { }
+
+        private:
+            friend class SearchSpace;
+
+            int heapIndex = -1;
+            std::size_t slotIndex = 0;
+        };
+
+        SearchSpace() : _slots(INITIAL_CAPACITY, -1), _heap(), _entries() { }
+
+        bool empty() const {
+            return _heap.empty();
+        }
+
+        const Entry& getEntry(int index) const {
+            return _entries[index];
+        }
+
+        int find(const Graph::NodeId& nodeId) const {
+            std::size_t mask = _slots.size() - 1;
+            for (std::size_t slotIndex = hashNodeId(nodeId) & mask; _slots[slotIndex] != -1; slotIndex = (slotIndex + 1) & mask) {
+                if (_entries[_slots[slotIndex]].nodeId == nodeId) {
+                    return _slots[slotIndex];
+                }
+            }
+            return -1;
+        }
+
+        int top() const {
+            return _heap.front();
+        }
+
+        int pop() {
+            int index = _heap.front();
+            removeHeapTop();
+            _entries[index].settled = true;
+            return index;
+        }
+
+        bool update(const Graph::NodeId& nodeId, int prevIndex, float weight) {
+            // Insert the node or decrease its weight. Settled nodes are never updated.
+            int index = find(nodeId);
+            if (index == -1) {
+                index = insertEntry(Entry(nodeId, prevIndex, weight));
+                _entries[index].heapIndex = static_cast<int>(_heap.size());
+                _heap.push_back(index);
+            }
+            else {
+                Entry& entry = _entries[index];
+                if (entry.settled || weight >= entry.weight) {
+                    return false;
+                }
+                entry.prevIndex = prevIndex;
+                entry.weight = weight;
+                if (entry.heapIndex == -1) {
+                    entry.heapIndex = static_cast<int>(_heap.size());
+                    _heap.push_back(index);
+                }
+            }
+            siftUp(_entries[index].heapIndex);
+            return true;
+        }
+
+        void clearHeap() {
+            for (int index : _heap) {
+                _entries[index].heapIndex = -1;
+            }
+            _heap.clear();
+        }
+
+        void clear() {
+            // Reset only the slots used by the last search, so that the cost does not depend on table capacity
+            for (const Entry& entry : _entries) {
+                _slots[entry.slotIndex] = -1;
+            }
+            _entries.clear();
+            _heap.clear();
+        }
+
+    private:
+        static constexpr std::size_t INITIAL_CAPACITY = 1024;
+        static constexpr int HEAP_ARITY = 4;
+
+        static std::size_t hashNodeId(const Graph::NodeId& nodeId) {
+            std::uint64_t hash = static_cast<std::uint32_t>(nodeId.blockId.packageId);
+            hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<std::uint32_t>(nodeId.blockId.blockIndex);
+            hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<std::uint32_t>(nodeId.elementIndex);
+            hash *= 0x9E3779B97F4A7C15ULL;
+            return static_cast<std::size_t>(hash ^ (hash >> 32));
+        }
+
+        int insertEntry(const Entry& entry) {
+            // Keep load factor at most 1/2, so that linear probing chains stay short
+            if ((_entries.size() + 1) * 2 > _slots.size()) {
+                _slots.assign(_slots.size() * 2, -1);
+                for (std::size_t i = 0; i < _entries.size(); i++) {
+                    _entries[i].slotIndex = findFreeSlot(_entries[i].nodeId);
+                    _slots[_entries[i].slotIndex] = static_cast<int>(i);
+                }
+            }
+
+            int index = static_cast<int>(_entries.size());
+            _entries.push_back(entry);
+            _entries.back().slotIndex = findFreeSlot(entry.nodeId);
+            _slots[_entries.back().slotIndex] = index;
+            return index;
+        }
+
+        std::size_t findFreeSlot(const Graph::NodeId& nodeId) const {
+            std::size_t mask = _slots.size() - 1;
+            std::size_t slotIndex = hashNodeId(nodeId) & mask;
+            while (_slots[slotIndex] != -1) {
+                slotIndex = (slotIndex + 1) & mask;
+            }
+            return slotIndex;
+        }
+
+        void removeHeapTop() {
+            _entries[_heap.front()].heapIndex = -1;
+            int lastIndex = _heap.back();
+            _heap.pop_back();
+            if (!_heap.empty()) {
+                _heap.front() = lastIndex;
+                _entries[lastIndex].heapIndex = 0;
+                siftDown(0);
+            }
+        }
+
+        void siftUp(int heapIndex) {
+            int index = _heap[heapIndex];
+            float weight = _entries[index].weight;
+            while (heapIndex > 0) {
+                int parentHeapIndex = (heapIndex - 1) / HEAP_ARITY;
+                int parentIndex = _heap[parentHeapIndex];
+                if (_entries[parentIndex].weight <= weight) {
+                    break;
+                }
+                _heap[heapIndex] = parentIndex;
+                _entries[parentIndex].heapIndex = heapIndex;
+                heapIndex = parentHeapIndex;
+            }
+            _heap[heapIndex] = index;
+            _entries[index].heapIndex = heapIndex;
+        }
+
+        void siftDown(int heapIndex) {
+            int index = _heap[heapIndex];
+            float weight = _entries[index].weight;
+            int heapSize = static_cast<int>(_heap.size());
+            while (true) {
+                int firstChildHeapIndex = heapIndex * HEAP_ARITY + 1;
+                if (firstChildHeapIndex >= heapSize) {
+                    break;
+                }
+                int minChildHeapIndex = firstChildHeapIndex;
+                int lastChildHeapIndex = std::min(firstChildHeapIndex + HEAP_ARITY, heapSize);
+                for (int childHeapIndex = firstChildHeapIndex + 1; childHeapIndex < lastChildHeapIndex; childHeapIndex++) {
+                    if (_entries[_heap[childHeapIndex]].weight < _entries[_heap[minChildHeapIndex]].weight) {
+                        minChildHeapIndex = childHeapIndex;
+                    }
+                }
+                int minChildIndex = _heap[minChildHeapIndex];
+                if (_entries[minChildIndex].weight >= weight) {
+                    break;
+                }
+                _heap[heapIndex] = minChildIndex;
+                _entries[minChildIndex].heapIndex = heapIndex;
+                heapIndex = minChildHeapIndex;
+            }
+            _heap[heapIndex] = index;
+            _entries[index].heapIndex = heapIndex;
+        }
+
+        std::vector<int> _slots; // open addressing table of entry indices, capacity is always a power of 2
+        std::vector<int> _heap; // 4-ary min-heap of entry indices
+        std::vector<Entry> _entries;
+    };
+} }
+
+#endif
@@ -1,11 +1,81 @@
 #include "Graph.h"
 
+#include <cmath>
+#include <cstring>
 #include <queue>
+#include <map>
+#include <tuple>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
 #include <algorithm>
 
 #include <boost/math/constants/constants.hpp>
 
 namespace {
+    constexpr std::uint32_t SERIALIZATION_MAGIC = 0x47524753; // 'SGRG'
+    constexpr std::uint32_t SERIALIZATION_VERSION = 2;
+
+    bool isBigEndianHost() {
+        std::uint16_t value = 1;
+        return *reinterpret_cast<const unsigned char*>(&value) == 0;
+    }
+
+    // Binary graph data is stored as fixed size little endian values, 8-byte aligned where possible. Values are byte-swapped on big endian hosts.
+    template <typename T>
+    void writeValue(std::ostream& os, const T& value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if (isBigEndianHost()) {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+        os.write(bytes, sizeof(T));
+    }
+
+    template <typename T>
+    T readValue(std::istream& is) {
+        char bytes[sizeof(T)];
+        if (!is.read(bytes, sizeof(T))) {
+            throw std::runtime_error("Unexpected end of graph data");
+        }
+        if (isBigEndianHost()) {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    void writePoint(std::ostream& os, const carto::sgre::Point& point) {
+        for (int i = 0; i < 3; i++) {
+            writeValue<double>(os, point(i));
+        }
+    }
+
+    carto::sgre::Point readPoint(std::istream& is) {
+        double x = readValue<double>(is);
+        double y = readValue<double>(is);
+        double z = readValue<double>(is);
+        return carto::sgre::Point(x, y, z);
+    }
+
+    void writeAttributes(std::ostream& os, const carto::sgre::RoutingAttributes& attrs) {
+        writeValue<float>(os, attrs.speed);
+        writeValue<float>(os, attrs.zSpeed);
+        writeValue<float>(os, attrs.turnSpeed);
+        writeValue<float>(os, attrs.delay);
+    }
+
+    carto::sgre::RoutingAttributes readAttributes(std::istream& is) {
+        carto::sgre::RoutingAttributes attrs;
+        attrs.speed = readValue<float>(is);
+        attrs.zSpeed = readValue<float>(is);
+        attrs.turnSpeed = readValue<float>(is);
+        attrs.delay = readValue<float>(is);
+        return attrs;
+    }
+
     double clamp(double val, double min, double max) {
         return std::max(min, std::min(max, val));
     }
@@ -13,7 +83,7 @@ namespace {
     bool pointOnLine(const std::array<cglib::vec3<double>, 2>& line, const cglib::vec3<double>& pos) {
         cglib::vec3<double> v0 = line[1] - line[0];
         cglib::vec3<double> v1 = pos - line[0];
-        return (v1 == cglib::vec3<double>(0, 0, 0) || cglib::dot_product(cglib::unit(v0), cglib::unit(v1)) == 1);
+        return (v1 == cglib::vec3<double>(0, 0, 0) || (cglib::dot_product(cglib::unit(v0), cglib::unit(v1)) == 1 && cglib::norm(v1) <= cglib::norm(v0)));
     }
 
     bool pointInsideTriangle(const std::array<cglib::vec3<double>, 3>& triangle, const cglib::vec3<double>& pos) {
@@ -140,48 +210,32 @@ namespace carto { namespace sgre {
         // Add edge ids to nodes
         linkNodeEdgeIds(_nodes, _edges);
 
+        // Build compact adjacency table for path search
+        buildAdjacencyTable();
+
         // Build RTree for faster spatial queries
-        cglib::bbox3<double> bounds = cglib::bbox3<double>::smallest();
-        std::vector<EdgeId> edgeIds;
-        edgeIds.reserve(_edges.size());
-        for (std::size_t i = 0; i < _edges.size(); i++) {
-            EdgeId edgeId = static_cast<EdgeId>(i);
-            const Edge& edge = getEdge(edgeId);
-            const Node& node0 = getNode(edge.nodeIds[0]);
-            const Node& node1 = getNode(edge.nodeIds[1]);
-            bounds.add(node0.points.begin(), node0.points.end());
-            bounds.add(node1.points.begin(), node1.points.end());
-            edgeIds.push_back(edgeId);
-        }
-        _rootNode = buildRTree(bounds, edgeIds);
+        buildRTree();
     }
 
     std::vector<std::pair<Graph::EdgeId, Point>> StaticGraph::findNearestEdgePoint(const Point& pos, const SearchOptions& options) const {
-        struct RTreeNodeRecord {
-            std::shared_ptr<const RTreeNode> node;
-            double dist;
+        using RTreeNodeRecord = std::pair<double, std::uint32_t>;
 
-            bool operator < (const RTreeNodeRecord& rec) const { return rec.dist < dist; }
-        };
-        
         static constexpr double DIST_EPSILON = 1.0e-6;
-        static constexpr double EARTH_RADIUS = 6378137.0;
 
-        double latScale = EARTH_RADIUS * boost::math::constants::pi<double>() / 180.0;
-        double lngScale = latScale * std::max(std::cos(pos(1) * boost::math::constants::pi<double>() / 180.0), 0.01);
-        cglib::vec3<double> scale(lngScale, latScale, options.zSensitivity);
+        cglib::vec3<double> scale = calculateScale(pos, options);
 
         double bestDist = std::numeric_limits<double>::infinity();
-        std::vector<std::pair<Graph::EdgeId, Point>> bestResults;
+        std::vector<std::tuple<double, Graph::EdgeId, Point>> candidates;
 
         // Do the matching starting from root RTree node. Use priority queue for sorting and rejecting subnodes.
-        std::priority_queue<RTreeNodeRecord> nodeQueue;
-        Point nearestRootPos = _rootNode->bounds.nearest_point(pos);
-        double rootDist = calculateDistance(nearestRootPos, pos, scale);
-        nodeQueue.push({ _rootNode, rootDist });
+        std::priority_queue<RTreeNodeRecord, std::vector<RTreeNodeRecord>, std::greater<RTreeNodeRecord>> nodeQueue;
+        if (!_rtreeNodes.empty()) {
+            std::uint32_t rootIndex = static_cast<std::uint32_t>(_rtreeNodes.size() - 1);
+            nodeQueue.emplace(calculateDistance(_rtreeNodes[rootIndex].bounds.nearest_point(pos), pos, scale), rootIndex);
+        }
         while (!nodeQueue.empty()) {
-            std::shared_ptr<const RTreeNode> node = nodeQueue.top().node;
-            double dist = nodeQueue.top().dist;
+            double dist = nodeQueue.top().first;
+            const RTreeNode& node = _rtreeNodes[nodeQueue.top().second];
             nodeQueue.pop();
 
             if (dist > bestDist + DIST_EPSILON) {
@@ -189,34 +243,79 @@ namespace carto { namespace sgre {
             }
 
             // Store subnodes in the priority queue
-            for (const std::shared_ptr<const RTreeNode>& subNode : node->subNodes) {
-                if (subNode) {
-                    Point nearestPos = subNode->bounds.nearest_point(pos);
-                    double dist = calculateDistance(nearestPos, pos, scale);
-                    nodeQueue.push({ subNode, dist });
+            if (!node.leaf) {
+                for (std::uint32_t i = node.firstIndex; i < node.firstIndex + node.count; i++) {
+                    nodeQueue.emplace(calculateDistance(_rtreeNodes[i].bounds.nearest_point(pos), pos, scale), i);
                 }
+                continue;
             }
 
-            // Do slow matching for edges store in this RTree node
-            for (EdgeId edgeId : node->edgeIds) {
-                const Edge& edge = getEdge(edgeId);
-
-                if (auto closestPos = findNearestEdgePoint(edge, pos, scale)) {
+            // Do slow matching for edges stored in this RTree leaf node
+            for (std::uint32_t i = node.firstIndex; i < node.firstIndex + node.count; i++) {
+                EdgeId edgeId = _rtreeEdgeIds[i];
+                if (auto closestPos = findNearestEdgePoint(_edges[edgeId], pos, scale)) {
                     double dist = calculateDistance(*closestPos, pos, scale);
                     if (dist <= bestDist + DIST_EPSILON) {
-                        if (dist + DIST_EPSILON < bestDist) {
-                            bestDist = dist;
-                            bestResults.clear();
-                        }
-                        bestResults.emplace_back(edgeId, *closestPos);
+                        bestDist = std::min(bestDist, dist);
+                        candidates.emplace_back(dist, edgeId, *closestPos);
                     }
                 }
             }
         }
 
+        // Keep all candidates within epsilon of the best distance, in edge id order so that the result does not depend on the traversal order
+        std::vector<std::pair<Graph::EdgeId, Point>> bestResults;
+        for (const std::tuple<double, Graph::EdgeId, Point>& candidate : candidates) {
+            if (std::get<0>(candidate) <= bestDist + DIST_EPSILON) {
+                bestResults.emplace_back(std::get<1>(candidate), std::get<2>(candidate));
+            }
+        }
+        std::sort(bestResults.begin(), bestResults.end(), [](const std::pair<Graph::EdgeId, Point>& result1, const std::pair<Graph::EdgeId, Point>& result2) {
+            return result1.first < result2.first;
+        });
         return bestResults;
     }
 
+    std::vector<std::pair<Graph::EdgeId, Point>> StaticGraph::findNearestEdgePoints(const Point& pos, std::size_t count, const SearchOptions& options) const {
+        struct QueueRecord {
+            double dist;
+            std::uint32_t index;   // RTree node index or edge id
+            bool edge;
+            Point closestPos;
+
+            bool operator < (const QueueRecord& rec) const { return rec.dist < dist; }
+        };
+
+        cglib::vec3<double> scale = calculateScale(pos, options);
+
+        // Best-first search over both RTree nodes and edges. Edges are reported in the order they are popped, which is the order of distance.
+        std::vector<std::pair<Graph::EdgeId, Point>> results;
+        std::priority_queue<QueueRecord> queue;
+        if (!_rtreeNodes.empty()) {
+            std::uint32_t rootIndex = static_cast<std::uint32_t>(_rtreeNodes.size() - 1);
+            queue.push({ calculateDistance(_rtreeNodes[rootIndex].bounds.nearest_point(pos), pos, scale), rootIndex, false, Point() });
+        }
+        while (!queue.empty() && results.size() < count) {
+            QueueRecord rec = queue.top();
+            queue.pop();
+
+            if (rec.edge) {
+                results.emplace_back(static_cast<EdgeId>(rec.index), rec.closestPos);
+                continue;
+            }
+
+            const RTreeNode& node = _rtreeNodes[rec.index];
+            for (std::uint32_t i = node.firstIndex; i < node.firstIndex + node.count; i++) {
+                if (!node.leaf) {
+                    queue.push({ calculateDistance(_rtreeNodes[i].bounds.nearest_point(pos), pos, scale), i, false, Point() });
+                } else if (auto closestPos = findNearestEdgePoint(_edges[_rtreeEdgeIds[i]], pos, scale)) {
+                    queue.push({ calculateDistance(*closestPos, pos, scale), static_cast<std::uint32_t>(_rtreeEdgeIds[i]), true, *closestPos });
+                }
+            }
+        }
+        return results;
+    }
+
     boost::optional<Point> StaticGraph::findNearestEdgePoint(const Edge& edge, const Point& pos, const cglib::vec3<double>& scale) const {
         const Node& node0 = getNode(edge.nodeIds[0]);
         const Node& node1 = getNode(edge.nodeIds[1]);
@@ -292,56 +391,312 @@ namespace carto { namespace sgre {
         return boost::optional<Point>();
     }
 
-    std::shared_ptr<StaticGraph::RTreeNode> StaticGraph::buildRTree(const cglib::bbox3<double>& bounds, std::vector<EdgeId> edgeIds) const {
-        static const std::size_t SPLIT_THRESHOLD = 4;
+    void StaticGraph::buildRTree() {
+        // Build the tree bottom-up using Sort-Tile-Recursive packing. Children of each node are stored contiguously and the root node is the last one.
+        auto calculateEdgeBounds = [this](EdgeId edgeId) {
+            const Node& node0 = _nodes[_edges[edgeId].nodeIds[0]];
+            const Node& node1 = _nodes[_edges[edgeId].nodeIds[1]];
+            cglib::bbox3<double> bounds = cglib::bbox3<double>::smallest();
+            bounds.add(node0.points.begin(), node0.points.end());
+            bounds.add(node1.points.begin(), node1.points.end());
+            return bounds;
+        };
+
+        _rtreeNodes.clear();
+        _rtreeEdgeIds.clear();
+        if (_edges.empty()) {
+            return;
+        }
 
-        // Create non-leaf nodes?
-        if (edgeIds.size() > SPLIT_THRESHOLD) {
-            cglib::bbox3<double> splitBounds[3][2];
-            std::vector<EdgeId> splitEdgeIds[3][2];
-            for (int dim = 0; dim < 3; dim++) {
-                splitBounds[dim][0] = splitBounds[dim][1] = cglib::bbox3<double>::smallest();
+        // Pack edges into leaf nodes
+        std::vector<std::pair<cglib::bbox3<double>, EdgeId>> edgeItems;
+        edgeItems.reserve(_edges.size());
+        for (std::size_t i = 0; i < _edges.size(); i++) {
+            edgeItems.emplace_back(calculateEdgeBounds(static_cast<EdgeId>(i)), static_cast<EdgeId>(i));
+        }
+        sortTiles(edgeItems.begin(), edgeItems.end(), 0);
+
+        std::vector<RTreeNode> levelNodes;
+        _rtreeEdgeIds.reserve(edgeItems.size());
+        for (std::size_t i = 0; i < edgeItems.size(); i += RTREE_FANOUT) {
+            RTreeNode node;
+            node.firstIndex = static_cast<std::uint32_t>(i);
+            node.count = static_cast<std::uint32_t>(std::min(RTREE_FANOUT, edgeItems.size() - i));
+            node.leaf = true;
+            for (std::size_t j = i; j < i + node.count; j++) {
+                node.bounds.add(edgeItems[j].first);
+                _rtreeEdgeIds.push_back(edgeItems[j].second);
             }
+            levelNodes.push_back(node);
+        }
 
-            // Do simple splitting by comparing the center of each edge to the center of the parent
-            cglib::vec3<double> center = bounds.center();
-            for (EdgeId edgeId : edgeIds) {
-                const Edge& edge = getEdge(edgeId);
-                const Node& node0 = getNode(edge.nodeIds[0]);
-                const Node& node1 = getNode(edge.nodeIds[1]);
-                cglib::bbox3<double> edgeBounds = cglib::bbox3<double>::smallest();
-                edgeBounds.add(node0.points.begin(), node0.points.end());
-                edgeBounds.add(node1.points.begin(), node1.points.end());
-                for (int dim = 0; dim < 3; dim++) {
-                    int idx = edgeBounds.center()(dim) < center(dim) ? 0 : 1;
-                    splitBounds[dim][idx].add(edgeBounds);
-                    splitEdgeIds[dim][idx].push_back(edgeId);
-                }
+        // Pack nodes of each level into parent nodes until a single root node remains
+        while (true) {
+            std::vector<std::pair<cglib::bbox3<double>, RTreeNode>> nodeItems;
+            nodeItems.reserve(levelNodes.size());
+            for (const RTreeNode& node : levelNodes) {
+                nodeItems.emplace_back(node.bounds, node);
             }
+            sortTiles(nodeItems.begin(), nodeItems.end(), 0);
 
-            // Find best splitting dimension (best means 'most balanced' by the number of edges here)
-            int bestDim = 0;
-            for (int dim = 1; dim < 3; dim++) {
-                if (std::min(splitEdgeIds[dim][0].size(), splitEdgeIds[dim][1].size()) > std::min(splitEdgeIds[bestDim][0].size(), splitEdgeIds[bestDim][1].size())) {
-                    bestDim = dim;
+            std::size_t levelOffset = _rtreeNodes.size();
+            for (const std::pair<cglib::bbox3<double>, RTreeNode>& nodeItem : nodeItems) {
+                _rtreeNodes.push_back(nodeItem.second);
+            }
+            if (nodeItems.size() == 1) {
+                break;
+            }
+
+            levelNodes.clear();
+            for (std::size_t i = 0; i < nodeItems.size(); i += RTREE_FANOUT) {
+                RTreeNode node;
+                node.firstIndex = static_cast<std::uint32_t>(levelOffset + i);
+                node.count = static_cast<std::uint32_t>(std::min(RTREE_FANOUT, nodeItems.size() - i));
+                node.leaf = false;
+                for (std::size_t j = i; j < i + node.count; j++) {
+                    node.bounds.add(nodeItems[j].first);
                 }
+                levelNodes.push_back(node);
+            }
+        }
+    }
+
+    template <typename T>
+    void StaticGraph::sortTiles(T begin, T end, int dim) {
+        // Sort items by bounds center along the dimension and split into slabs, each slab is then recursively sorted along the next dimension
+        std::size_t itemCount = end - begin;
+        std::sort(begin, end, [dim](const typename T::value_type& item1, const typename T::value_type& item2) {
+            return item1.first.center()(dim) < item2.first.center()(dim);
+        });
+        if (dim == 2 || itemCount <= RTREE_FANOUT) {
+            return;
+        }
+
+        std::size_t nodeCount = (itemCount + RTREE_FANOUT - 1) / RTREE_FANOUT;
+        std::size_t slabCount = static_cast<std::size_t>(std::ceil(std::pow(static_cast<double>(nodeCount), 1.0 / (3 - dim))));
+        std::size_t slabSize = (nodeCount + slabCount - 1) / slabCount * RTREE_FANOUT;
+        for (std::size_t i = 0; i < itemCount; i += slabSize) {
+            sortTiles(begin + i, begin + std::min(i + slabSize, itemCount), dim + 1);
+        }
+    }
+
+    void StaticGraph::serialize(std::ostream& os) const {
+        writeValue<std::uint32_t>(os, SERIALIZATION_MAGIC);
+        writeValue<std::uint32_t>(os, SERIALIZATION_VERSION);
+
+        // Nodes. Outgoing edge ids are not stored, they are restored from the adjacency table.
+        writeValue<std::uint64_t>(os, _nodes.size());
+        for (const Node& node : _nodes) {
+            writeValue<std::uint32_t>(os, node.nodeFlags);
+            writeValue<std::uint32_t>(os, 0);
+            writePoint(os, node.points[0]);
+            writePoint(os, node.points[1]);
+        }
+
+        // Edges, including triangle ids and routing attributes
+        writeValue<std::uint64_t>(os, _edges.size());
+        for (const Edge& edge : _edges) {
+            writeValue<std::uint32_t>(os, edge.edgeFlags);
+            writeValue<std::uint32_t>(os, static_cast<std::uint32_t>(edge.searchCriteria));
+            writeValue<std::uint64_t>(os, edge.featureId);
+            writeValue<std::uint64_t>(os, edge.triangleId);
+            writeValue<std::uint64_t>(os, edge.nodeIds[0]);
+            writeValue<std::uint64_t>(os, edge.nodeIds[1]);
+            writeAttributes(os, edge.attributes);
+        }
+
+        // Features are stored as serialized JSON, padded to 8 bytes
+        writeValue<std::uint64_t>(os, _features.size());
+        for (const Feature& feature : _features) {
+            std::string json = feature.serialize();
+            writeValue<std::uint64_t>(os, json.size());
+            os.write(json.data(), json.size());
+            os.write("\0\0\0\0\0\0\0", (8 - json.size() % 8) % 8);
+        }
+
+        // Adjacency and attribute tables
+        writeValue<std::uint64_t>(os, _attributesTable.size());
+        for (const RoutingAttributes& attrs : _attributesTable) {
+            writeAttributes(os, attrs);
+        }
+        writeValue<std::uint64_t>(os, _adjacentEdges.size());
+        for (std::size_t offset : _nodeEdgeOffsets) {
+            writeValue<std::uint64_t>(os, offset);
+        }
+        for (const AdjacentEdge& adjacentEdge : _adjacentEdges) {
+            writeValue<std::uint64_t>(os, adjacentEdge.edgeId);
+            writeValue<std::uint64_t>(os, adjacentEdge.targetNodeId);
+            writeValue<std::uint32_t>(os, adjacentEdge.attributesId);
+            writeValue<std::uint32_t>(os, 0);
+        }
+
+        // Packed RTree nodes and leaf edge ids
+        writeValue<std::uint64_t>(os, _rtreeNodes.size());
+        for (const RTreeNode& node : _rtreeNodes) {
+            writePoint(os, node.bounds.min);
+            writePoint(os, node.bounds.max);
+            writeValue<std::uint32_t>(os, node.firstIndex);
+            writeValue<std::uint32_t>(os, node.count);
+            writeValue<std::uint32_t>(os, node.leaf ? 1 : 0);
+            writeValue<std::uint32_t>(os, 0);
+        }
+        writeValue<std::uint64_t>(os, _rtreeEdgeIds.size());
+        for (EdgeId edgeId : _rtreeEdgeIds) {
+            writeValue<std::uint64_t>(os, edgeId);
+        }
+
+        if (!os) {
+            throw std::runtime_error("Failed to write graph data");
+        }
+    }
+
+    std::shared_ptr<StaticGraph> StaticGraph::deserialize(std::istream& is) {
+        if (readValue<std::uint32_t>(is) != SERIALIZATION_MAGIC) {
+            throw std::runtime_error("Illegal graph data");
+        }
+        if (readValue<std::uint32_t>(is) != SERIALIZATION_VERSION) {
+            throw std::runtime_error("Unsupported graph data version");
+        }
+
+        auto graph = std::make_shared<StaticGraph>();
+
+        graph->_nodes.resize(readValue<std::uint64_t>(is));
+        for (Node& node : graph->_nodes) {
+            node.nodeFlags = NodeFlags(readValue<std::uint32_t>(is));
+            readValue<std::uint32_t>(is);
+            node.points[0] = readPoint(is);
+            node.points[1] = readPoint(is);
+        }
+
+        graph->_edges.resize(readValue<std::uint64_t>(is));
+        for (Edge& edge : graph->_edges) {
+            edge.edgeFlags = EdgeFlags(readValue<std::uint32_t>(is));
+            edge.searchCriteria = SearchCriteria(readValue<std::uint32_t>(is));
+            edge.featureId = static_cast<FeatureId>(readValue<std::uint64_t>(is));
+            edge.triangleId = static_cast<TriangleId>(readValue<std::uint64_t>(is));
+            edge.nodeIds[0] = static_cast<NodeId>(readValue<std::uint64_t>(is));
+            edge.nodeIds[1] = static_cast<NodeId>(readValue<std::uint64_t>(is));
+            edge.attributes = readAttributes(is);
+            if (edge.nodeIds[0] >= graph->_nodes.size() || edge.nodeIds[1] >= graph->_nodes.size()) {
+                throw std::runtime_error("Illegal node id in graph data");
             }
+        }
 
-            // If splitting succeeded (resulting subtrees contain enough elements), recurse
-            if (splitEdgeIds[bestDim][0].size() > SPLIT_THRESHOLD / 4 && splitEdgeIds[bestDim][1].size() > SPLIT_THRESHOLD / 4) {
-                auto node = std::make_shared<RTreeNode>();
-                node->bounds = bounds;
-                node->subNodes[0] = buildRTree(splitBounds[bestDim][0], std::move(splitEdgeIds[bestDim][0]));
-                node->subNodes[1] = buildRTree(splitBounds[bestDim][1], std::move(splitEdgeIds[bestDim][1]));
-                return node;
+        graph->_features.resize(readValue<std::uint64_t>(is));
+        for (Feature& feature : graph->_features) {
+            std::string json(readValue<std::uint64_t>(is), '\0');
+            std::string padding((8 - json.size() % 8) % 8, '\0');
+            if (!is.read(&json[0], json.size()) || !is.read(&padding[0], padding.size())) {
+                throw std::runtime_error("Unexpected end of graph data");
+            }
+            std::string err = picojson::parse(feature, json);
+            if (!err.empty()) {
+                throw std::runtime_error("Illegal feature in graph data: " + err);
             }
         }
 
-        // Create final leaf node
-        auto node = std::make_shared<RTreeNode>();
-        node->bounds = bounds;
-        node->edgeIds = std::move(edgeIds);
-        return node;
+        graph->_attributesTable.resize(readValue<std::uint64_t>(is));
+        for (RoutingAttributes& attrs : graph->_attributesTable) {
+            attrs = readAttributes(is);
+        }
+        graph->_adjacentEdges.resize(readValue<std::uint64_t>(is));
+        graph->_nodeEdgeOffsets.resize(graph->_nodes.size() + 1);
+        std::uint64_t prevOffset = 0;
+        for (std::size_t& offset : graph->_nodeEdgeOffsets) {
+            std::uint64_t value = readValue<std::uint64_t>(is);
+            if (value < prevOffset || value > graph->_adjacentEdges.size()) {
+                throw std::runtime_error("Illegal edge offset in graph data");
+            }
+            offset = static_cast<std::size_t>(value);
+            prevOffset = value;
+        }
+        if (graph->_nodeEdgeOffsets.back() != graph->_adjacentEdges.size()) {
+            throw std::runtime_error("Illegal edge offset in graph data");
+        }
+        for (AdjacentEdge& adjacentEdge : graph->_adjacentEdges) {
+            std::uint64_t edgeId = readValue<std::uint64_t>(is);
+            std::uint64_t targetNodeId = readValue<std::uint64_t>(is);
+            std::uint32_t attributesId = readValue<std::uint32_t>(is);
+            readValue<std::uint32_t>(is);
+            if (edgeId >= graph->_edges.size()) {
+                throw std::runtime_error("Illegal edge id in graph data");
+            }
+            if (targetNodeId >= graph->_nodes.size()) {
+                throw std::runtime_error("Illegal node id in graph data");
+            }
+            if (attributesId >= graph->_attributesTable.size()) {
+                throw std::runtime_error("Illegal attributes id in graph data");
+            }
+            adjacentEdge.edgeId = static_cast<EdgeId>(edgeId);
+            adjacentEdge.targetNodeId = static_cast<NodeId>(targetNodeId);
+            adjacentEdge.attributesId = attributesId;
+        }
+
+        // Restore outgoing edge ids of the nodes from the adjacency table
+        for (std::size_t i = 0; i < graph->_nodes.size(); i++) {
+            for (std::size_t j = graph->_nodeEdgeOffsets[i]; j < graph->_nodeEdgeOffsets[i + 1]; j++) {
+                graph->_nodes[i].edgeIds.push_back(graph->_adjacentEdges.at(j).edgeId);
+            }
+        }
+
+        graph->_rtreeNodes.resize(readValue<std::uint64_t>(is));
+        for (RTreeNode& node : graph->_rtreeNodes) {
+            node.bounds.min = readPoint(is);
+            node.bounds.max = readPoint(is);
+            node.firstIndex = readValue<std::uint32_t>(is);
+            node.count = readValue<std::uint32_t>(is);
+            node.leaf = readValue<std::uint32_t>(is) != 0;
+            readValue<std::uint32_t>(is);
+        }
+        graph->_rtreeEdgeIds.resize(readValue<std::uint64_t>(is));
+        for (EdgeId& edgeId : graph->_rtreeEdgeIds) {
+            edgeId = static_cast<EdgeId>(readValue<std::uint64_t>(is));
+            if (edgeId >= graph->_edges.size()) {
+                throw std::runtime_error("Illegal edge id in graph data");
+            }
+        }
+
+        // Leaf nodes must refer to stored edge ids. Child nodes are always stored before their parent, which also rules out cycles.
+        for (std::size_t i = 0; i < graph->_rtreeNodes.size(); i++) {
+            const RTreeNode& node = graph->_rtreeNodes[i];
+            std::uint64_t endIndex = static_cast<std::uint64_t>(node.firstIndex) + node.count;
+            if (endIndex > (node.leaf ? graph->_rtreeEdgeIds.size() : i)) {
+                throw std::runtime_error("Illegal RTree node in graph data");
+            }
+        }
+        return graph;
+    }
+
+    void StaticGraph::buildAdjacencyTable() {
+        // Routing attributes are shared by most edges of the same feature, store only unique combinations
+        auto attributesKey = [](const RoutingAttributes& attrs) {
+            return std::make_tuple(attrs.speed, attrs.zSpeed, attrs.turnSpeed, attrs.delay);
+        };
+        std::map<std::tuple<float, float, float, float>, AttributesId> attributesIdMap;
+
+        _nodeEdgeOffsets.clear();
+        _nodeEdgeOffsets.reserve(_nodes.size() + 1);
+        _adjacentEdges.clear();
+        _adjacentEdges.reserve(_edges.size());
+        _attributesTable.clear();
+        for (const Node& node : _nodes) {
+            _nodeEdgeOffsets.push_back(_adjacentEdges.size());
+            for (EdgeId edgeId : node.edgeIds) {
+                const Edge& edge = _edges[edgeId];
+                auto it = attributesIdMap.find(attributesKey(edge.attributes));
+                if (it == attributesIdMap.end()) {
+                    it = attributesIdMap.emplace(attributesKey(edge.attributes), static_cast<AttributesId>(_attributesTable.size())).first;
+                    _attributesTable.push_back(edge.attributes);
+                }
+
+                AdjacentEdge adjacentEdge;
+                adjacentEdge.edgeId = edgeId;
+                adjacentEdge.targetNodeId = edge.nodeIds[1];
+                adjacentEdge.attributesId = it->second;
+                _adjacentEdges.push_back(adjacentEdge);
+            }
+        }
+        _nodeEdgeOffsets.push_back(_adjacentEdges.size());
     }
 
     void StaticGraph::linkNodeEdgeIds(std::vector<Node>& nodes, const std::vector<Edge>& edges) {
@@ -355,6 +710,14 @@ namespace carto { namespace sgre {
         }
     }
 
+    cglib::vec3<double> StaticGraph::calculateScale(const Point& pos, const SearchOptions& options) {
+        static constexpr double EARTH_RADIUS = 6378137.0;
+
+        double latScale = EARTH_RADIUS * boost::math::constants::pi<double>() / 180.0;
+        double lngScale = latScale * std::max(std::cos(pos(1) * boost::math::constants::pi<double>() / 180.0), 0.01);
+        return cglib::vec3<double>(lngScale, latScale, options.zSensitivity);
+    }
+
     double StaticGraph::calculateDistance(const Point& pos0, const Point& pos1, const cglib::vec3<double>& scale) {
         Point pos0Scaled = cglib::pointwise_product(pos0, scale);
         Point pos1Scaled = cglib::pointwise_product(pos1, scale);
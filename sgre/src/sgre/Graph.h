@@ -9,6 +9,8 @@
 
 #include "Base.h"
 
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <array>
 #include <vector>
@@ -84,7 +86,17 @@ namespace carto { namespace sgre {
         struct SearchOptions {
             double zSensitivity = 1.0;
         };
-        
+
+        using AttributesId = std::uint32_t;
+
+        struct AdjacentEdge {
+            EdgeId edgeId = EdgeId(-1);             // original edge id
+            NodeId targetNodeId = NodeId(-1);       // target node of the edge
+            AttributesId attributesId = AttributesId(-1); // index into the shared routing attributes table
+        };
+
+        using AdjacentEdgeRange = std::pair<const AdjacentEdge*, const AdjacentEdge*>;
+
         StaticGraph() = default;
         explicit StaticGraph(std::vector<Node> nodes, std::vector<Edge> edges, std::vector<Feature> features);
 
@@ -96,27 +108,53 @@ namespace carto { namespace sgre {
         virtual const Edge& getEdge(EdgeId edgeId) const override { return _edges.at(edgeId); }
         virtual const Feature& getFeature(FeatureId featureId) const override { return _features.at(featureId); }
 
+        AdjacentEdgeRange getAdjacentEdges(NodeId nodeId) const { return AdjacentEdgeRange(_adjacentEdges.data() + _nodeEdgeOffsets[nodeId], _adjacentEdges.data() + _nodeEdgeOffsets[nodeId + 1]); }
+        const RoutingAttributes& getAttributes(AttributesId attributesId) const { return _attributesTable[attributesId]; }
+
         std::vector<std::pair<EdgeId, Point>> findNearestEdgePoint(const Point& pos, const SearchOptions& options) const;
+        std::vector<std::pair<EdgeId, Point>> findNearestEdgePoints(const Point& pos, std::size_t count, const SearchOptions& options) const;
+
+        void serialize(std::ostream& os) const;
+
+        static std::shared_ptr<StaticGraph> deserialize(std::istream& is);
 
     private:
         struct RTreeNode {
-            cglib::bbox3<double> bounds;
-            std::vector<EdgeId> edgeIds;
-            std::array<std::shared_ptr<RTreeNode>, 2> subNodes;
+            cglib::bbox3<double> bounds = cglib::bbox3<double>::smallest();
+            std::uint32_t firstIndex = 0;           // index of the first child node, or index of the first edge id in case of leaf nodes
+            std::uint32_t count = 0;                // number of child nodes or edge ids
+            bool leaf = true;
         };
+
+        static constexpr std::size_t RTREE_FANOUT = 16;
         
         boost::optional<Point> findNearestEdgePoint(const Edge& edge, const Point& pos, const cglib::vec3<double>& scale) const;
 
-        std::shared_ptr<RTreeNode> buildRTree(const cglib::bbox3<double>& bounds, std::vector<EdgeId> edgeIds) const;
+        void buildRTree();
+
+        template <typename T>
+        static void sortTiles(T begin, T end, int dim);
+
+        void buildAdjacencyTable();
 
         static void linkNodeEdgeIds(std::vector<Node>& nodes, const std::vector<Edge>& edges);
 
+        static cglib::vec3<double> calculateScale(const Point& pos, const SearchOptions& options);
+
         static double calculateDistance(const Point& pos0, const Point& pos1, const cglib::vec3<double>& scale);
 
         std::vector<Node> _nodes;
         std::vector<Edge> _edges;
-        std::vector<Feature> _features;
-        std::shared_ptr<const RTreeNode> _rootNode;
+        std::vector<Feature> _features; // cold data, only needed when building the final result
+
+        // Compressed sparse row layout of the outgoing edges, used by the path search. Edges of node N are stored at [_nodeEdgeOffsets[N], _nodeEdgeOffsets[N + 1]).
+        std::vector<std::size_t> _nodeEdgeOffsets;
+        std::vector<AdjacentEdge> _adjacentEdges;
+        std::vector<RoutingAttributes> _attributesTable;
+
+        // Packed RTree of the edges, the root node is the last node
+        std::vector<RTreeNode> _rtreeNodes;
+        std::vector<EdgeId> _rtreeEdgeIds;
     };
 
     class DynamicGraph final : public Graph {
@@ -132,6 +170,10 @@ namespace carto { namespace sgre {
         virtual const Edge& getEdge(EdgeId edgeId) const override;
         virtual const Feature& getFeature(FeatureId featureId) const override;
 
+        const StaticGraph& getStaticGraph() const { return *_staticGraph; }
+
+        bool isStaticNode(NodeId nodeId) const { return _nodes.find(nodeId) == _nodes.end() && nodeId < _staticGraph->getNodeIdRangeEnd(); }
+
         void reset();
 
         NodeId addNode(Node node);
@@ -1,5 +1,9 @@
 #include "GraphBuilder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <unordered_set>
 
 #include <tesselator.h>
@@ -27,13 +31,15 @@ namespace {
 
 namespace carto { namespace sgre {
     void GraphBuilder::addLineString(const std::vector<Point>& coordsList, const picojson::value& properties) {
-        Graph::FeatureId featureId = addFeature(properties);
-        addLineString(featureId, coordsList, properties);
+        FeatureGeometry geometry;
+        prepareLineString(geometry, coordsList, properties, _ruleMatchCache);
+        mergeFeatureGeometry(addFeature(properties), geometry);
     }
 
     void GraphBuilder::addPolygon(const std::vector<std::vector<Point>>& rings, const picojson::value& properties) {
-        Graph::FeatureId featureId = addFeature(properties);
-        addPolygon(featureId, rings, properties);
+        FeatureGeometry geometry;
+        preparePolygon(geometry, rings, properties, _ruleMatchCache);
+        mergeFeatureGeometry(addFeature(properties), geometry);
     }
 
     void GraphBuilder::importGeoJSON(const picojson::value& geoJSON) {
@@ -47,16 +53,52 @@ namespace carto { namespace sgre {
         }
     }
 
-    void GraphBuilder::importGeoJSONFeatureCollection(const picojson::value& featureCollectionDef) {
+    void GraphBuilder::importGeoJSONFeatureCollection(const picojson::value& featureCollectionDef, unsigned int threadCount) {
         const picojson::array& featuresDef = featureCollectionDef.get("features").get<picojson::array>();
 
-        for (const picojson::value& featureDef : featuresDef) {
-            std::string type = featureDef.get("type").get<std::string>();
-            if (type != "Feature") {
-                throw std::runtime_error("Unexpected element type");
+        if (threadCount == 0) {
+            threadCount = std::max(1U, std::thread::hardware_concurrency());
+        }
+        threadCount = static_cast<unsigned int>(std::min(static_cast<std::size_t>(threadCount), featuresDef.size()));
+
+        // Parse, match rules and triangulate the features in parallel. Workers write to fixed slots, so the result does not depend on scheduling.
+        std::vector<FeatureGeometry> geometries(featuresDef.size());
+        std::vector<std::exception_ptr> exceptions(featuresDef.size());
+        std::atomic<std::size_t> nextIndex(0);
+        auto worker = [&]() {
+            RuleMatchCache ruleMatchCache;
+            for (std::size_t index = nextIndex++; index < featuresDef.size(); index = nextIndex++) {
+                try {
+                    const picojson::value& featureDef = featuresDef[index];
+                    std::string type = featureDef.get("type").get<std::string>();
+                    if (type != "Feature") {
+                        throw std::runtime_error("Unexpected element type");
+                    }
+
+                    prepareGeoJSONGeometry(geometries[index], featureDef.get("geometry"), featureDef.get("properties"), ruleMatchCache);
+                }
+                catch (...) {
+                    exceptions[index] = std::current_exception();
+                }
             }
-            
-            importGeoJSONFeature(featureDef);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        // Merge the features in input order. This assigns the same ids as importing the features one by one.
+        for (std::size_t index = 0; index < featuresDef.size(); index++) {
+            if (exceptions[index]) {
+                std::rethrow_exception(exceptions[index]);
+            }
+
+            mergeFeatureGeometry(addFeature(featuresDef[index].get("properties")), geometries[index]);
+            geometries[index] = FeatureGeometry();
         }
     }
 
@@ -64,29 +106,30 @@ namespace carto { namespace sgre {
         const picojson::value& geometryDef = featureDef.get("geometry");
         const picojson::value& properties = featureDef.get("properties");
 
-        importGeoJSONGeometry(geometryDef, properties);
+        FeatureGeometry geometry;
+        prepareGeoJSONGeometry(geometry, geometryDef, properties, _ruleMatchCache);
+        mergeFeatureGeometry(addFeature(properties), geometry);
     }
 
-    void GraphBuilder::importGeoJSONGeometry(const picojson::value& geometryDef, const picojson::value& properties) {
+    void GraphBuilder::prepareGeoJSONGeometry(FeatureGeometry& geometry, const picojson::value& geometryDef, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const {
         std::string type = geometryDef.get("type").get<std::string>();
         const picojson::value& coordsDef = geometryDef.get("coordinates");
         
-        Graph::FeatureId featureId = addFeature(properties);
         if (type == "Point") {
             // Can ignore
         } else if (type == "LineString") {
-            addLineString(featureId, parseCoordinatesList(coordsDef), properties);
+            prepareLineString(geometry, parseCoordinatesList(coordsDef), properties, ruleMatchCache);
         } else if (type == "Polygon") {
-            addPolygon(featureId, parseCoordinatesRings(coordsDef), properties);
+            preparePolygon(geometry, parseCoordinatesRings(coordsDef), properties, ruleMatchCache);
         } else if (type == "MultiPoint") {
             // Can ignore
         } else if (type == "MultiLineString") {
             for (const picojson::value& subCoordsDef : coordsDef.get<picojson::array>()) {
-                addLineString(featureId, parseCoordinatesList(subCoordsDef), properties);
+                prepareLineString(geometry, parseCoordinatesList(subCoordsDef), properties, ruleMatchCache);
             }
         } else if (type == "MultiPolygon") {
             for (const picojson::value& subCoordsDef : coordsDef.get<picojson::array>()) {
-                addPolygon(featureId, parseCoordinatesRings(subCoordsDef), properties);
+                preparePolygon(geometry, parseCoordinatesRings(subCoordsDef), properties, ruleMatchCache);
             }
         } else {
             throw std::runtime_error("Invalid geometry type");
@@ -135,16 +178,18 @@ namespace carto { namespace sgre {
         return std::make_shared<StaticGraph>(std::move(nodes), std::move(edges), _features);
     }
 
-    void GraphBuilder::addLineString(Graph::FeatureId featureId, const std::vector<Point>& coordsList, const picojson::value& properties) {
+    void GraphBuilder::prepareLineString(FeatureGeometry& geometry, const std::vector<Point>& coordsList, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const {
+        const std::vector<std::size_t>& ruleIndices = matchRules(properties, ruleMatchCache);
+
         Graph::LinkMode linkMode = Graph::LinkMode::ALL;
         Graph::SearchCriteria searchCriteria = Graph::SearchCriteria::EDGE;
         RoutingAttributes attribs;
-        matchRules(properties, linkMode, searchCriteria, attribs, true);
+        applyRules(ruleIndices, linkMode, searchCriteria, attribs, true);
 
         Graph::LinkMode linkModeBackwards = linkMode;
         Graph::SearchCriteria searchCriteriaBackwards = searchCriteria;
         RoutingAttributes attribsBackward = attribs;
-        matchRules(properties, linkModeBackwards, searchCriteriaBackwards, attribsBackward, false);
+        applyRules(ruleIndices, linkModeBackwards, searchCriteriaBackwards, attribsBackward, false);
 
         // Create node for each vertex
         std::vector<Graph::NodeId> nodeIds;
@@ -154,7 +199,8 @@ namespace carto { namespace sgre {
             Graph::Node node;
             node.nodeFlags = Graph::NodeFlags(i == 0 || i + 1 == coordsList.size() ? Graph::NodeFlags::ENDPOINT_VERTEX | Graph::NodeFlags::GEOMETRY_VERTEX : Graph::NodeFlags::GEOMETRY_VERTEX);
             node.points = std::array<Point, 2> {{ point, point }};
-            Graph::NodeId nodeId = addNode(node);
+            Graph::NodeId nodeId = static_cast<Graph::NodeId>(geometry.nodes.size());
+            geometry.nodes.push_back(node);
             nodeIds.push_back(nodeId);
 
             // Store vertex information needed for linking it with underlying triangle
@@ -162,43 +208,43 @@ namespace carto { namespace sgre {
             lineVertex.nodeId = nodeId;
             lineVertex.linkMode = linkMode;
             lineVertex.point = point;
-            _lineVertices.push_back(lineVertex);
+            geometry.lineVertices.push_back(lineVertex);
         }
 
         // Create edges (both forward and backward)
         for (std::size_t i = 1; i < nodeIds.size(); i++) {
-            const Graph::Node& node0 = getNode(nodeIds[i - 1]);
-            const Graph::Node& node1 = getNode(nodeIds[i]);
+            const Graph::Node& node0 = geometry.nodes[nodeIds[i - 1]];
+            const Graph::Node& node1 = geometry.nodes[nodeIds[i]];
 
             std::pair<double, double> dist2D = calculateDistance2D(node0.points[0], node1.points[0]);
 
             if (!(dist2D.first != 0 && attribs.speed == 0) && !(dist2D.second != 0 && attribs.zSpeed == 0)) {
                 Graph::Edge edge;
                 edge.edgeFlags = Graph::EdgeFlags(Graph::EdgeFlags::GEOMETRY_EDGE);
-                edge.featureId = featureId;
                 edge.nodeIds = std::array<Graph::NodeId, 2> {{ nodeIds[i - 1], nodeIds[i] }};
                 edge.searchCriteria = searchCriteria;
                 edge.attributes = attribs;
-                addEdge(edge);
+                geometry.edges.push_back(edge);
+                geometry.edgeFlagNodeIds.push_back(Graph::NodeId(-1));
             }
 
             if (!(dist2D.first != 0 && attribsBackward.speed == 0) && !(dist2D.second != 0 && attribsBackward.zSpeed == 0)) {
                 Graph::Edge edge;
                 edge.edgeFlags = Graph::EdgeFlags(Graph::EdgeFlags::GEOMETRY_EDGE);
-                edge.featureId = featureId;
                 edge.nodeIds = std::array<Graph::NodeId, 2> {{ nodeIds[i], nodeIds[i - 1] }};
                 edge.searchCriteria = searchCriteriaBackwards; // Note: always equal to searchCriteria
                 edge.attributes = attribsBackward;
-                addEdge(edge);
+                geometry.edges.push_back(edge);
+                geometry.edgeFlagNodeIds.push_back(Graph::NodeId(-1));
             }
         }
     }
 
-    void GraphBuilder::addPolygon(Graph::FeatureId featureId, const std::vector<std::vector<Point>>& rings, const picojson::value& properties) {
+    void GraphBuilder::preparePolygon(FeatureGeometry& geometry, const std::vector<std::vector<Point>>& rings, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const {
         Graph::LinkMode linkMode = Graph::LinkMode::ALL;
         Graph::SearchCriteria searchCriteria = Graph::SearchCriteria::SURFACE;
         RoutingAttributes attribs;
-        matchRules(properties, linkMode, searchCriteria, attribs);
+        applyRules(matchRules(properties, ruleMatchCache), linkMode, searchCriteria, attribs);
         attribs.delay = 0; // reset the delay manually
 
         TESSalloc ma;
@@ -264,49 +310,87 @@ namespace carto { namespace sgre {
                 Graph::Node node;
                 node.nodeFlags = geometryEdges.count({{ point0(0), point0(1), point0(2), point1(0), point1(1), point1(2) }}) + geometryEdges.count({{ point1(0), point1(1), point1(2), point0(0), point0(1), point0(2) }}) > 0 ? Graph::NodeFlags::GEOMETRY_VERTEX : Graph::NodeFlags();
                 node.points = std::array<Point, 2> {{ point0, point1 }};
-                Graph::NodeId nodeId = addNode(node);
+                Graph::NodeId nodeId = static_cast<Graph::NodeId>(geometry.nodes.size());
+                geometry.nodes.push_back(node);
                 nodeIds.push_back(nodeId);
             }
 
             // Store the triangle needed for linking linestrings with triangles at later stage.
             Graph::TriangleId triangleId = Graph::TriangleId(-1);
             if (points.size() == 3) { // Note: less points than 3 possible only for invalid (intersecting) geometry
-                triangleId = static_cast<Graph::TriangleId>(_triangles.size());
+                triangleId = static_cast<Graph::TriangleId>(geometry.triangles.size());
                 Triangle triangle;
-                triangle.featureId = featureId;
                 triangle.searchCriteria = searchCriteria;
                 triangle.attributes = attribs;
                 triangle.points = std::array<Point, 3> {{ points[0], points[1], points[2] }};
                 triangle.nodeIds = nodeIds;
-                _triangles.push_back(triangle);
+                geometry.triangles.push_back(triangle);
             }
 
             // Build the edges
             for (std::size_t i0 = 0; i0 + 1 < nodeIds.size(); i0++) {
                 for (std::size_t i1 = i0 + 1; i1 < nodeIds.size(); i1++) {
-                    const Graph::Node& node0 = getNode(nodeIds[i0]);
-                    const Graph::Node& node1 = getNode(nodeIds[i1]);
+                    const Graph::Node& node0 = geometry.nodes[nodeIds[i0]];
+                    const Graph::Node& node1 = geometry.nodes[nodeIds[i1]];
 
                     std::pair<double, double> dist2D = calculateDistance2D((node0.points[0] + node0.points[1]) * 0.5, (node1.points[0] + node1.points[1]) * 0.5);
 
                     if (!(dist2D.first != 0 && attribs.speed == 0) && !(dist2D.second != 0 && attribs.zSpeed == 0)) {
                         Graph::Edge edge;
-                        edge.edgeFlags = Graph::EdgeFlags(getNode(nodeIds[nodeIds.size() - i0 - i1]).nodeFlags & Graph::NodeFlags::GEOMETRY_VERTEX ? Graph::EdgeFlags::GEOMETRY_EDGE : 0); // use the 'geometry vertex' flag from the third (opposite edge)
-                        edge.featureId = featureId;
                         edge.triangleId = triangleId;
                         edge.nodeIds = std::array<Graph::NodeId, 2> {{ nodeIds[i0], nodeIds[i1] }};
                         edge.searchCriteria = searchCriteria;
                         edge.attributes = attribs;
-                        addEdge(edge);
+                        geometry.edges.push_back(edge);
+                        geometry.edgeFlagNodeIds.push_back(nodeIds[nodeIds.size() - i0 - i1]); // use the 'geometry vertex' flag from the third (opposite edge)
 
                         std::swap(edge.nodeIds[0], edge.nodeIds[1]);
-                        addEdge(edge);
+                        geometry.edges.push_back(edge);
+                        geometry.edgeFlagNodeIds.push_back(nodeIds[nodeIds.size() - i0 - i1]);
                     }
                 }
             }
         }
     }
 
+    void GraphBuilder::mergeFeatureGeometry(Graph::FeatureId featureId, const FeatureGeometry& geometry) {
+        // Deduplicate the nodes in creation order and remap the local node and triangle ids
+        std::vector<Graph::NodeId> nodeIds;
+        nodeIds.reserve(geometry.nodes.size());
+        for (const Graph::Node& node : geometry.nodes) {
+            nodeIds.push_back(addNode(node));
+        }
+
+        for (LineVertex lineVertex : geometry.lineVertices) {
+            lineVertex.nodeId = nodeIds[lineVertex.nodeId];
+            _lineVertices.push_back(lineVertex);
+        }
+
+        Graph::TriangleId triangleIdOffset = static_cast<Graph::TriangleId>(_triangles.size());
+        for (Triangle triangle : geometry.triangles) {
+            triangle.featureId = featureId;
+            for (Graph::NodeId& nodeId : triangle.nodeIds) {
+                nodeId = nodeIds[nodeId];
+            }
+            _triangles.push_back(std::move(triangle));
+        }
+
+        for (std::size_t i = 0; i < geometry.edges.size(); i++) {
+            Graph::Edge edge = geometry.edges[i];
+            edge.featureId = featureId;
+            if (edge.triangleId != Graph::TriangleId(-1)) {
+                edge.triangleId += triangleIdOffset;
+            }
+            edge.nodeIds = std::array<Graph::NodeId, 2> {{ nodeIds[edge.nodeIds[0]], nodeIds[edge.nodeIds[1]] }};
+            if (geometry.edgeFlagNodeIds[i] != Graph::NodeId(-1)) {
+                // Note: the flag must be taken from the deduplicated node, which may come from an earlier feature
+                const Graph::Node& node = getNode(nodeIds[geometry.edgeFlagNodeIds[i]]);
+                edge.edgeFlags = Graph::EdgeFlags(node.nodeFlags & Graph::NodeFlags::GEOMETRY_VERTEX ? Graph::EdgeFlags::GEOMETRY_EDGE : 0);
+            }
+            addEdge(edge);
+        }
+    }
+
     const Graph::Node& GraphBuilder::getNode(Graph::NodeId nodeId) const {
         return _nodes.at(nodeId);
     }
@@ -353,26 +437,19 @@ namespace carto { namespace sgre {
         return featureId;
     }
 
-    void GraphBuilder::matchRules(const picojson::value& properties, Graph::LinkMode& linkMode, Graph::SearchCriteria& searchCriteria, RoutingAttributes& attribs, bool forward) const {
-        for (const Rule& rule : _ruleList.getRules()) {
-            if (auto filters = rule.getFilters()) {
-                bool match = false;
-                for (const Rule::Filter& filter : *filters) {
-                    auto it = filter.begin();
-                    for (; it != filter.end(); it++) {
-                        if (!properties.contains(it->first) || properties.get(it->first) != it->second) {
-                            break;
-                        }
-                    }
-                    if (it == filter.end()) {
-                        match = true;
-                        break;
-                    }
-                }
-                if (!match) {
-                    continue;
-                }
-            }
+    const std::vector<std::size_t>& GraphBuilder::matchRules(const picojson::value& properties, RuleMatchCache& ruleMatchCache) const {
+        // Evaluate the rule filters once for each distinct set of referenced property values
+        std::string key = _ruleList.getMatchKey(properties);
+        auto it = ruleMatchCache.find(key);
+        if (it == ruleMatchCache.end()) {
+            it = ruleMatchCache.emplace(std::move(key), _ruleList.match(properties)).first;
+        }
+        return it->second;
+    }
+
+    void GraphBuilder::applyRules(const std::vector<std::size_t>& ruleIndices, Graph::LinkMode& linkMode, Graph::SearchCriteria& searchCriteria, RoutingAttributes& attribs, bool forward) const {
+        for (std::size_t ruleIndex : ruleIndices) {
+            const Rule& rule = _ruleList.getRules()[ruleIndex];
 
             rule.apply(attribs, forward);
 
@@ -29,7 +29,7 @@ namespace carto { namespace sgre {
         void addPolygon(const std::vector<std::vector<Point>>& rings, const picojson::value& properties);
 
         void importGeoJSON(const picojson::value& geoJSON);
-        void importGeoJSONFeatureCollection(const picojson::value& featureCollectionDef);
+        void importGeoJSONFeatureCollection(const picojson::value& featureCollectionDef, unsigned int threadCount = 0);
         void importGeoJSONFeature(const picojson::value& featureDef);
 
         std::shared_ptr<StaticGraph> build() const;
@@ -48,11 +48,23 @@ namespace carto { namespace sgre {
             std::array<Point, 3> points;
             std::vector<Graph::NodeId> nodeIds;
         };
+
+        using RuleMatchCache = std::unordered_map<std::string, std::vector<std::size_t>>;
+
+        struct FeatureGeometry {
+            std::vector<Graph::Node> nodes;             // nodes before deduplication, ids in edges, vertices and triangles refer to this list
+            std::vector<Graph::Edge> edges;             // edges without feature ids, triangle ids are local to the geometry
+            std::vector<Graph::NodeId> edgeFlagNodeIds; // node defining the 'geometry edge' flag of each edge after merging, or -1 if the edge flags are final
+            std::vector<LineVertex> lineVertices;
+            std::vector<Triangle> triangles;
+        };
         
-        void importGeoJSONGeometry(const picojson::value& geometryDef, const picojson::value& properties);
+        void prepareGeoJSONGeometry(FeatureGeometry& geometry, const picojson::value& geometryDef, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const;
+
+        void prepareLineString(FeatureGeometry& geometry, const std::vector<Point>& coordsList, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const;
+        void preparePolygon(FeatureGeometry& geometry, const std::vector<std::vector<Point>>& rings, const picojson::value& properties, RuleMatchCache& ruleMatchCache) const;
 
-        void addLineString(Graph::FeatureId featureId, const std::vector<Point>& coordsList, const picojson::value& properties);
-        void addPolygon(Graph::FeatureId featureId, const std::vector<std::vector<Point>>& rings, const picojson::value& properties);
+        void mergeFeatureGeometry(Graph::FeatureId featureId, const FeatureGeometry& geometry);
         
         const Graph::Node& getNode(Graph::NodeId nodeId) const;
         const Graph::Edge& getEdge(Graph::EdgeId edgeId) const;
@@ -62,7 +74,8 @@ namespace carto { namespace sgre {
         Graph::EdgeId addEdge(const Graph::Edge& edge);
         Graph::FeatureId addFeature(const Graph::Feature& feature);
 
-        void matchRules(const picojson::value& properties, Graph::LinkMode& linkMode, Graph::SearchCriteria& searchCriteria, RoutingAttributes& attribs, bool forward = true) const;
+        const std::vector<std::size_t>& matchRules(const picojson::value& properties, RuleMatchCache& ruleMatchCache) const;
+        void applyRules(const std::vector<std::size_t>& ruleIndices, Graph::LinkMode& linkMode, Graph::SearchCriteria& searchCriteria, RoutingAttributes& attribs, bool forward = true) const;
 
         static std::vector<std::vector<Point>> parseCoordinatesRings(const picojson::value& coordsDef);
         static std::vector<Point> parseCoordinatesList(const picojson::value& coordsDef);
@@ -80,6 +93,7 @@ namespace carto { namespace sgre {
         std::vector<Triangle> _triangles;
         std::unordered_map<std::array<double, 6>, Graph::NodeId, boost::hash<std::array<double, 6>>> _coordsNodeIdMap;
         std::unordered_map<std::string, Graph::FeatureId> _propertiesFeatureIdMap;
+        RuleMatchCache _ruleMatchCache;
     };
 } }
 
@@ -0,0 +1,65 @@
+#include "Isochrone.h"
+
+namespace {
+    picojson::value serializePoint(const carto::sgre::Point& point) {
+        picojson::array pointDef;
+        for (std::size_t i = 0; i < 3; i++) {
+            pointDef.emplace_back(point(i));
+        }
+        return picojson::value(pointDef);
+    }
+
+    carto::sgre::Point parsePoint(const picojson::value& pointDef) {
+        carto::sgre::Point point;
+        for (std::size_t i = 0; i < 3; i++) {
+            point(i) = pointDef.get<picojson::array>().at(i).get<double>();
+        }
+        return point;
+    }
+}
+
+namespace carto { namespace sgre {
+    picojson::value Isochrone::serialize() const {
+        picojson::object isochroneObj;
+        isochroneObj["status"] = picojson::value(static_cast<std::int64_t>(_status));
+        if (_status == Status::SUCCESS) {
+            picojson::array nodesDef;
+            for (const NodeTime& nodeTime : _nodeTimes) {
+                picojson::object nodeObj;
+                nodeObj["id"] = picojson::value(static_cast<std::int64_t>(nodeTime.nodeId));
+                nodeObj["point"] = serializePoint(nodeTime.point);
+                nodeObj["time"] = picojson::value(nodeTime.time);
+                nodesDef.emplace_back(std::move(nodeObj));
+            }
+            picojson::array boundaryDef;
+            for (const Point& point : _boundary) {
+                boundaryDef.push_back(serializePoint(point));
+            }
+            isochroneObj["nodes"] = picojson::value(nodesDef);
+            isochroneObj["boundary"] = picojson::value(boundaryDef);
+        }
+        return picojson::value(isochroneObj);
+    }
+
+    Isochrone Isochrone::parse(const picojson::value& isochroneDef) {
+        Status status = static_cast<Status>(isochroneDef.get("status").get<std::int64_t>());
+        if (status == Status::FAILED) {
+            return Isochrone();
+        }
+        const picojson::array& nodesDef = isochroneDef.get("nodes").get<picojson::array>();
+        std::vector<NodeTime> nodeTimes;
+        for (const picojson::value& nodeDef : nodesDef) {
+            NodeTime nodeTime;
+            nodeTime.nodeId = static_cast<Graph::NodeId>(nodeDef.get("id").get<std::int64_t>());
+            nodeTime.point = parsePoint(nodeDef.get("point"));
+            nodeTime.time = nodeDef.get("time").get<double>();
+            nodeTimes.push_back(nodeTime);
+        }
+        const picojson::array& boundaryDef = isochroneDef.get("boundary").get<picojson::array>();
+        std::vector<Point> boundary;
+        for (const picojson::value& pointDef : boundaryDef) {
+            boundary.push_back(parsePoint(pointDef));
+        }
+        return Isochrone(std::move(nodeTimes), std::move(boundary));
+    }
+} }
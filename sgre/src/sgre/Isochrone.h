@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_SGRE_ISOCHRONE_H_
+#define _CARTO_SGRE_ISOCHRONE_H_
+
+#include "Base.h"
+#include "Graph.h"
+
+#include <vector>
+
+#include <picojson/picojson.h>
+
+namespace carto { namespace sgre {
+    class Isochrone final {
+    public:
+        enum class Status {
+            FAILED = 0,
+            SUCCESS = 1
+        };
+
+        struct NodeTime {
+            Graph::NodeId nodeId; // static graph node id
+            Point point;          // fastest reached point of the node
+            double time;          // travel time to the point
+        };
+
+        Isochrone() = default;
+        explicit Isochrone(std::vector<NodeTime> nodeTimes, std::vector<Point> boundary) : _status(Status::SUCCESS), _nodeTimes(std::move(nodeTimes)), _boundary(std::move(boundary)) { }
+
+        Status getStatus() const { return _status; }
+        const std::vector<NodeTime>& getNodeTimes() const { return _nodeTimes; }
+        const std::vector<Point>& getBoundary() const { return _boundary; }
+
+        picojson::value serialize() const;
+
+        static Isochrone parse(const picojson::value& isochroneDef);
+
+    private:
+        Status _status = Status::FAILED;
+        std::vector<NodeTime> _nodeTimes; // sorted by node id
+        std::vector<Point> _boundary;
+    };
+} }
+
+#endif
@@ -0,0 +1,210 @@
+#include "LandmarkTable.h"
+
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <numeric>
+#include <functional>
+#include <algorithm>
+
+#include <boost/math/constants/constants.hpp>
+
+namespace {
+    double pointSegmentDistance(const cglib::vec2<double>& pos, const cglib::vec2<double>& pos0, const cglib::vec2<double>& pos1) {
+        cglib::vec2<double> delta = pos1 - pos0;
+        double len2 = cglib::dot_product(delta, delta);
+        double t = (len2 > 0 ? std::max(0.0, std::min(1.0, cglib::dot_product(pos - pos0, delta) / len2)) : 0.0);
+        return cglib::length(pos - (pos0 + delta * t));
+    }
+
+    double segmentDistance(const std::array<cglib::vec2<double>, 2>& seg0, const std::array<cglib::vec2<double>, 2>& seg1) {
+        auto cross = [](const cglib::vec2<double>& v0, const cglib::vec2<double>& v1) {
+            return v0(0) * v1(1) - v0(1) * v1(0);
+        };
+
+        // Check for proper intersection first, collinear and touching cases are handled by endpoint distances
+        double d0 = cross(seg0[1] - seg0[0], seg1[0] - seg0[0]);
+        double d1 = cross(seg0[1] - seg0[0], seg1[1] - seg0[0]);
+        double d2 = cross(seg1[1] - seg1[0], seg0[0] - seg1[0]);
+        double d3 = cross(seg1[1] - seg1[0], seg0[1] - seg1[0]);
+        if (((d0 > 0 && d1 < 0) || (d0 < 0 && d1 > 0)) && ((d2 > 0 && d3 < 0) || (d2 < 0 && d3 > 0))) {
+            return 0;
+        }
+
+        double dist = std::min(pointSegmentDistance(seg0[0], seg1[0], seg1[1]), pointSegmentDistance(seg0[1], seg1[0], seg1[1]));
+        return std::min(dist, std::min(pointSegmentDistance(seg1[0], seg0[0], seg0[1]), pointSegmentDistance(seg1[1], seg0[0], seg0[1])));
+    }
+}
+
+namespace carto { namespace sgre {
+    LandmarkTable::LandmarkTable(const StaticGraph& graph, int landmarkCount) :
+        _nodeCount(graph.getNodeIdRangeEnd())
+    {
+        if (_nodeCount == 0 || landmarkCount <= 0) {
+            return;
+        }
+
+        // Use the smallest longitude scale of the graph area, so that the times are lower bounds for any query
+        double minLat = std::numeric_limits<double>::infinity(), maxLat = -std::numeric_limits<double>::infinity();
+        for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+            for (const Point& point : graph.getNode(nodeId).points) {
+                minLat = std::min(minLat, point(1));
+                maxLat = std::max(maxLat, point(1));
+            }
+        }
+        double minLngScale = std::min(std::cos(minLat * boost::math::constants::pi<double>() / 180.0), std::cos(maxLat * boost::math::constants::pi<double>() / 180.0));
+        double lngScale = std::max(minLngScale, 0.01);
+
+        // Build forward and backward adjacency lists with minimum edge times between the node segments
+        std::vector<std::size_t> forwardOffsets(_nodeCount + 1, 0);
+        std::vector<AdjacentNode> forwardNodes;
+        std::vector<std::size_t> backwardOffsets(_nodeCount + 1, 0);
+        for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+            forwardOffsets[nodeId] = forwardNodes.size();
+            StaticGraph::AdjacentEdgeRange adjacentEdges = graph.getAdjacentEdges(nodeId);
+            for (const StaticGraph::AdjacentEdge* it = adjacentEdges.first; it != adjacentEdges.second; it++) {
+                double time = calculateMinTime(graph.getAttributes(it->attributesId), graph.getNode(nodeId), graph.getNode(it->targetNodeId), lngScale);
+                if (std::isfinite(time)) {
+                    forwardNodes.push_back({ it->targetNodeId, time });
+                    backwardOffsets[it->targetNodeId + 1]++;
+                }
+            }
+        }
+        forwardOffsets[_nodeCount] = forwardNodes.size();
+
+        std::partial_sum(backwardOffsets.begin(), backwardOffsets.end(), backwardOffsets.begin());
+        std::vector<AdjacentNode> backwardNodes(forwardNodes.size());
+        std::vector<std::size_t> backwardFill(backwardOffsets.begin(), backwardOffsets.end() - 1);
+        for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+            for (std::size_t i = forwardOffsets[nodeId]; i < forwardOffsets[nodeId + 1]; i++) {
+                backwardNodes[backwardFill[forwardNodes[i].nodeId]++] = { nodeId, forwardNodes[i].time };
+            }
+        }
+
+        // Select landmarks using farthest-first selection, starting from the node farthest from an arbitrary node.
+        // Unreachable nodes are preferred, so that each connected component gets a landmark.
+        std::size_t count = std::min(static_cast<std::size_t>(landmarkCount), _nodeCount);
+        std::vector<double> forwardTimes, backwardTimes;
+        calculateTimes(forwardOffsets, forwardNodes, 0, forwardTimes);
+        Graph::NodeId landmarkNodeId = 0;
+        for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+            if (std::isfinite(forwardTimes[nodeId]) && forwardTimes[nodeId] > forwardTimes[landmarkNodeId]) {
+                landmarkNodeId = nodeId;
+            }
+        }
+
+        std::vector<double> minTimes(_nodeCount, std::numeric_limits<double>::infinity());
+        std::vector<std::vector<double>> landmarkForwardTimes, landmarkBackwardTimes;
+        while (_landmarkNodeIds.size() < count) {
+            calculateTimes(forwardOffsets, forwardNodes, landmarkNodeId, forwardTimes);
+            calculateTimes(backwardOffsets, backwardNodes, landmarkNodeId, backwardTimes);
+            _landmarkNodeIds.push_back(landmarkNodeId);
+            landmarkForwardTimes.push_back(forwardTimes);
+            landmarkBackwardTimes.push_back(backwardTimes);
+
+            Graph::NodeId nextNodeId = landmarkNodeId;
+            for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+                minTimes[nodeId] = std::min(minTimes[nodeId], forwardTimes[nodeId]);
+                if (minTimes[nodeId] > minTimes[nextNodeId]) {
+                    nextNodeId = nodeId;
+                }
+            }
+            if (minTimes[nextNodeId] <= 0) {
+                break; // all nodes are already covered
+            }
+            landmarkNodeId = nextNodeId;
+        }
+
+        // Store the tables in node-major order, so that all landmark times of a node share cache lines
+        std::size_t landmarkNodeCount = _landmarkNodeIds.size();
+        _forwardTimes.resize(_nodeCount * landmarkNodeCount);
+        _backwardTimes.resize(_nodeCount * landmarkNodeCount);
+        for (std::size_t i = 0; i < landmarkNodeCount; i++) {
+            for (Graph::NodeId nodeId = 0; nodeId < _nodeCount; nodeId++) {
+                _forwardTimes[nodeId * landmarkNodeCount + i] = static_cast<float>(landmarkForwardTimes[i][nodeId]);
+                _backwardTimes[nodeId * landmarkNodeCount + i] = static_cast<float>(landmarkBackwardTimes[i][nodeId]);
+            }
+        }
+    }
+
+    double LandmarkTable::calculateLowerBound(Graph::NodeId nodeId, const std::vector<Graph::NodeId>& targetNodeIds) const {
+        static constexpr double TIME_EPSILON = 1.0e-6; // relative slack covering the single precision rounding of the tables
+
+        std::size_t landmarkCount = _landmarkNodeIds.size();
+        if (landmarkCount == 0) {
+            return targetNodeIds.empty() ? std::numeric_limits<double>::infinity() : 0.0;
+        }
+        const float* nodeForwardTimes = &_forwardTimes[nodeId * landmarkCount];
+        const float* nodeBackwardTimes = &_backwardTimes[nodeId * landmarkCount];
+
+        double minBound = std::numeric_limits<double>::infinity();
+        for (Graph::NodeId targetNodeId : targetNodeIds) {
+            const float* targetForwardTimes = &_forwardTimes[targetNodeId * landmarkCount];
+            const float* targetBackwardTimes = &_backwardTimes[targetNodeId * landmarkCount];
+
+            // Use both d(L, t) - d(L, v) <= d(v, t) and d(v, L) - d(t, L) <= d(v, t)
+            double bound = 0;
+            for (std::size_t i = 0; i < landmarkCount && bound < minBound; i++) {
+                double time0 = targetForwardTimes[i], time1 = nodeForwardTimes[i];
+                if (std::isfinite(time0) && std::isfinite(time1)) {
+                    bound = std::max(bound, time0 - time1 - TIME_EPSILON * (time0 + time1));
+                } else if (std::isfinite(time1)) {
+                    bound = std::numeric_limits<double>::infinity();
+                }
+
+                double time2 = nodeBackwardTimes[i], time3 = targetBackwardTimes[i];
+                if (std::isfinite(time2) && std::isfinite(time3)) {
+                    bound = std::max(bound, time2 - time3 - TIME_EPSILON * (time2 + time3));
+                } else if (std::isfinite(time3)) {
+                    bound = std::numeric_limits<double>::infinity();
+                }
+            }
+            minBound = std::min(minBound, bound);
+        }
+        return minBound;
+    }
+
+    void LandmarkTable::calculateTimes(const std::vector<std::size_t>& nodeOffsets, const std::vector<AdjacentNode>& adjacentNodes, Graph::NodeId landmarkNodeId, std::vector<double>& times) const {
+        using NodeRecord = std::pair<double, Graph::NodeId>;
+
+        times.assign(_nodeCount, std::numeric_limits<double>::infinity());
+        times[landmarkNodeId] = 0;
+        std::priority_queue<NodeRecord, std::vector<NodeRecord>, std::greater<NodeRecord>> nodeQueue;
+        nodeQueue.push(NodeRecord(0.0, landmarkNodeId));
+        while (!nodeQueue.empty()) {
+            NodeRecord rec = nodeQueue.top();
+            nodeQueue.pop();
+            if (rec.first > times[rec.second]) {
+                continue;
+            }
+            for (std::size_t i = nodeOffsets[rec.second]; i < nodeOffsets[rec.second + 1]; i++) {
+                double time = rec.first + adjacentNodes[i].time;
+                if (time < times[adjacentNodes[i].nodeId]) {
+                    times[adjacentNodes[i].nodeId] = time;
+                    nodeQueue.push(NodeRecord(time, adjacentNodes[i].nodeId));
+                }
+            }
+        }
+    }
+
+    double LandmarkTable::calculateMinTime(const RoutingAttributes& attrs, const Graph::Node& node0, const Graph::Node& node1, double lngScale) {
+        static constexpr double EARTH_RADIUS = 6378137.0;
+
+        // Find the minimum horizontal and vertical distances between the node segments separately, the search uses the same time model
+        auto toLocal = [lngScale](const Point& point) {
+            return cglib::vec2<double>(point(0) * lngScale, point(1));
+        };
+        std::array<cglib::vec2<double>, 2> seg0 {{ toLocal(node0.points[0]), toLocal(node0.points[1]) }};
+        std::array<cglib::vec2<double>, 2> seg1 {{ toLocal(node1.points[0]), toLocal(node1.points[1]) }};
+        double distXY = segmentDistance(seg0, seg1) * EARTH_RADIUS * boost::math::constants::pi<double>() / 180.0;
+
+        double minZ0 = std::min(node0.points[0](2), node0.points[1](2)), maxZ0 = std::max(node0.points[0](2), node0.points[1](2));
+        double minZ1 = std::min(node1.points[0](2), node1.points[1](2)), maxZ1 = std::max(node1.points[0](2), node1.points[1](2));
+        double distZ = std::max(0.0, std::max(minZ0 - maxZ1, minZ1 - maxZ0));
+
+        double time = attrs.delay;
+        time += (distXY > 0 ? distXY / attrs.speed : 0);
+        time += (distZ > 0 ? distZ / attrs.zSpeed : 0);
+        return time;
+    }
+} }
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_SGRE_LANDMARKTABLE_H_
+#define _CARTO_SGRE_LANDMARKTABLE_H_
+
+#include "Base.h"
+#include "Graph.h"
+
+#include <vector>
+
+namespace carto { namespace sgre {
+    class LandmarkTable final {
+    public:
+        LandmarkTable() = delete;
+        explicit LandmarkTable(const StaticGraph& graph, int landmarkCount);
+
+        const std::vector<Graph::NodeId>& getLandmarkNodeIds() const { return _landmarkNodeIds; }
+
+        bool hasNode(Graph::NodeId nodeId) const { return nodeId < _nodeCount; }
+
+        // Lower bound for the travel time from the node to the nearest target node, based on the triangle inequality. Infinity means that no target is reachable.
+        double calculateLowerBound(Graph::NodeId nodeId, const std::vector<Graph::NodeId>& targetNodeIds) const;
+
+    private:
+        struct AdjacentNode {
+            Graph::NodeId nodeId;
+            double time;
+        };
+
+        void calculateTimes(const std::vector<std::size_t>& nodeOffsets, const std::vector<AdjacentNode>& adjacentNodes, Graph::NodeId landmarkNodeId, std::vector<double>& times) const;
+
+        static double calculateMinTime(const RoutingAttributes& attrs, const Graph::Node& node0, const Graph::Node& node1, double lngScale);
+
+        std::size_t _nodeCount = 0;
+        std::vector<Graph::NodeId> _landmarkNodeIds;
+        std::vector<float> _forwardTimes;  // times from landmarks to nodes, stored per node: [nodeId * landmarkCount + landmarkIndex]
+        std::vector<float> _backwardTimes; // times from nodes to landmarks, stored per node
+    };
+} }
+
+#endif
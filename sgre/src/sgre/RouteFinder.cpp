@@ -2,9 +2,7 @@
 
 #include <cassert>
 #include <algorithm>
-#include <queue>
 #include <set>
-#include <map>
 
 #include <boost/math/constants/constants.hpp>
 
@@ -31,87 +29,157 @@ namespace {
 
 namespace carto { namespace sgre {
     Result RouteFinder::find(const Query& query) const {
-        static constexpr double DIST_EPSILON = 1.0e-6;
-        
-        struct EndPoint {
-            Point point;
-            Graph::TriangleId triangleId;
-            std::set<Graph::EdgeId> edgeIds;
-        };
-
-        auto calculateAvgLngScale = [](const Point& point1, const Point& point2) -> double {
-            return std::max(std::cos((point1(1) + point2(1)) * 0.5 * boost::math::constants::pi<double>() / 180.0), 0.01);
-        };
-        
         // Find nearest edges to the endpoints. Note that there could be multiple nearest edges for both endpoints (two-way edges)
         std::vector<EndPoint> endPoints[2];
         for (int i = 0; i < 2; i++) {
-            StaticGraph::SearchOptions options;
-            options.zSensitivity = _zSensitivity;
-            std::vector<std::pair<Graph::EdgeId, Point>> edgePoints = _graph->findNearestEdgePoint(query.getPos(i), options);
-            if (edgePoints.empty()) {
+            endPoints[i] = findEndPoints(query.getPos(i));
+            if (endPoints[i].empty()) {
                 return Result();
             }
-
-            for (const std::pair<Graph::EdgeId, Point>& edgePoint : edgePoints) {
-                const Graph::Edge& edge = _graph->getEdge(edgePoint.first);
-
-                EndPoint endPoint;
-                endPoint.point = edgePoint.second;
-                endPoint.triangleId = edge.triangleId;
-                endPoint.edgeIds = std::set<Graph::EdgeId> {{ edgePoint.first }};
-
-                bool found = false;
-                for (std::size_t j = 0; j < endPoints[i].size(); j++) {
-                    double lngScale = calculateAvgLngScale(endPoints[i][j].point, endPoint.point);
-                    double dist = calculateDistance(endPoints[i][j].point, endPoint.point, lngScale);
-                    if (dist < DIST_EPSILON && endPoints[i][j].triangleId == endPoint.triangleId) {
-                        endPoints[i][j].edgeIds.insert(edgePoint.first);
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    endPoints[i].push_back(endPoint);
-                }
-            }
         }
         
-        // Try all endpoint combinations and find the fastest one.
-        Path bestPath;
-        double bestTime = std::numeric_limits<double>::infinity();
-        double bestLngScale = 0;
-        std::shared_ptr<DynamicGraph> bestGraph;
+        // Build a single overlay graph containing all endpoint candidates as virtual nodes.
+        // Initial nodes have no incoming edges and final nodes no outgoing edges, so candidates can not interfere with each other.
+        auto graph = std::make_shared<DynamicGraph>(_graph);
+        std::vector<Graph::NodeId> initialNodeIds;
+        for (const EndPoint& endPoint : endPoints[0]) {
+            Graph::NodeId initialNodeId = createNode(*graph, endPoint.point);
+            linkNodeToEdges(*graph, endPoint.edgeIds, initialNodeId, 0);
+            initialNodeIds.push_back(initialNodeId);
+        }
+        std::vector<Graph::NodeId> finalNodeIds;
+        for (const EndPoint& endPoint : endPoints[1]) {
+            Graph::NodeId finalNodeId = createNode(*graph, endPoint.point);
+            linkNodeToEdges(*graph, endPoint.edgeIds, finalNodeId, 1);
+            finalNodeIds.push_back(finalNodeId);
+        }
         for (std::size_t i0 = 0; i0 < endPoints[0].size(); i0++) {
             for (std::size_t i1 = 0; i1 < endPoints[1].size(); i1++) {
-                auto graph = std::make_shared<DynamicGraph>(_graph);
-
-                Graph::NodeId initialNodeId = createNode(*graph, endPoints[0][i0].point);
-                Graph::NodeId finalNodeId = createNode(*graph, endPoints[1][i1].point);
-
-                linkNodeToEdges(*graph, endPoints[0][i0].edgeIds, initialNodeId, 0);
-                linkNodeToEdges(*graph, endPoints[1][i1].edgeIds, finalNodeId, 1);
-                linkNodesToCommonEdges(*graph, endPoints[0][i0].edgeIds, endPoints[1][i1].edgeIds, initialNodeId, finalNodeId);
+                linkNodesToCommonEdges(*graph, endPoints[0][i0].edgeIds, endPoints[1][i1].edgeIds, initialNodeIds[i0], finalNodeIds[i1]);
+            }
+        }
 
-                double lngScale = calculateAvgLngScale(endPoints[0][i0].point, endPoints[1][i1].point);
-                if (auto path = findOptimalPath(*graph, initialNodeId, finalNodeId, _fastestAttributes, lngScale, _tesselationDistance, bestTime)) {
-                    bestPath = *path;
-                    bestGraph = graph;
-                    bestLngScale = lngScale;
-                }
+        // Use the average latitude of the candidates for longitude scaling
+        double avgLat[2] = { 0, 0 };
+        for (int i = 0; i < 2; i++) {
+            for (const EndPoint& endPoint : endPoints[i]) {
+                avgLat[i] += endPoint.point(1);
             }
+            avgLat[i] /= endPoints[i].size();
         }
-        if (!bestGraph) {
+        double bestLngScale = calculateAvgLngScale(Point(0, avgLat[0], 0), Point(0, avgLat[1], 0));
+
+        // Find the fastest path from any initial node to any final node in a single search
+        boost::optional<Path> bestPath = findOptimalPath(*graph, initialNodeIds, finalNodeIds, _fastestAttributes, _landmarkTable.get(), bestLngScale, _tesselationDistance);
+        if (!bestPath) {
             return Result();
         }
 
         // Do optional path straightening. This is very important for polygon/hybrid graphs.
         if (_pathStraightening) {
-            straightenPath(*bestGraph, bestPath, bestLngScale);
+            straightenPath(*graph, *bestPath, bestLngScale);
         }
 
         // Build final result (remove duplicate nodes, create instructions)
-        return buildResult(*bestGraph, bestPath, bestLngScale);
+        return buildResult(*graph, *bestPath, bestLngScale);
+    }
+
+    Isochrone RouteFinder::findIsochrone(const Point& pos, double maxTime, bool calculateBoundary) const {
+        std::vector<EndPoint> endPoints = findEndPoints(pos);
+        if (endPoints.empty()) {
+            return Isochrone();
+        }
+
+        // Link all origin candidates to an overlay graph, as in point-to-point queries
+        auto graph = std::make_shared<DynamicGraph>(_graph);
+        std::vector<Graph::NodeId> initialNodeIds;
+        double avgLat = 0;
+        for (const EndPoint& endPoint : endPoints) {
+            Graph::NodeId initialNodeId = createNode(*graph, endPoint.point);
+            linkNodeToEdges(*graph, endPoint.edgeIds, initialNodeId, 0);
+            initialNodeIds.push_back(initialNodeId);
+            avgLat += endPoint.point(1);
+
+            // An origin exactly at a linestring vertex reaches the vertex node itself without cost
+            for (Graph::EdgeId edgeId : endPoint.edgeIds) {
+                Graph::NodeId sourceNodeId = _graph->getEdge(edgeId).nodeIds[0];
+                const Graph::Node& sourceNode = _graph->getNode(sourceNodeId);
+                if (sourceNode.points[0] == endPoint.point && sourceNode.points[1] == endPoint.point) {
+                    initialNodeIds.push_back(sourceNodeId);
+                }
+            }
+        }
+        avgLat /= endPoints.size();
+        double lngScale = calculateAvgLngScale(Point(0, avgLat, 0), Point(0, avgLat, 0));
+
+        // Run a one-to-many search without targets until all entries within the time budget are settled
+        SearchSpace& searchSpace = getSearchSpace();
+        searchSpace.reset(graph->getNodeIdRangeEnd());
+        for (Graph::NodeId initialNodeId : initialNodeIds) {
+            searchSpace.update(initialNodeId, 0.0, 0.0, 0.0, Graph::EdgeId(-1), -1);
+        }
+        auto calculateEstTime = [](Graph::NodeId, const Point&, Graph::NodeId) {
+            return 0.0;
+        };
+        while (!searchSpace.empty()) {
+            int index = searchSpace.pop();
+            expandNode(*graph, searchSpace, index, std::vector<Graph::NodeId>(), lngScale, _tesselationDistance, maxTime, calculateEstTime);
+        }
+
+        // Collect the fastest entry of each static node. Triangle edge nodes may have several entries with different T values.
+        std::vector<int> nodeEntryIndices;
+        for (int index = 0; index < searchSpace.getEntryCount(); index++) {
+            const SearchSpace::Entry& entry = searchSpace.getEntry(index);
+            if (graph->isStaticNode(entry.nodeId)) {
+                nodeEntryIndices.push_back(index);
+            }
+        }
+        std::sort(nodeEntryIndices.begin(), nodeEntryIndices.end(), [&searchSpace](int index0, int index1) {
+            const SearchSpace::Entry& entry0 = searchSpace.getEntry(index0);
+            const SearchSpace::Entry& entry1 = searchSpace.getEntry(index1);
+            return entry0.nodeId < entry1.nodeId || (entry0.nodeId == entry1.nodeId && entry0.time < entry1.time);
+        });
+
+        std::vector<Isochrone::NodeTime> nodeTimes;
+        for (int index : nodeEntryIndices) {
+            const SearchSpace::Entry& entry = searchSpace.getEntry(index);
+            if (nodeTimes.empty() || nodeTimes.back().nodeId != entry.nodeId) {
+                const Graph::Node& node = graph->getNode(entry.nodeId);
+                nodeTimes.push_back({ entry.nodeId, node.points[0] + (node.points[1] - node.points[0]) * entry.nodeT, entry.time });
+            }
+        }
+
+        if (!calculateBoundary) {
+            return Isochrone(std::move(nodeTimes), std::vector<Point>());
+        }
+
+        // Use all reached points and the points where the time budget runs out along the outgoing edges as boundary candidates
+        std::vector<Point> points;
+        for (int index = 0; index < searchSpace.getEntryCount(); index++) {
+            const SearchSpace::Entry& entry = searchSpace.getEntry(index);
+            const Graph::Node& node = graph->getNode(entry.nodeId);
+            Point nodePos = node.points[0] + (node.points[1] - node.points[0]) * entry.nodeT;
+            points.push_back(nodePos);
+
+            double remainingTime = maxTime - entry.time;
+            processNodeEdges(*graph, entry.nodeId, [&](Graph::EdgeId, Graph::NodeId targetNodeId, const RoutingAttributes& attributes) {
+                const Graph::Node& targetNode = graph->getNode(targetNodeId);
+                Point targetNodePos = (targetNode.points[0] + targetNode.points[1]) * 0.5;
+                double edgeTime = calculateTime(attributes, true, 0.0, nodePos, targetNodePos, lngScale);
+                if (std::isfinite(edgeTime) && edgeTime > remainingTime && remainingTime >= attributes.delay) {
+                    points.push_back(nodePos + (targetNodePos - nodePos) * ((remainingTime - attributes.delay) / (edgeTime - attributes.delay)));
+                }
+            });
+        }
+        return Isochrone(std::move(nodeTimes), buildBoundary(pos, points, lngScale));
+    }
+
+    void RouteFinder::setLandmarkCount(int landmarkCount) {
+        if (landmarkCount > 0) {
+            _landmarkTable = std::make_shared<LandmarkTable>(*_graph, landmarkCount);
+        } else {
+            _landmarkTable.reset();
+        }
     }
 
     std::unique_ptr<RouteFinder> RouteFinder::create(std::shared_ptr<const StaticGraph> graph, const picojson::value& configDef) {
@@ -125,9 +193,46 @@ namespace carto { namespace sgre {
         if (configDef.contains("zsensitivity")) {
             routeFinder->setZSensitivity(configDef.get("zsensitivity").get<double>());
         }
+        if (configDef.contains("landmarks")) {
+            routeFinder->setLandmarkCount(static_cast<int>(configDef.get("landmarks").get<double>()));
+        }
         return routeFinder;
     }
 
+    std::vector<RouteFinder::EndPoint> RouteFinder::findEndPoints(const Point& pos) const {
+        static constexpr double DIST_EPSILON = 1.0e-6;
+
+        StaticGraph::SearchOptions options;
+        options.zSensitivity = _zSensitivity;
+        std::vector<std::pair<Graph::EdgeId, Point>> edgePoints = _graph->findNearestEdgePoint(pos, options);
+
+        // Merge the edge points at the same location of the same triangle
+        std::vector<EndPoint> endPoints;
+        for (const std::pair<Graph::EdgeId, Point>& edgePoint : edgePoints) {
+            const Graph::Edge& edge = _graph->getEdge(edgePoint.first);
+
+            EndPoint endPoint;
+            endPoint.point = edgePoint.second;
+            endPoint.triangleId = edge.triangleId;
+            endPoint.edgeIds = std::set<Graph::EdgeId> {{ edgePoint.first }};
+
+            bool found = false;
+            for (std::size_t j = 0; j < endPoints.size(); j++) {
+                double lngScale = calculateAvgLngScale(endPoints[j].point, endPoint.point);
+                double dist = calculateDistance(endPoints[j].point, endPoint.point, lngScale);
+                if (dist < DIST_EPSILON && endPoints[j].triangleId == endPoint.triangleId) {
+                    endPoints[j].edgeIds.insert(edgePoint.first);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                endPoints.push_back(endPoint);
+            }
+        }
+        return endPoints;
+    }
+
     Graph::NodeId RouteFinder::createNode(DynamicGraph& graph, const Point& point) {
         Graph::Node node;
         node.nodeFlags = Graph::NodeFlags(0);
@@ -137,6 +242,8 @@ namespace carto { namespace sgre {
 
     void RouteFinder::linkNodeToEdges(DynamicGraph& graph, const std::set<Graph::EdgeId>& edgeIds, Graph::NodeId nodeId, int nodeIdx) {
         // Find all 'linked edge' ids. For triangles this means finding all edges of the triangle.
+        // Only static edges are considered, as the graph may already contain edges added for other endpoint candidates.
+        Graph::EdgeId staticEdgeIdRangeEnd = graph.getStaticGraph().getEdgeIdRangeEnd();
         std::set<Graph::EdgeId> linkedEdgeIds;
         for (Graph::EdgeId edgeId : edgeIds) {
             const Graph::Edge& edge = graph.getEdge(edgeId);
@@ -145,7 +252,7 @@ namespace carto { namespace sgre {
                 const Graph::Node& node = graph.getNode(edge.nodeIds[1 - nodeIdx]);
                 for (Graph::EdgeId linkedEdgeId : node.edgeIds) {
                     const Graph::Edge& linkedEdge = graph.getEdge(linkedEdgeId);
-                    if (linkedEdge.triangleId == edge.triangleId) {
+                    if (linkedEdgeId < staticEdgeIdRangeEnd && linkedEdge.triangleId == edge.triangleId) {
                         linkedEdgeIds.insert(linkedEdgeId);
 
                         // For final node, we need to do another hop as we do not store incoming edge ids for nodes
@@ -153,7 +260,7 @@ namespace carto { namespace sgre {
                             const Graph::Node& nextNode = graph.getNode(linkedEdge.nodeIds[1]);
                             for (Graph::EdgeId nextLinkedEdgeId : nextNode.edgeIds) {
                                 const Graph::Edge& nextLinkedEdge = graph.getEdge(nextLinkedEdgeId);
-                                if (nextLinkedEdge.triangleId == edge.triangleId) {
+                                if (nextLinkedEdgeId < staticEdgeIdRangeEnd && nextLinkedEdge.triangleId == edge.triangleId) {
                                     linkedEdgeIds.insert(nextLinkedEdgeId);
                                 }
                             }
@@ -340,7 +447,27 @@ namespace carto { namespace sgre {
             nodePoints.push_back(graph.getNode(path[i].edge.nodeIds[1]).points);
         }
 
-        // Path straightening may need lots of iterations
+        auto calculatePathDistance = [&]() {
+            double dist = 0;
+            Point pos0 = initialPoint;
+            for (std::size_t i = 0; i < path.size(); i++) {
+                Point pos1 = nodePoints[i][0] + (nodePoints[i][1] - nodePoints[i][0]) * path[i].targetNodeT;
+                dist += calculateDistance(pos0, pos1, lngScale);
+                pos0 = pos1;
+            }
+            return dist;
+        };
+
+        // Find the taut path in a single pass using the funnel algorithm. As the funnel works in 2D, the relaxation
+        // passes below are still needed for non-planar paths, but for planar paths the first pass makes no progress.
+        Path oldPath = path;
+        double oldDist = calculatePathDistance();
+        straightenPathFunnel(initialPoint, nodePoints, path, lngScale);
+        if (calculatePathDistance() > oldDist) {
+            path = std::move(oldPath);
+        }
+
+        // Refine the path by relaxing the node T values one by one
         bool reverse = false;
         for (int iter = 0; iter < MAX_ITERATIONS; iter++) {
             bool progress = false;
@@ -374,109 +501,391 @@ namespace carto { namespace sgre {
         }
     }
 
-    boost::optional<RouteFinder::Path> RouteFinder::findOptimalPath(const Graph& graph, Graph::NodeId initialNodeId, Graph::NodeId finalNodeId, const RoutingAttributes& fastestAttributes, double lngScale, double tesselationDistance, double& bestTime) {
-        struct PathNodeKey {
-            Graph::NodeId nodeId;
-            double nodeT;
+    void RouteFinder::straightenPathFunnel(const Point& initialPoint, const std::vector<std::array<Point, 2>>& nodePoints, Path& path, double lngScale) {
+        static constexpr double POS_EPSILON = 1.0e-12;
 
-            bool operator < (const PathNodeKey& key) const { if (nodeId != key.nodeId) return nodeId < key.nodeId; return nodeT < key.nodeT; }
-        };
+        using Vec2 = cglib::vec2<double>;
 
-        struct PathElement {
-            double time;
-            Graph::EdgeId edgeId;
-            double nodeT;
+        auto toLocal = [lngScale](const Point& point) {
+            return Vec2(point(0) * lngScale, point(1));
         };
-        
-        struct NodeRecord {
-            double time;
-            Graph::NodeId nodeId;
-            double nodeT;
-
-            bool operator < (const NodeRecord& rec) const { return rec.time < time; }
+        auto cross = [](const Vec2& v0, const Vec2& v1) {
+            return v0(0) * v1(1) - v0(1) * v1(0);
+        };
+        auto equalPos = [](const Vec2& pos0, const Vec2& pos1) {
+            return cglib::norm(pos1 - pos0) <= POS_EPSILON * POS_EPSILON;
         };
 
-        const Graph::Node& initialNode = graph.getNode(initialNodeId);
-        const Graph::Node& finalNode = graph.getNode(finalNodeId);
+        // Build the portals, the initial point is the first portal. Portal i + 1 corresponds to path node i.
+        std::vector<std::array<Vec2, 2>> portals;
+        portals.push_back({{ toLocal(initialPoint), toLocal(initialPoint) }});
+        for (const std::array<Point, 2>& points : nodePoints) {
+            portals.push_back({{ toLocal(points[0]), toLocal(points[1]) }});
+        }
 
-        // Initialize path map for initial node
-        std::map<PathNodeKey, PathElement> bestPathMap;
-        bestPathMap[{ initialNodeId, 0.0 }] = { 0.0, Graph::EdgeId(-1), -1.0 };
+        // Orient the portals as (left, right) pairs relative to the travel direction. Consecutive triangle edge portals share a vertex,
+        // the non-shared vertex of the neighbour portal gives the side of the triangle. Flags tell if the portal points were swapped.
+        std::vector<bool> swapped(portals.size(), false);
+        for (std::size_t i = 1; i + 1 < portals.size(); i++) {
+            std::array<Vec2, 2>& portal = portals[i];
+            if (equalPos(portal[0], portal[1])) {
+                continue;
+            }
 
-        // Use priority queue for storing fastest estimations. Start with fastest estimation from initial node to final node.
-        std::priority_queue<NodeRecord> nodeQueue;
-        double bestTotalEstTime = calculateTime(fastestAttributes, false, 0.0, initialNode.points[0], finalNode.points[0], lngScale);
-        nodeQueue.push({ bestTotalEstTime, initialNodeId, 0.0 });
+            double side = 0;
+            for (int dir : { 1, -1 }) {
+                const std::array<Vec2, 2>& neighbourPortal = portals[i + dir];
+                for (int j = 0; j < 2 && side == 0; j++) {
+                    if (equalPos(neighbourPortal[j], portal[0]) || equalPos(neighbourPortal[j], portal[1])) {
+                        side = dir * cross(portal[1] - portal[0], neighbourPortal[1 - j] - portal[0]);
+                    }
+                }
+                if (side != 0) {
+                    break;
+                }
+            }
+            if (side == 0) {
+                // Not inside a triangle strip, use the direction of the current path
+                Vec2 pos0 = portals[i - 1][0] + (portals[i - 1][1] - portals[i - 1][0]) * (i > 1 ? path[i - 2].targetNodeT : 0.0);
+                Vec2 pos1 = portals[i + 1][0] + (portals[i + 1][1] - portals[i + 1][0]) * path[i].targetNodeT;
+                side = cross(portal[1] - portal[0], pos1 - pos0);
+            }
+            if (side < 0) {
+                std::swap(portal[0], portal[1]);
+                swapped[i] = true;
+            }
+        }
 
-        // Process the node queue
-        while (!nodeQueue.empty()) {
-            NodeRecord rec = nodeQueue.top();
-            nodeQueue.pop();
+        // Simple stupid funnel algorithm. The corners of the taut path are stored together with the last portal index they belong to.
+        std::vector<std::pair<Vec2, std::size_t>> corners;
+        auto addCorner = [&corners, &equalPos](const Vec2& pos, std::size_t index) {
+            if (!corners.empty() && equalPos(corners.back().first, pos)) {
+                corners.back().second = index; // the apex may be restarted from the same point, merge the corners
+            } else {
+                corners.emplace_back(pos, index);
+            }
+        };
+        Vec2 apex = portals[0][0], left = portals[0][0], right = portals[0][1];
+        std::size_t apexIndex = 0, leftIndex = 0, rightIndex = 0;
+        addCorner(apex, apexIndex);
+        for (std::size_t i = 1; i < portals.size(); i++) {
+            const Vec2& portalLeft = portals[i][0];
+            const Vec2& portalRight = portals[i][1];
+
+            // Try to narrow the funnel from the right
+            if (cross(right - apex, portalRight - apex) >= 0) {
+                if (equalPos(apex, right) || cross(left - apex, portalRight - apex) < 0) {
+                    right = portalRight;
+                    rightIndex = i;
+                } else {
+                    // Right side crosses the left side, the left point becomes the new apex
+                    apex = right = left;
+                    apexIndex = rightIndex = leftIndex;
+                    addCorner(apex, apexIndex);
+                    i = apexIndex;
+                    continue;
+                }
+            }
 
-            if (rec.time >= bestTime) {
-                break;
+            // Try to narrow the funnel from the left
+            if (cross(left - apex, portalLeft - apex) <= 0) {
+                if (equalPos(apex, left) || cross(right - apex, portalLeft - apex) > 0) {
+                    left = portalLeft;
+                    leftIndex = i;
+                } else {
+                    // Left side crosses the right side, the right point becomes the new apex
+                    apex = left = right;
+                    apexIndex = leftIndex = rightIndex;
+                    addCorner(apex, apexIndex);
+                    i = apexIndex;
+                    continue;
+                }
+            }
+        }
+        addCorner(portals.back()[0], portals.size() - 1);
+
+        // Find the T values of the path nodes by intersecting the portals with the taut path segments
+        std::size_t cornerIndex = 0;
+        for (std::size_t i = 1; i + 1 < portals.size(); i++) {
+            const std::array<Vec2, 2>& portal = portals[i];
+            if (equalPos(portal[0], portal[1])) {
+                continue;
+            }
+            while (cornerIndex + 2 < corners.size() && corners[cornerIndex + 1].second < i) {
+                cornerIndex++;
             }
 
-            if (rec.nodeId == finalNodeId) {
-                break;
+            double t = 0;
+            if (corners[cornerIndex + 1].second == i) {
+                t = (equalPos(corners[cornerIndex + 1].first, portal[0]) ? 0.0 : 1.0);
+            } else {
+                Vec2 delta = corners[cornerIndex + 1].first - corners[cornerIndex].first;
+                double denom = cross(delta, portal[1] - portal[0]);
+                if (denom == 0) {
+                    continue;
+                }
+                t = std::max(0.0, std::min(1.0, cross(delta, corners[cornerIndex].first - portal[0]) / denom));
             }
+            path[i - 1].targetNodeT = (swapped[i] ? 1.0 - t : t);
+        }
+    }
 
-            Graph::NodeId nodeId = rec.nodeId;
-            const Graph::Node& node = graph.getNode(nodeId);
-            double nodeT = rec.nodeT;
-            Point nodePos = node.points[0] + (node.points[1] - node.points[0]) * nodeT;
-            double time = bestPathMap[{ nodeId, nodeT }].time;
+    boost::optional<RouteFinder::Path> RouteFinder::findOptimalPath(const DynamicGraph& graph, const std::vector<Graph::NodeId>& initialNodeIds, const std::vector<Graph::NodeId>& finalNodeIds, const RoutingAttributes& fastestAttributes, const LandmarkTable* landmarkTable, double lngScale, double tesselationDistance) {
+        auto isFinalNode = [&finalNodeIds](Graph::NodeId nodeId) {
+            return std::find(finalNodeIds.begin(), finalNodeIds.end(), nodeId) != finalNodeIds.end();
+        };
 
-            // Process each edge from the current node
-            for (Graph::EdgeId edgeId : node.edgeIds) {
+        // Final nodes can be reached only from the nodes linked to them. Landmark bounds to these nodes are also bounds to the final nodes.
+        std::vector<Graph::NodeId> landmarkTargetNodeIds;
+        if (landmarkTable) {
+            for (Graph::EdgeId edgeId = graph.getStaticGraph().getEdgeIdRangeEnd(); edgeId < graph.getEdgeIdRangeEnd(); edgeId++) {
                 const Graph::Edge& edge = graph.getEdge(edgeId);
-                assert(edge.nodeIds[0] == nodeId);
-                Graph::NodeId targetNodeId = edge.nodeIds[1];
-                const Graph::Node& targetNode = graph.getNode(targetNodeId);
-
-                // Tesselate all triangle edges based on tesselation distance
-                int tesselationLevel = static_cast<int>(std::floor(calculateDistance(targetNode.points[0], targetNode.points[1], lngScale) / tesselationDistance)) + 1;
-                for (int i = 0; i < tesselationLevel; i++) {
-                    double targetNodeT = (targetNodeId == finalNodeId ? 0.0 : (i + 1.0) / (tesselationLevel + 1.0));
-                    Point targetNodePos = targetNode.points[0] + (targetNode.points[1] - targetNode.points[0]) * targetNodeT;
-
-                    // Check if we found a better path to target node compared to existing path
-                    double targetTime = time + calculateTime(edge.attributes, true, 0.0, nodePos, targetNodePos, lngScale);
-                    if (!std::isfinite(targetTime)) {
-                        continue;
-                    }
-                    auto it = bestPathMap.find({ targetNodeId, targetNodeT });
-                    if (it != bestPathMap.end() && it->second.time <= targetTime) {
-                        continue;
-                    }
-                    bestPathMap[{ targetNodeId, targetNodeT }] = { targetTime, edgeId, nodeT };
+                if (isFinalNode(edge.nodeIds[1]) && landmarkTable->hasNode(edge.nodeIds[0])) {
+                    landmarkTargetNodeIds.push_back(edge.nodeIds[0]);
+                }
+            }
+            std::sort(landmarkTargetNodeIds.begin(), landmarkTargetNodeIds.end());
+            landmarkTargetNodeIds.erase(std::unique(landmarkTargetNodeIds.begin(), landmarkTargetNodeIds.end()), landmarkTargetNodeIds.end());
+        }
 
-                    // Calculate the fastest possible estimation from target node to the final node
-                    double bestTotalEstTime = targetTime + calculateTime(fastestAttributes, false, 0.0, targetNodePos, finalNode.points[0], lngScale);
-                    nodeQueue.push({ bestTotalEstTime, targetNodeId, targetNodeT });
+        // Calculate the fastest possible estimation from the given node point to the given final node, or to the nearest final node if the final node is -1.
+        // Landmark bounds depend only on the node, the last bound is cached as tesselation points of the same node are estimated consecutively.
+        Graph::NodeId boundNodeId = Graph::NodeId(-1);
+        double bound = 0;
+        auto calculateEstTime = [&](Graph::NodeId nodeId, const Point& pos, Graph::NodeId finalNodeId) {
+            if (isFinalNode(nodeId)) {
+                return 0.0;
+            }
+            double estTime = std::numeric_limits<double>::infinity();
+            for (Graph::NodeId otherFinalNodeId : finalNodeIds) {
+                if (finalNodeId == Graph::NodeId(-1) || finalNodeId == otherFinalNodeId) {
+                    estTime = std::min(estTime, calculateTime(fastestAttributes, false, 0.0, pos, graph.getNode(otherFinalNodeId).points[0], lngScale));
                 }
             }
+            if (landmarkTable && landmarkTable->hasNode(nodeId)) {
+                if (nodeId != boundNodeId) {
+                    bound = landmarkTable->calculateLowerBound(nodeId, landmarkTargetNodeIds);
+                    boundNodeId = nodeId;
+                }
+                estTime = std::max(estTime, bound);
+            }
+            return estTime;
+        };
+
+        // Initialize search space with all initial nodes. This is equivalent to a search from a virtual super-source node.
+        SearchSpace& searchSpace = getSearchSpace();
+        searchSpace.reset(graph.getNodeIdRangeEnd());
+        for (Graph::NodeId initialNodeId : initialNodeIds) {
+            searchSpace.update(initialNodeId, 0.0, 0.0, calculateEstTime(initialNodeId, graph.getNode(initialNodeId).points[0], Graph::NodeId(-1)), Graph::EdgeId(-1), -1);
+        }
+
+        // Process the heap until the first final node is reached
+        int reachedIndex = -1;
+        while (!searchSpace.empty()) {
+            int index = searchSpace.pop();
+            Graph::NodeId nodeId = searchSpace.getEntry(index).nodeId;
+            if (isFinalNode(nodeId)) {
+                reachedIndex = index;
+                break;
+            }
+
+            expandNode(graph, searchSpace, index, finalNodeIds, lngScale, tesselationDistance, std::numeric_limits<double>::infinity(), calculateEstTime);
         }
 
-        auto it = bestPathMap.find({ finalNodeId, 0.0 });
-        if (it == bestPathMap.end() || it->second.time >= bestTime) {
+        if (reachedIndex == -1) {
             return boost::optional<Path>();
         }
-        bestTime = it->second.time;
 
         // Reconstruct the optimal path backwards.
         Path bestPath;
-        while (it->second.edgeId != Graph::EdgeId(-1)) {
-            const Graph::Edge& edge = graph.getEdge(it->second.edgeId);
-            assert(edge.nodeIds[1] == it->first.nodeId);
-            bestPath.push_back({ edge, it->first.nodeT });
-            it = bestPathMap.find({ edge.nodeIds[0], it->second.nodeT });
-            assert(it != bestPathMap.end());
+        for (int index = reachedIndex; searchSpace.getEntry(index).edgeId != Graph::EdgeId(-1); index = searchSpace.getEntry(index).prevIndex) {
+            const SearchSpace::Entry& entry = searchSpace.getEntry(index);
+            const Graph::Edge& edge = graph.getEdge(entry.edgeId);
+            assert(edge.nodeIds[1] == entry.nodeId);
+            bestPath.push_back({ edge, entry.nodeT });
         }
         std::reverse(bestPath.begin(), bestPath.end());
         return bestPath;
     }
 
+    template <typename EdgeFunc>
+    void RouteFinder::processNodeEdges(const DynamicGraph& graph, Graph::NodeId nodeId, const EdgeFunc& edgeFunc) {
+        // Nodes not touched by the query use the compact adjacency table of the static graph, other nodes need the generic edge lookup
+        if (graph.isStaticNode(nodeId)) {
+            const StaticGraph& staticGraph = graph.getStaticGraph();
+            StaticGraph::AdjacentEdgeRange adjacentEdges = staticGraph.getAdjacentEdges(nodeId);
+            for (const StaticGraph::AdjacentEdge* it = adjacentEdges.first; it != adjacentEdges.second; it++) {
+                edgeFunc(it->edgeId, it->targetNodeId, staticGraph.getAttributes(it->attributesId));
+            }
+        } else {
+            for (Graph::EdgeId edgeId : graph.getNode(nodeId).edgeIds) {
+                const Graph::Edge& edge = graph.getEdge(edgeId);
+                assert(edge.nodeIds[0] == nodeId);
+                edgeFunc(edgeId, edge.nodeIds[1], edge.attributes);
+            }
+        }
+    }
+
+    template <typename EstTimeFunc>
+    void RouteFinder::expandNode(const DynamicGraph& graph, SearchSpace& searchSpace, int index, const std::vector<Graph::NodeId>& finalNodeIds, double lngScale, double tesselationDistance, double maxTime, const EstTimeFunc& calculateEstTime) {
+        auto isFinalNode = [&finalNodeIds](Graph::NodeId nodeId) {
+            return std::find(finalNodeIds.begin(), finalNodeIds.end(), nodeId) != finalNodeIds.end();
+        };
+
+        // Triangle edges are tesselated based on tesselation distance, final nodes have a single point
+        auto calculatePointCount = [&](Graph::NodeId targetNodeId) {
+            if (isFinalNode(targetNodeId)) {
+                return 1;
+            }
+            const Graph::Node& targetNode = graph.getNode(targetNodeId);
+            return static_cast<int>(std::floor(calculateDistance(targetNode.points[0], targetNode.points[1], lngScale) / tesselationDistance)) + 1;
+        };
+
+        // Generate the tesselation points of the edge starting from the given point. The estimated total times of the points do not decrease in the
+        // given direction, so the generation can stop at the first queued entry and the remaining points can be attached to it.
+        auto generatePoints = [&](int sourceIndex, Graph::EdgeId edgeId, Graph::NodeId targetNodeId, const RoutingAttributes& attributes, int pointIndex, int pointStep) {
+            const SearchSpace::Entry& sourceEntry = searchSpace.getEntry(sourceIndex);
+            const Graph::Node& sourceNode = graph.getNode(sourceEntry.nodeId);
+            Point sourcePos = sourceNode.points[0] + (sourceNode.points[1] - sourceNode.points[0]) * sourceEntry.nodeT;
+            double sourceTime = sourceEntry.time;
+
+            const Graph::Node& targetNode = graph.getNode(targetNodeId);
+            int pointCount = calculatePointCount(targetNodeId);
+            for (; pointIndex >= 0 && pointIndex < pointCount; pointIndex += pointStep) {
+                double targetNodeT = (isFinalNode(targetNodeId) ? 0.0 : (pointIndex + 1.0) / (pointCount + 1.0));
+                Point targetNodePos = targetNode.points[0] + (targetNode.points[1] - targetNode.points[0]) * targetNodeT;
+
+                // Store the target node if we found a better path compared to existing path
+                double targetTime = sourceTime + calculateTime(attributes, true, 0.0, sourcePos, targetNodePos, lngScale);
+                if (!std::isfinite(targetTime)) {
+                    return;
+                }
+                if (targetTime > maxTime) {
+                    continue;
+                }
+                int targetIndex = searchSpace.find(targetNodeId, targetNodeT);
+                if (targetIndex != -1 && searchSpace.getEntry(targetIndex).time <= targetTime) {
+                    if (!searchSpace.isQueued(targetIndex)) {
+                        continue;
+                    }
+                } else {
+                    double estTime = calculateEstTime(targetNodeId, targetNodePos, Graph::NodeId(-1));
+                    if (!std::isfinite(estTime)) {
+                        return;
+                    }
+                    targetIndex = searchSpace.update(targetNodeId, targetNodeT, targetTime, targetTime + estTime, edgeId, sourceIndex);
+                }
+                if (pointIndex + pointStep >= 0 && pointIndex + pointStep < pointCount) {
+                    SearchSpace::PendingPoints pendingPoints;
+                    pendingPoints.sourceIndex = sourceIndex;
+                    pendingPoints.edgeId = edgeId;
+                    pendingPoints.pointIndex = pointIndex + pointStep;
+                    pendingPoints.pointStep = pointStep;
+                    searchSpace.attachPendingPoints(targetIndex, pendingPoints);
+                }
+                return;
+            }
+        };
+
+        // Continue the point ranges that were postponed until this entry
+        SearchSpace::PendingPoints pendingPoints;
+        while (searchSpace.popPendingPoints(index, pendingPoints)) {
+            const Graph::Edge& edge = graph.getEdge(pendingPoints.edgeId);
+            generatePoints(pendingPoints.sourceIndex, pendingPoints.edgeId, edge.nodeIds[1], edge.attributes, pendingPoints.pointIndex, pendingPoints.pointStep);
+        }
+
+        Graph::NodeId nodeId = searchSpace.getEntry(index).nodeId;
+        const Graph::Node& node = graph.getNode(nodeId);
+        double nodeT = searchSpace.getEntry(index).nodeT;
+        Point nodePos = node.points[0] + (node.points[1] - node.points[0]) * nodeT;
+
+        // Process each edge from the current node
+        std::vector<int> seedPointIndices;
+        processNodeEdges(graph, nodeId, [&](Graph::EdgeId edgeId, Graph::NodeId targetNodeId, const RoutingAttributes& attributes) {
+            const Graph::Node& targetNode = graph.getNode(targetNodeId);
+            int pointCount = calculatePointCount(targetNodeId);
+            if (pointCount == 1) {
+                generatePoints(index, edgeId, targetNodeId, attributes, 0, 1);
+                return;
+            }
+
+            // Points are generated lazily, starting from the point with the smallest estimated total time. For a single final node the estimate is
+            // convex along the edge, so with several final nodes the search starts from the best point of each final node.
+            auto calculateTotalTime = [&](int pointIndex, Graph::NodeId finalNodeId) {
+                Point targetNodePos = targetNode.points[0] + (targetNode.points[1] - targetNode.points[0]) * ((pointIndex + 1.0) / (pointCount + 1.0));
+                return calculateTime(attributes, true, 0.0, nodePos, targetNodePos, lngScale) + calculateEstTime(targetNodeId, targetNodePos, finalNodeId);
+            };
+            seedPointIndices.clear();
+            for (std::size_t i = 0; i < std::max(finalNodeIds.size(), std::size_t(1)); i++) {
+                Graph::NodeId finalNodeId = (finalNodeIds.empty() ? Graph::NodeId(-1) : finalNodeIds[i]);
+                int minIndex = 0, maxIndex = pointCount - 1;
+                while (maxIndex - minIndex > 2) {
+                    int index0 = minIndex + (maxIndex - minIndex) / 3;
+                    int index1 = maxIndex - (maxIndex - minIndex) / 3;
+                    if (calculateTotalTime(index0, finalNodeId) <= calculateTotalTime(index1, finalNodeId)) {
+                        maxIndex = index1;
+                    } else {
+                        minIndex = index0;
+                    }
+                }
+                int bestIndex = minIndex;
+                double bestTotalTime = calculateTotalTime(minIndex, finalNodeId);
+                for (int pointIndex = minIndex + 1; pointIndex <= maxIndex; pointIndex++) {
+                    double totalTime = calculateTotalTime(pointIndex, finalNodeId);
+                    if (totalTime < bestTotalTime) {
+                        bestIndex = pointIndex;
+                        bestTotalTime = totalTime;
+                    }
+                }
+                if (std::find(seedPointIndices.begin(), seedPointIndices.end(), bestIndex) == seedPointIndices.end()) {
+                    seedPointIndices.push_back(bestIndex);
+                }
+            }
+            for (int seedPointIndex : seedPointIndices) {
+                generatePoints(index, edgeId, targetNodeId, attributes, seedPointIndex, -1);
+                generatePoints(index, edgeId, targetNodeId, attributes, seedPointIndex + 1, 1);
+            }
+        });
+    }
+
+    std::vector<Point> RouteFinder::buildBoundary(const Point& origin, const std::vector<Point>& points, double lngScale) {
+        static constexpr int SECTOR_COUNT = 72;
+
+        // Keep the farthest point in each angular sector around the origin. Connecting these gives a star-shaped, generally concave, boundary.
+        std::vector<int> sectorPointIndices(SECTOR_COUNT, -1);
+        std::vector<double> sectorDists(SECTOR_COUNT, 0.0);
+        for (std::size_t i = 0; i < points.size(); i++) {
+            double dx = (points[i](0) - origin(0)) * lngScale;
+            double dy = points[i](1) - origin(1);
+            double dist = std::sqrt(dx * dx + dy * dy);
+            if (dist == 0) {
+                continue;
+            }
+            double angle = std::atan2(dy, dx) + boost::math::constants::pi<double>();
+            int sector = std::min(SECTOR_COUNT - 1, static_cast<int>(angle / (2 * boost::math::constants::pi<double>()) * SECTOR_COUNT));
+            if (dist > sectorDists[sector]) {
+                sectorDists[sector] = dist;
+                sectorPointIndices[sector] = static_cast<int>(i);
+            }
+        }
+
+        std::vector<Point> boundary;
+        for (int sector = 0; sector < SECTOR_COUNT; sector++) {
+            if (sectorPointIndices[sector] != -1) {
+                boundary.push_back(points[sectorPointIndices[sector]]);
+            }
+        }
+        if (boundary.size() < 3) {
+            return std::vector<Point>();
+        }
+        return boundary;
+    }
+
+    SearchSpace& RouteFinder::getSearchSpace() {
+        static thread_local SearchSpace searchSpace;
+        return searchSpace;
+    }
+
     double RouteFinder::calculateTime(const RoutingAttributes& attrs, bool applyDelay, double turnAngle, const Point& pos0, const Point& pos1, double lngScale) {
         std::pair<double, double> dist2D = calculateDistance2D(pos0, pos1, lngScale);
 
@@ -495,6 +904,10 @@ namespace carto { namespace sgre {
         return std::sqrt(dist2D.first * dist2D.first + dist2D.second * dist2D.second);
     }
 
+    double RouteFinder::calculateAvgLngScale(const Point& pos0, const Point& pos1) {
+        return std::max(std::cos((pos0(1) + pos1(1)) * 0.5 * boost::math::constants::pi<double>() / 180.0), 0.01);
+    }
+
     std::pair<double, double> RouteFinder::calculateDistance2D(const Point& pos0, const Point& pos1, double lngScale) {
         static constexpr double EARTH_RADIUS = 6378137.0;
 
@@ -9,8 +9,11 @@
 
 #include "Base.h"
 #include "Graph.h"
+#include "Isochrone.h"
+#include "LandmarkTable.h"
 #include "Query.h"
 #include "Result.h"
+#include "SearchSpace.h"
 
 #include <memory>
 #include <string>
@@ -36,11 +39,23 @@ namespace carto { namespace sgre {
         double getZSensitivity() const { return _zSensitivity; }
         void setZSensitivity(double zSensitivity) { _zSensitivity = zSensitivity; }
 
+        int getLandmarkCount() const { return _landmarkTable ? static_cast<int>(_landmarkTable->getLandmarkNodeIds().size()) : 0; }
+        void setLandmarkCount(int landmarkCount);
+
         Result find(const Query& query) const;
 
+        // Travel times to all nodes reachable from the given point within the time budget, using the same cost model as find
+        Isochrone findIsochrone(const Point& pos, double maxTime, bool calculateBoundary) const;
+
         static std::unique_ptr<RouteFinder> create(std::shared_ptr<const StaticGraph> graph, const picojson::value& configDef);
 
     private:
+        struct EndPoint {
+            Point point;
+            Graph::TriangleId triangleId;
+            std::set<Graph::EdgeId> edgeIds;
+        };
+
         struct PathNode {
             Graph::Edge edge;
             double targetNodeT;
@@ -48,6 +63,8 @@ namespace carto { namespace sgre {
         
         using Path = std::vector<PathNode>;
 
+        std::vector<EndPoint> findEndPoints(const Point& pos) const;
+
         static Graph::NodeId createNode(DynamicGraph& graph, const Point& point);
         
         static void linkNodeToEdges(DynamicGraph& graph, const std::set<Graph::EdgeId>& edgeIds, Graph::NodeId nodeId, int nodeIdx);
@@ -59,12 +76,26 @@ namespace carto { namespace sgre {
         static Result buildResult(const Graph& graph, const Path& path, double lngScale);
         
         static void straightenPath(const Graph& graph, Path& path, double lngScale);
+
+        static void straightenPathFunnel(const Point& initialPoint, const std::vector<std::array<Point, 2>>& nodePoints, Path& path, double lngScale);
         
-        static boost::optional<Path> findOptimalPath(const Graph& graph, Graph::NodeId initialNodeId, Graph::NodeId finalNodeId, const RoutingAttributes& fastestAttributes, double lngScale, double tesselationDistance, double& bestTime);
+        static boost::optional<Path> findOptimalPath(const DynamicGraph& graph, const std::vector<Graph::NodeId>& initialNodeIds, const std::vector<Graph::NodeId>& finalNodeIds, const RoutingAttributes& fastestAttributes, const LandmarkTable* landmarkTable, double lngScale, double tesselationDistance);
         
+        template <typename EdgeFunc>
+        static void processNodeEdges(const DynamicGraph& graph, Graph::NodeId nodeId, const EdgeFunc& edgeFunc);
+
+        template <typename EstTimeFunc>
+        static void expandNode(const DynamicGraph& graph, SearchSpace& searchSpace, int index, const std::vector<Graph::NodeId>& finalNodeIds, double lngScale, double tesselationDistance, double maxTime, const EstTimeFunc& calculateEstTime);
+
+        static std::vector<Point> buildBoundary(const Point& origin, const std::vector<Point>& points, double lngScale);
+
+        static SearchSpace& getSearchSpace();
+
         static double calculateTime(const RoutingAttributes& attrs, bool applyDelay, double turnAngle, const Point& pos0, const Point& pos1, double lngScale);
 
         static double calculateDistance(const Point& pos0, const Point& pos1, double lngScale);
+
+        static double calculateAvgLngScale(const Point& pos0, const Point& pos1);
         
         static std::pair<double, double> calculateDistance2D(const Point& pos0, const Point& pos1, double lngScale);
         
@@ -74,6 +105,7 @@ namespace carto { namespace sgre {
 
         const RoutingAttributes _fastestAttributes;
         const std::shared_ptr<const StaticGraph> _graph;
+        std::shared_ptr<const LandmarkTable> _landmarkTable;
     };
 } }
 
@@ -1,5 +1,7 @@
 #include "Rule.h"
 
+#include <algorithm>
+
 namespace carto { namespace sgre {
     void Rule::apply(RoutingAttributes& attribs, bool forward) const {
         int ruleIndex = forward ? 0 : 1;
@@ -91,6 +93,12 @@ namespace carto { namespace sgre {
         return values;
     }
 
+    RuleList::RuleList(std::vector<Rule> rules) :
+        _rules(std::move(rules))
+    {
+        compile();
+    }
+
     void RuleList::filter(const std::string& profile) {
         std::vector<Rule> rules;
         rules.reserve(_rules.size());
@@ -103,6 +111,7 @@ namespace carto { namespace sgre {
             rules.push_back(rule);
         }
         std::swap(rules, _rules);
+        compile();
     }
 
     void RuleList::apply(RoutingAttributes& attribs, bool forward) const {
@@ -111,6 +120,47 @@ namespace carto { namespace sgre {
         }
     }
 
+    std::string RuleList::getMatchKey(const picojson::value& properties) const {
+        std::string key;
+        for (const std::string& propertyKey : _keys) {
+            if (properties.contains(propertyKey)) {
+                key += '+';
+                key += properties.get(propertyKey).serialize();
+            } else {
+                key += '-';
+            }
+        }
+        return key;
+    }
+
+    std::vector<std::size_t> RuleList::match(const picojson::value& properties) const {
+        // Look up each referenced property once, conditions then only compare the values
+        std::vector<const picojson::value*> values(_keys.size(), nullptr);
+        for (std::size_t i = 0; i < _keys.size(); i++) {
+            if (properties.contains(_keys[i])) {
+                values[i] = &properties.get(_keys[i]);
+            }
+        }
+
+        std::vector<std::size_t> ruleIndices;
+        for (std::size_t ruleIndex = 0; ruleIndex < _rules.size(); ruleIndex++) {
+            for (std::size_t filterIndex = _ruleFilterOffsets[ruleIndex]; filterIndex < _ruleFilterOffsets[ruleIndex + 1]; filterIndex++) {
+                std::size_t conditionIndex = _filterOffsets[filterIndex];
+                for (; conditionIndex < _filterOffsets[filterIndex + 1]; conditionIndex++) {
+                    const Condition& condition = _conditions[conditionIndex];
+                    if (!values[condition.keyIndex] || *values[condition.keyIndex] != condition.value) {
+                        break;
+                    }
+                }
+                if (conditionIndex == _filterOffsets[filterIndex + 1]) {
+                    ruleIndices.push_back(ruleIndex);
+                    break;
+                }
+            }
+        }
+        return ruleIndices;
+    }
+
     RuleList RuleList::parse(const picojson::value& ruleListDef) {
         const picojson::array& ruleListArray = ruleListDef.get<picojson::array>();
         
@@ -121,4 +171,39 @@ namespace carto { namespace sgre {
         }
         return RuleList(std::move(rules));
     }
+
+    void RuleList::compile() {
+        _keys.clear();
+        for (const Rule& rule : _rules) {
+            if (auto filters = rule.getFilters()) {
+                for (const Rule::Filter& filter : *filters) {
+                    for (auto it = filter.begin(); it != filter.end(); it++) {
+                        _keys.push_back(it->first);
+                    }
+                }
+            }
+        }
+        std::sort(_keys.begin(), _keys.end());
+        _keys.erase(std::unique(_keys.begin(), _keys.end()), _keys.end());
+
+        _conditions.clear();
+        _filterOffsets.clear();
+        _ruleFilterOffsets.clear();
+        for (const Rule& rule : _rules) {
+            _ruleFilterOffsets.push_back(_filterOffsets.size());
+            if (auto filters = rule.getFilters()) {
+                for (const Rule::Filter& filter : *filters) {
+                    _filterOffsets.push_back(_conditions.size());
+                    for (auto it = filter.begin(); it != filter.end(); it++) {
+                        std::size_t keyIndex = std::lower_bound(_keys.begin(), _keys.end(), it->first) - _keys.begin();
+                        _conditions.push_back({ keyIndex, it->second });
+                    }
+                }
+            } else {
+                _filterOffsets.push_back(_conditions.size());
+            }
+        }
+        _ruleFilterOffsets.push_back(_filterOffsets.size());
+        _filterOffsets.push_back(_conditions.size());
+    }
 } }
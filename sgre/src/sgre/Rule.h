@@ -52,7 +52,7 @@ namespace carto { namespace sgre {
     class RuleList final {
     public:
         RuleList() = default;
-        explicit RuleList(std::vector<Rule> rules) : _rules(std::move(rules)) { }
+        explicit RuleList(std::vector<Rule> rules);
 
         const std::vector<Rule>& getRules() const { return _rules; }
         
@@ -60,10 +60,28 @@ namespace carto { namespace sgre {
 
         void apply(RoutingAttributes& attribs, bool forward) const;
 
+        // Key of the property values referenced by the rule filters. Properties with equal keys match the same rules.
+        std::string getMatchKey(const picojson::value& properties) const;
+
+        // Indices of the rules matching the properties, in rule order
+        std::vector<std::size_t> match(const picojson::value& properties) const;
+
         static RuleList parse(const picojson::value& ruleListDef);
 
     private:
+        struct Condition {
+            std::size_t keyIndex;
+            picojson::value value;
+        };
+
+        void compile();
+
         std::vector<Rule> _rules;
+
+        std::vector<std::string> _keys;               // interned property keys referenced by the filters
+        std::vector<Condition> _conditions;           // conditions of all filters, grouped by filter
+        std::vector<std::size_t> _filterOffsets;      // first condition of each filter, followed by the end offset
+        std::vector<std::size_t> _ruleFilterOffsets;  // first filter of each rule, followed by the end offset. Rules without filters get a single empty filter.
     };
 } }
 
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2016 CartoDB. All rights reserved.
+ * Copying and using this code is allowed only according
+ * to license terms, as given in https://cartodb.com/terms/
+ */
+
+#ifndef _CARTO_SGRE_SEARCHSPACE_H_
+#define _CARTO_SGRE_SEARCHSPACE_H_
+
+#include "Graph.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace carto { namespace sgre {
+    class SearchSpace final {
+    public:
+        struct Entry {
+            Graph::NodeId nodeId = Graph::NodeId(-1);
+            double nodeT = 0;
+            double time = 0;                        // fastest known time from the initial nodes
+            double estTime = 0;                     // time plus estimated time to the final nodes, used as heap key
+            Graph::EdgeId edgeId = Graph::EdgeId(-1); // edge used to reach this entry, or -1 for initial nodes
+            int prevIndex = -1;                     // entry at the source node of the edge
+
+            Entry() = default;
+            explicit Entry(Graph::NodeId nodeId, double nodeT) : nodeId(nodeId), nodeT(nodeT) { }
+
+        private:
+            friend class SearchSpace;
+
+            int heapIndex = -1;
+            int lowerIndex = -1;                    // entry of the same node with the next smaller T value
+            int upperIndex = -1;                    // entry of the same node with the next larger T value
+            int pendingIndex = -1;                  // first pending point range attached to this entry
+        };
+
+        // Tesselation points of an edge that are not generated yet. The points are generated when the entry the range is attached to is popped.
+        struct PendingPoints {
+            int sourceIndex = -1;                   // entry the points are reached from
+            Graph::EdgeId edgeId = Graph::EdgeId(-1); // edge leading to the tesselated node
+            int pointIndex = 0;                     // next point to generate
+            int pointStep = 0;                      // direction of generation, -1 or 1
+        };
+
+        SearchSpace() = default;
+
+        void reset(std::size_t nodeCount) {
+            // Invalidate node heads of the previous search by bumping the stamp instead of clearing the arrays
+            if (++_stamp == 0) {
+                std::fill(_nodeStamps.begin(), _nodeStamps.end(), 0);
+                _stamp = 1;
+            }
+            if (_nodeHeads.size() < nodeCount) {
+                _nodeHeads.resize(nodeCount, -1);
+                _nodeStamps.resize(nodeCount, 0);
+            }
+            _entries.clear();
+            _heap.clear();
+            _pendingPoints.clear();
+        }
+
+        bool empty() const {
+            return _heap.empty();
+        }
+
+        int getEntryCount() const {
+            return static_cast<int>(_entries.size());
+        }
+
+        const Entry& getEntry(int index) const {
+            return _entries[index];
+        }
+
+        bool isQueued(int index) const {
+            return _entries[index].heapIndex != -1;
+        }
+
+        int find(Graph::NodeId nodeId, double nodeT) {
+            int index = locateEntry(nodeId, nodeT);
+            return index != -1 && _entries[index].nodeT == nodeT ? index : -1;
+        }
+
+        int pop() {
+            int index = _heap.front();
+            _entries[index].heapIndex = -1;
+            int lastIndex = _heap.back();
+            _heap.pop_back();
+            if (!_heap.empty()) {
+                _heap.front() = lastIndex;
+                _entries[lastIndex].heapIndex = 0;
+                siftDown(0);
+            }
+            return index;
+        }
+
+        int update(Graph::NodeId nodeId, double nodeT, double time, double estTime, Graph::EdgeId edgeId, int prevIndex) {
+            // Insert the entry or update it if the new time is better. Entries already popped are pushed back to the heap.
+            // Returns the index of the updated entry or -1 if the existing entry was not updated.
+            int index = find(nodeId, nodeT);
+            if (index == -1) {
+                index = insertEntry(nodeId, nodeT);
+            } else if (_entries[index].time <= time) {
+                return -1;
+            }
+
+            Entry& entry = _entries[index];
+            entry.time = time;
+            entry.estTime = estTime;
+            entry.edgeId = edgeId;
+            entry.prevIndex = prevIndex;
+            if (entry.heapIndex == -1) {
+                entry.heapIndex = static_cast<int>(_heap.size());
+                _heap.push_back(index);
+            }
+            siftUp(entry.heapIndex);
+            return index;
+        }
+
+        void attachPendingPoints(int index, const PendingPoints& pendingPoints) {
+            _pendingPoints.emplace_back(pendingPoints, _entries[index].pendingIndex);
+            _entries[index].pendingIndex = static_cast<int>(_pendingPoints.size()) - 1;
+        }
+
+        bool popPendingPoints(int index, PendingPoints& pendingPoints) {
+            int pendingIndex = _entries[index].pendingIndex;
+            if (pendingIndex == -1) {
+                return false;
+            }
+            pendingPoints = _pendingPoints[pendingIndex].first;
+            _entries[index].pendingIndex = _pendingPoints[pendingIndex].second;
+            return true;
+        }
+
+    private:
+        static constexpr int HEAP_ARITY = 4;
+
+        int locateEntry(Graph::NodeId nodeId, double nodeT) {
+            // Entries of a node are kept sorted by T value. The search starts from the last located entry, as consecutive
+            // lookups usually concern neighbouring tesselation points. Returns the entry with the T value or a neighbour of it.
+            if (_nodeStamps[nodeId] != _stamp) {
+                return -1;
+            }
+            int index = _nodeHeads[nodeId];
+            while (_entries[index].nodeT < nodeT && _entries[index].upperIndex != -1) {
+                index = _entries[index].upperIndex;
+            }
+            while (_entries[index].nodeT > nodeT && _entries[index].lowerIndex != -1) {
+                index = _entries[index].lowerIndex;
+            }
+            _nodeHeads[nodeId] = index;
+            return index;
+        }
+
+        int insertEntry(Graph::NodeId nodeId, double nodeT) {
+            int nearIndex = locateEntry(nodeId, nodeT);
+            int index = static_cast<int>(_entries.size());
+            _entries.emplace_back(nodeId, nodeT);
+            if (nearIndex == -1) {
+                _nodeStamps[nodeId] = _stamp;
+            } else if (_entries[nearIndex].nodeT < nodeT) {
+                _entries[index].lowerIndex = nearIndex;
+                _entries[index].upperIndex = _entries[nearIndex].upperIndex;
+            } else {
+                _entries[index].lowerIndex = _entries[nearIndex].lowerIndex;
+                _entries[index].upperIndex = nearIndex;
+            }
+            if (_entries[index].lowerIndex != -1) {
+                _entries[_entries[index].lowerIndex].upperIndex = index;
+            }
+            if (_entries[index].upperIndex != -1) {
+                _entries[_entries[index].upperIndex].lowerIndex = index;
+            }
+            _nodeHeads[nodeId] = index;
+            return index;
+        }
+
+        void siftUp(int heapIndex) {
+            int index = _heap[heapIndex];
+            double estTime = _entries[index].estTime;
+            while (heapIndex > 0) {
+                int parentHeapIndex = (heapIndex - 1) / HEAP_ARITY;
+                int parentIndex = _heap[parentHeapIndex];
+                if (_entries[parentIndex].estTime <= estTime) {
+                    break;
+                }
+                _heap[heapIndex] = parentIndex;
+                _entries[parentIndex].heapIndex = heapIndex;
+                heapIndex = parentHeapIndex;
+            }
+            _heap[heapIndex] = index;
+            _entries[index].heapIndex = heapIndex;
+        }
+
+        void siftDown(int heapIndex) {
+            int index = _heap[heapIndex];
+            double estTime = _entries[index].estTime;
+            int heapSize = static_cast<int>(_heap.size());
+            while (true) {
+                int firstChildHeapIndex = heapIndex * HEAP_ARITY + 1;
+                if (firstChildHeapIndex >= heapSize) {
+                    break;
+                }
+                int minChildHeapIndex = firstChildHeapIndex;
+                int lastChildHeapIndex = std::min(firstChildHeapIndex + HEAP_ARITY, heapSize);
+                for (int childHeapIndex = firstChildHeapIndex + 1; childHeapIndex < lastChildHeapIndex; childHeapIndex++) {
+                    if (_entries[_heap[childHeapIndex]].estTime < _entries[_heap[minChildHeapIndex]].estTime) {
+                        minChildHeapIndex = childHeapIndex;
+                    }
+                }
+                int minChildIndex = _heap[minChildHeapIndex];
+                if (_entries[minChildIndex].estTime >= estTime) {
+                    break;
+                }
+                _heap[heapIndex] = minChildIndex;
+                _entries[minChildIndex].heapIndex = heapIndex;
+                heapIndex = minChildHeapIndex;
+            }
+            _heap[heapIndex] = index;
+            _entries[index].heapIndex = heapIndex;
+        }
+
+        std::vector<int> _nodeHeads; // last located entry of each node, valid only if the node stamp matches the current stamp
+        std::vector<unsigned int> _nodeStamps;
+        unsigned int _stamp = 0;
+        std::vector<int> _heap; // 4-ary min-heap of entry indices
+        std::vector<Entry> _entries;
+        std::vector<std::pair<PendingPoints, int>> _pendingPoints; // pending point ranges with the index of the next range attached to the same entry
+    };
+} }
+
+#endif
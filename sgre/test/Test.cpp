@@ -8,6 +8,9 @@
 
 #include <picojson/picojson.h>
 
+#include <map>
+#include <sstream>
+
 #include <boost/math/constants/constants.hpp>
 #include <boost/test/included/unit_test.hpp>
 
@@ -212,6 +215,31 @@ BOOST_AUTO_TEST_CASE(polygonEdgeSearch) {
     }
 }
 
+// Test cases for k-nearest edge search
+BOOST_AUTO_TEST_CASE(nearestEdgeSearch) {
+    GraphBuilder graphBuilder = GraphBuilder(RuleList());
+    for (int i = 0; i < 50; i++) {
+        graphBuilder.addLineString(shiftPoints(createChain(0.1, 2), { 0, i * 0.1, 0 }), picojson::value());
+    }
+    auto graph = graphBuilder.build();
+
+    Point pos(0.05, 2.02, 0.0);
+    StaticGraph::SearchOptions options;
+    auto nearestEdgePoints = graph->findNearestEdgePoints(pos, 10, options);
+    BOOST_CHECK(nearestEdgePoints.size() == 10);
+    auto nearestEdgePoint = graph->findNearestEdgePoint(pos, options);
+    BOOST_CHECK(!nearestEdgePoint.empty() && equal(nearestEdgePoint.at(0).second, nearestEdgePoints.at(0).second));
+    for (std::size_t i = 0; i < nearestEdgePoints.size(); i++) {
+        BOOST_CHECK(std::abs(nearestEdgePoints[i].second(0) - 0.05) < 1.0e-9);
+        if (i > 0) {
+            BOOST_CHECK(std::abs(nearestEdgePoints[i - 1].second(1) - pos(1)) <= std::abs(nearestEdgePoints[i].second(1) - pos(1)) + 1.0e-9);
+        }
+    }
+    BOOST_CHECK(std::abs(nearestEdgePoints.back().second(1) - 1.8) < 1.0e-9);
+
+    BOOST_CHECK(graph->findNearestEdgePoints(pos, 1000, options).size() == graph->getEdgeIdRangeEnd());
+}
+
 // Test cases for edge linking in hybrid graphs (polygons and linestrings)
 BOOST_AUTO_TEST_CASE(edgeLinking) {
     auto buildGraph = [](const std::string& mode) -> std::shared_ptr<const StaticGraph> {
@@ -282,6 +310,266 @@ BOOST_AUTO_TEST_CASE(nodeSharing) {
     }
 }
 
+// Test cases for queries with multiple endpoint candidates
+BOOST_AUTO_TEST_CASE(multipleEndpoints) {
+    // Check that the fastest of equally near lines is used for both endpoints
+    {
+        auto chain = createChain(1.0, 3);
+        auto ruleList = RuleList::parse(parseJSON(R"R([{ "filters":[{"type":1}], "speed":2.0 }])R"));
+        GraphBuilder graphBuilder = GraphBuilder(ruleList);
+        graphBuilder.addLineString({ shiftPoints(chain, { 0, 0.1, 0 }) }, parseJSON("{ \"type\": 0 }"));
+        graphBuilder.addLineString({ shiftPoints(chain, { 0, -0.1, 0 }) }, parseJSON("{ \"type\": 1 }"));
+        RouteFinder finder(graphBuilder.build());
+
+        Query query(Point(0.0, 0.0, 0.0), Point(2.0, 0.0, 0.0));
+        Result result = finder.find(query);
+        BOOST_CHECK(result.getStatus() == Result::Status::SUCCESS);
+        BOOST_CHECK(equal(result.getGeometry().front(), Point(0.0, -0.1, 0.0)));
+        BOOST_CHECK(equal(result.getGeometry().back(), Point(2.0, -0.1, 0.0)));
+
+        Query lineQuery(Point(0.0, -0.1, 0.0), Point(2.0, -0.1, 0.0));
+        double lineTime = finder.find(lineQuery).getTotalTime();
+        BOOST_CHECK(std::abs(result.getTotalTime() - lineTime) < lineTime * 1.0e-5); // longitude scaling is based on the average latitude of the candidates
+    }
+
+    // Check endpoints on the shared edge of polygon triangles
+    {
+        std::vector<Point> rect { Point(1.0, 0.5, 0.0), Point(1.0, -0.5, 0.0), Point(-1.0, -0.5, 0.0), Point(-1.0, 0.5, 0.0) };
+        GraphBuilder graphBuilder = GraphBuilder(RuleList());
+        graphBuilder.addPolygon({ rect }, picojson::value());
+        RouteFinder finder(graphBuilder.build());
+
+        Query query(Point(0.0, 0.0, 0.0), Point(-0.5, 0.25, 0.0));
+        Result result = finder.find(query);
+        BOOST_CHECK(result.getGeometry().size() == 2);
+        if (result.getGeometry().size() == 2) {
+            BOOST_CHECK(equal(result.getGeometry()[0], query.getPos(0)));
+            BOOST_CHECK(equal(result.getGeometry()[1], query.getPos(1)));
+        }
+
+        Query revQuery(Point(-0.5, 0.25, 0.0), Point(0.0, 0.0, 0.0));
+        Result revResult = finder.find(revQuery);
+        BOOST_CHECK(revResult.getGeometry().size() == 2);
+        if (revResult.getGeometry().size() == 2) {
+            BOOST_CHECK(equal(revResult.getGeometry()[0], revQuery.getPos(0)));
+            BOOST_CHECK(equal(revResult.getGeometry()[1], revQuery.getPos(1)));
+        }
+    }
+
+    // Check endpoints shared by a polygon and a line
+    {
+        auto square = createSquare(0.5);
+        auto chain = createChain(1.0, 2);
+        GraphBuilder graphBuilder = GraphBuilder(RuleList());
+        graphBuilder.addPolygon({ square }, picojson::value());
+        graphBuilder.addLineString({ shiftPoints(chain, { 0.5, 0.5, 0 }) }, picojson::value());
+        RouteFinder finder(graphBuilder.build());
+
+        Query query(Point(0.5, 0.5, 0.0), Point(1.5, 0.5, 0.0));
+        Result result = finder.find(query);
+        BOOST_CHECK(result.getStatus() == Result::Status::SUCCESS);
+        BOOST_CHECK(equal(result.getGeometry().front(), query.getPos(0)));
+        BOOST_CHECK(equal(result.getGeometry().back(), query.getPos(1)));
+
+        Query revQuery(Point(1.5, 0.5, 0.0), Point(-0.25, -0.25, 0.0));
+        Result revResult = finder.find(revQuery);
+        BOOST_CHECK(revResult.getStatus() == Result::Status::SUCCESS);
+        BOOST_CHECK(equal(revResult.getGeometry().front(), revQuery.getPos(0)));
+        BOOST_CHECK(equal(revResult.getGeometry().back(), revQuery.getPos(1)));
+    }
+}
+
+// Test cases for landmark heuristic, results must be identical to the default heuristic
+BOOST_AUTO_TEST_CASE(landmarkRouting) {
+    auto buildGraph = []() -> std::shared_ptr<const StaticGraph> {
+        auto ruleList = RuleList::parse(parseJSON(R"R([{ "turnspeed":1.0e12 }, { "filters":[{"type":1}], "speed":3.0 }, { "filters":[{"type":2}], "speed":0.5, "delay":2.0 }])R"));
+        GraphBuilder graphBuilder = GraphBuilder(ruleList);
+        for (int z = 0; z < 3; z++) {
+            for (int i = 0; i <= 4; i++) {
+                graphBuilder.addLineString(shiftPoints(createChain(0.001, 5), { 0, i * 0.001, z * 4.0 }), parseJSON("{ \"type\": " + std::to_string(i % 2) + " }"));
+                graphBuilder.addLineString({ Point(i * 0.001, 0, z * 4.0), Point(i * 0.001, 0.004, z * 4.0) }, parseJSON("{ \"type\": 0 }"));
+            }
+            graphBuilder.addPolygon({ shiftPoints(createSquare(0.001), { 0.006, 0.002, z * 4.0 }) }, parseJSON("{ \"type\": 2 }"));
+            graphBuilder.addLineString({ Point(0.004, 0.002, z * 4.0), Point(0.005, 0.002, z * 4.0) }, parseJSON("{ \"type\": 0 }"));
+        }
+        graphBuilder.addLineString({ Point(0.0, 0.0, 0.0), Point(0.0, 0.0, 4.0) }, parseJSON("{ \"type\": 0 }"));
+        graphBuilder.addLineString({ Point(0.004, 0.004, 4.0), Point(0.004, 0.004, 8.0) }, parseJSON("{ \"type\": 0 }"));
+        graphBuilder.addLineString({ Point(0.006, 0.002, 0.0), Point(0.006, 0.002, 8.0) }, parseJSON("{ \"type\": 2 }"));
+        return graphBuilder.build();
+    };
+
+    auto graph = buildGraph();
+    RouteFinder finder1(graph);
+    for (int landmarkCount : { 1, 4, 16 }) {
+        RouteFinder finder2(graph);
+        finder2.setLandmarkCount(landmarkCount);
+        BOOST_CHECK(finder2.getLandmarkCount() == landmarkCount);
+        for (int i = 0; i < 64; i++) {
+            Point pos0(0.001 * (i % 7), 0.0007 * (i % 5), 4.0 * (i % 3));
+            Point pos1(0.001 * ((i * 3) % 7), 0.0007 * ((i * 2) % 5), 4.0 * ((i + 1) % 3));
+            Query query(pos0, pos1);
+            Result result1 = finder1.find(query);
+            Result result2 = finder2.find(query);
+            BOOST_CHECK(result1.getStatus() == result2.getStatus());
+            BOOST_CHECK(std::abs(result1.getTotalTime() - result2.getTotalTime()) <= 1.0e-6 * result1.getTotalTime());
+        }
+    }
+}
+
+// Test cases for rule matching
+BOOST_AUTO_TEST_CASE(ruleMatching) {
+    auto ruleList = RuleList::parse(parseJSON(R"R([
+        { "speed":1.0 },
+        { "filters":[{"type":1}, {"type":2, "level":0}], "speed":2.0, "profiles":["walk"] },
+        { "filters":[], "speed":3.0 },
+        { "filters":[{"level":0}], "speed":4.0 },
+        { "filters":[{"type":"1"}], "speed":5.0 }
+    ])R"));
+
+    BOOST_CHECK(ruleList.match(parseJSON("{}")) == std::vector<std::size_t>({ 0 }));
+    BOOST_CHECK(ruleList.match(parseJSON("{ \"type\": 1 }")) == std::vector<std::size_t>({ 0, 1 }));
+    BOOST_CHECK(ruleList.match(parseJSON("{ \"type\": 2 }")) == std::vector<std::size_t>({ 0 }));
+    BOOST_CHECK(ruleList.match(parseJSON("{ \"type\": 2, \"level\": 0 }")) == std::vector<std::size_t>({ 0, 1, 3 }));
+    BOOST_CHECK(ruleList.match(parseJSON("{ \"type\": \"1\", \"level\": 1 }")) == std::vector<std::size_t>({ 0, 4 }));
+
+    // Properties not referenced by the filters must not affect the match key
+    BOOST_CHECK(ruleList.getMatchKey(parseJSON("{ \"type\": 1, \"name\": \"a\" }")) == ruleList.getMatchKey(parseJSON("{ \"type\": 1, \"name\": \"b\" }")));
+    BOOST_CHECK(ruleList.getMatchKey(parseJSON("{ \"type\": 1 }")) != ruleList.getMatchKey(parseJSON("{ \"type\": \"1\" }")));
+    BOOST_CHECK(ruleList.getMatchKey(parseJSON("{ \"type\": 1 }")) != ruleList.getMatchKey(parseJSON("{ \"level\": 1 }")));
+
+    // Check that filtering by profile recompiles the rules
+    ruleList.filter("default");
+    BOOST_CHECK(ruleList.match(parseJSON("{ \"type\": 2, \"level\": 0 }")) == std::vector<std::size_t>({ 0, 2 }));
+}
+
+// Test cases for path straightening
+BOOST_AUTO_TEST_CASE(pathStraightening) {
+    auto calculateDistance = [](const Point& pos0, const Point& pos1) {
+        return cglib::length(pos1 - pos0) * 6378137.0 * boost::math::constants::pi<double>() / 180.0;
+    };
+
+    // Check that the path around a square hole is taut and turns only at a hole corner
+    {
+        GraphBuilder graphBuilder = GraphBuilder(RuleList());
+        graphBuilder.addPolygon({ createSquare(0.002), createSquare(0.001) }, parseJSON("{}"));
+        RouteFinder finder(graphBuilder.build());
+        for (int i = 0; i < 4; i++) {
+            double angle = i * 0.5 * boost::math::constants::pi<double>();
+            Point pos0(std::cos(angle) * 0.0015 - std::sin(angle) * 0.0015, std::sin(angle) * 0.0015 + std::cos(angle) * 0.0015, 0);
+            Point pos1(-pos0(0) + 0.0002 * std::cos(angle), -pos0(1) + 0.0002 * std::sin(angle), 0);
+            Result result = finder.find(Query(pos0, pos1));
+            BOOST_CHECK(result.getGeometry().size() == 3);
+            if (result.getGeometry().size() == 3) {
+                const Point& corner = result.getGeometry()[1];
+                BOOST_CHECK(std::abs(std::abs(corner(0)) - 0.001) < 1.0e-8 && std::abs(std::abs(corner(1)) - 0.001) < 1.0e-8);
+                double dist = calculateDistance(pos0, corner) + calculateDistance(corner, pos1);
+                BOOST_CHECK(std::abs(result.getTotalDistance() - dist) < 1.0e-6 * dist);
+            }
+        }
+    }
+
+    // Check that the path through a concave U-shaped polygon with a hole follows the inner corners
+    {
+        std::vector<Point> outerRing = {
+            Point(0.0, 0.0, 0), Point(0.003, 0.0, 0), Point(0.003, 0.003, 0), Point(0.002, 0.003, 0),
+            Point(0.002, 0.001, 0), Point(0.001, 0.001, 0), Point(0.001, 0.003, 0), Point(0.0, 0.003, 0)
+        };
+        std::vector<Point> holeRing = shiftPoints(createSquare(0.0002), { 0.0015, 0.0005, 0 });
+        GraphBuilder graphBuilder = GraphBuilder(RuleList());
+        graphBuilder.addPolygon({ outerRing, holeRing }, parseJSON("{}"));
+        RouteFinder finder(graphBuilder.build());
+        for (Query query : { Query(Point(0.0005, 0.0025, 0), Point(0.0025, 0.0025, 0)), Query(Point(0.0025, 0.0028, 0), Point(0.0002, 0.0021, 0)) }) {
+            Result result = finder.find(query);
+            BOOST_CHECK(result.getGeometry().size() == 4);
+            if (result.getGeometry().size() == 4) {
+                bool forward = query.getPos(0)(0) < query.getPos(1)(0);
+                Point corner0(forward ? 0.001 : 0.002, 0.001, 0);
+                Point corner1(forward ? 0.002 : 0.001, 0.001, 0);
+                BOOST_CHECK(equal(result.getGeometry()[1], corner0));
+                BOOST_CHECK(equal(result.getGeometry()[2], corner1));
+                double dist = calculateDistance(query.getPos(0), corner0) + calculateDistance(corner0, corner1) + calculateDistance(corner1, query.getPos(1));
+                BOOST_CHECK(std::abs(result.getTotalDistance() - dist) < 1.0e-6 * dist);
+            }
+        }
+    }
+}
+
+// Test cases for lazily tesselated edges
+BOOST_AUTO_TEST_CASE(tesselatedRouting) {
+    GraphBuilder graphBuilder = GraphBuilder(RuleList());
+    graphBuilder.addPolygon({ createSquare(0.005), shiftPoints(createSquare(0.001), { 0.001, -0.001, 0 }) }, parseJSON("{}"));
+    auto graph = graphBuilder.build();
+
+    // Landmarks must not change the tesselated search results, and the unstraightened paths must approach the straightened ones
+    RouteFinder finder(graph);
+    RouteFinder landmarkFinder(graph);
+    RouteFinder straightFinder(graph);
+    finder.setTesselationDistance(20.0);
+    finder.setPathStraightening(false);
+    landmarkFinder.setTesselationDistance(20.0);
+    landmarkFinder.setPathStraightening(false);
+    landmarkFinder.setLandmarkCount(4);
+    for (int i = 0; i < 8; i++) {
+        double angle = i * 0.25 * boost::math::constants::pi<double>();
+        Query query(Point(std::cos(angle) * 0.004, std::sin(angle) * 0.004, 0), Point(-std::cos(angle) * 0.0045, -std::sin(angle) * 0.003, 0));
+        Result result = finder.find(query);
+        Result landmarkResult = landmarkFinder.find(query);
+        Result straightResult = straightFinder.find(query);
+        BOOST_CHECK(result.getStatus() == Result::Status::SUCCESS);
+        BOOST_CHECK(std::abs(result.getTotalTime() - landmarkResult.getTotalTime()) < 1.0e-6 * result.getTotalTime());
+        BOOST_CHECK(result.getTotalTime() > straightResult.getTotalTime() * (1 - 1.0e-6));
+        BOOST_CHECK(result.getTotalTime() < straightResult.getTotalTime() * 1.05);
+    }
+}
+
+// Test cases for isochrone search
+BOOST_AUTO_TEST_CASE(isochroneSearch) {
+    auto buildGraph = []() -> std::shared_ptr<const StaticGraph> {
+        auto ruleList = RuleList::parse(parseJSON(R"R([{ "turnspeed":1.0e12 }, { "filters":[{"type":1}], "speed":3.0 }, { "filters":[{"type":2}], "delay":20.0 }])R"));
+        GraphBuilder graphBuilder = GraphBuilder(ruleList);
+        for (int z = 0; z < 2; z++) {
+            for (int i = 0; i < 5; i++) {
+                std::vector<Point> column;
+                for (int j = 0; j < 5; j++) {
+                    column.emplace_back(i * 0.001, j * 0.001, z * 4.0);
+                }
+                graphBuilder.addLineString(shiftPoints(createChain(0.001, 5), { 0, i * 0.001, z * 4.0 }), parseJSON("{ \"type\": " + std::to_string(i % 2) + " }"));
+                graphBuilder.addLineString(column, parseJSON("{ \"type\": " + std::to_string(i == 2 ? 2 : 0) + " }"));
+            }
+        }
+        graphBuilder.addLineString({ Point(0.004, 0.004, 0.0), Point(0.004, 0.004, 4.0) }, parseJSON("{ \"type\": 0 }"));
+        return graphBuilder.build();
+    };
+
+    // Compare travel times against point-to-point queries. Path straightening is disabled as it is not used by the search.
+    auto graph = buildGraph();
+    RouteFinder finder(graph);
+    finder.setPathStraightening(false);
+    Point origin(0.001, 0.0, 0.0);
+    for (double maxTime : { 150.0, 400.0 }) {
+        Isochrone isochrone = finder.findIsochrone(origin, maxTime, true);
+        BOOST_CHECK(isochrone.getStatus() == Isochrone::Status::SUCCESS);
+        BOOST_CHECK(isochrone.getBoundary().size() >= 3);
+
+        std::map<Graph::NodeId, double> nodeTimes;
+        for (const Isochrone::NodeTime& nodeTime : isochrone.getNodeTimes()) {
+            BOOST_CHECK(nodeTime.time <= maxTime);
+            nodeTimes[nodeTime.nodeId] = nodeTime.time;
+        }
+        for (Graph::NodeId nodeId = 0; nodeId < graph->getNodeIdRangeEnd(); nodeId++) {
+            const Point& point = graph->getNode(nodeId).points[0];
+            Result result = finder.find(Query(origin, point));
+            double time = (point == origin ? 0.0 : result.getStatus() == Result::Status::SUCCESS ? result.getTotalTime() : std::numeric_limits<double>::infinity());
+            auto it = nodeTimes.find(nodeId);
+            if (it != nodeTimes.end()) {
+                BOOST_CHECK(std::abs(it->second - time) <= 1.0e-6 * time + 1.0e-6);
+            } else {
+                BOOST_CHECK(time > maxTime - 1.0e-6);
+            }
+        }
+    }
+}
+
 // Test cases for routing attributes
 BOOST_AUTO_TEST_CASE(routingAttributes) {
     auto buildGraph = [](const std::string& rules) -> std::shared_ptr<const StaticGraph> {
@@ -394,6 +682,175 @@ BOOST_AUTO_TEST_CASE(routingInstructions) {
     }
 }
 
+// Test cases for binary graph serialization
+BOOST_AUTO_TEST_CASE(graphSerialization) {
+    auto buildGraph = []() -> std::shared_ptr<const StaticGraph> {
+        auto square = createSquare(0.5);
+        auto chain = createChain(1.0, 2);
+        auto ruleList = RuleList::parse(parseJSON(R"R([{ "filters":[{"type":1}], "speed":2.0, "backward_speed":0.5 }, { "filters":[{"type":2}], "delay":3.0 }])R"));
+        GraphBuilder graphBuilder = GraphBuilder(ruleList);
+        graphBuilder.addPolygon({ shiftPoints(square, { -1, 0, 0 }), shiftPoints(createSquare(0.1), { -1, 0, 0 }) }, parseJSON("{ \"type\": 0, \"name\": \"room\" }"));
+        graphBuilder.addLineString({ shiftPoints(chain, { -0.5, 0, 0 }) }, parseJSON("{ \"type\": 1 }"));
+        graphBuilder.addPolygon({ shiftPoints(square, { 1, 0, 1 }) }, parseJSON("{ \"type\": 2 }"));
+        graphBuilder.addLineString({ Point(0.5, 0, 0), Point(0.5, 0, 1) }, parseJSON("{ \"type\": 0 }"));
+        return graphBuilder.build();
+    };
+
+    // Check that graph structure and routing results are identical after a round-trip
+    {
+        auto graph1 = buildGraph();
+        std::stringstream ss;
+        graph1->serialize(ss);
+        std::shared_ptr<const StaticGraph> graph2 = StaticGraph::deserialize(ss);
+
+        BOOST_CHECK(graph1->getNodeIdRangeEnd() == graph2->getNodeIdRangeEnd());
+        BOOST_CHECK(graph1->getEdgeIdRangeEnd() == graph2->getEdgeIdRangeEnd());
+        BOOST_CHECK(graph1->getFeatureIdRangeEnd() == graph2->getFeatureIdRangeEnd());
+        for (Graph::NodeId nodeId = 0; nodeId < graph1->getNodeIdRangeEnd(); nodeId++) {
+            BOOST_CHECK(graph1->getNode(nodeId).points == graph2->getNode(nodeId).points);
+            BOOST_CHECK(graph1->getNode(nodeId).edgeIds == graph2->getNode(nodeId).edgeIds);
+        }
+        for (Graph::FeatureId featureId = 0; featureId < graph1->getFeatureIdRangeEnd(); featureId++) {
+            BOOST_CHECK(graph1->getFeature(featureId) == graph2->getFeature(featureId));
+        }
+
+        RouteFinder finder1(graph1);
+        RouteFinder finder2(graph2);
+        for (int i = 0; i < 25; i++) {
+            Query query(Point(-1.4 + 0.1 * (i % 5), -0.4 + 0.2 * (i / 5), 0.0), Point(1.4 - 0.2 * (i / 5), 0.4 - 0.2 * (i % 5), 1.0));
+            BOOST_CHECK(finder1.find(query).serialize() == finder2.find(query).serialize());
+            Query revQuery(query.getPos(1), query.getPos(0));
+            BOOST_CHECK(finder1.find(revQuery).serialize() == finder2.find(revQuery).serialize());
+        }
+    }
+
+    // Check that invalid data is rejected
+    {
+        std::stringstream ss;
+        buildGraph()->serialize(ss);
+        std::string data = ss.str();
+
+        std::stringstream ss1(data.substr(0, data.size() / 2));
+        BOOST_CHECK_THROW(StaticGraph::deserialize(ss1), std::runtime_error);
+
+        std::stringstream ss2("X" + data.substr(1));
+        BOOST_CHECK_THROW(StaticGraph::deserialize(ss2), std::runtime_error);
+    }
+
+    // Check that out of range indices in the adjacency and RTree tables are rejected
+    {
+        std::stringstream ss;
+        buildGraph()->serialize(ss);
+        const std::string data = ss.str();
+
+        auto readValue = [&data](std::size_t offset, int size) {
+            std::uint64_t value = 0;
+            for (int i = size - 1; i >= 0; i--) {
+                value = (value << 8) | static_cast<unsigned char>(data[offset + i]);
+            }
+            return value;
+        };
+        auto checkCorrupted = [&data](std::size_t offset, int size, std::uint64_t value) {
+            std::string corruptedData = data;
+            for (int i = 0; i < size; i++) {
+                corruptedData[offset + i] = static_cast<char>(value >> (i * 8));
+            }
+            std::stringstream corruptedStream(corruptedData);
+            BOOST_CHECK_THROW(StaticGraph::deserialize(corruptedStream), std::runtime_error);
+        };
+
+        // Skip header, nodes, edges, features and attributes to locate the tables
+        std::size_t offset = 8;
+        std::uint64_t nodeCount = readValue(offset, 8);
+        offset += 8 + nodeCount * 56;
+        std::uint64_t edgeCount = readValue(offset, 8);
+        offset += 8 + edgeCount * 56;
+        std::uint64_t featureCount = readValue(offset, 8);
+        offset += 8;
+        for (std::uint64_t i = 0; i < featureCount; i++) {
+            offset += 8 + (readValue(offset, 8) + 7) / 8 * 8;
+        }
+        std::uint64_t attributesCount = readValue(offset, 8);
+        offset += 8 + attributesCount * 16;
+        std::uint64_t adjacentEdgeCount = readValue(offset, 8);
+        std::size_t offsetsOffset = offset + 8;
+        std::size_t adjacentEdgesOffset = offsetsOffset + (nodeCount + 1) * 8;
+        std::size_t rtreeNodesOffset = adjacentEdgesOffset + adjacentEdgeCount * 24 + 8;
+        std::uint64_t rtreeNodeCount = readValue(rtreeNodesOffset - 8, 8);
+        BOOST_REQUIRE(adjacentEdgeCount > 0 && rtreeNodeCount > 1);
+        BOOST_REQUIRE(readValue(offsetsOffset + nodeCount * 8, 8) == adjacentEdgeCount);
+
+        checkCorrupted(offsetsOffset, 8, adjacentEdgeCount);                      // non-monotonic edge offsets
+        checkCorrupted(offsetsOffset + nodeCount * 8, 8, adjacentEdgeCount - 1);  // last offset not matching the adjacency table
+        checkCorrupted(adjacentEdgesOffset, 8, edgeCount);                        // edge id
+        checkCorrupted(adjacentEdgesOffset + 8, 8, nodeCount);                    // target node id
+        checkCorrupted(adjacentEdgesOffset + 16, 4, attributesCount);             // attributes id
+        checkCorrupted(rtreeNodesOffset + 52, 4, 0xffff);                         // leaf edge id range
+        checkCorrupted(rtreeNodesOffset + (rtreeNodeCount - 1) * 64 + 48, 4, rtreeNodeCount - 1); // root children not stored before the root
+    }
+}
+
+// Test cases for parallel GeoJSON feature collection import
+BOOST_AUTO_TEST_CASE(parallelImport) {
+    // Build a feature collection with shared polygon edges, linestrings crossing the polygons and multi-geometries
+    auto coordsJSON = [](const std::vector<Point>& points) {
+        std::string json;
+        for (const Point& point : points) {
+            json += (json.empty() ? "[" : ",") + std::string("[") + std::to_string(point(0)) + "," + std::to_string(point(1)) + "," + std::to_string(point(2)) + "]";
+        }
+        return json + "]";
+    };
+    std::string featuresJSON;
+    for (int i = 0; i < 40; i++) {
+        std::string geometryJSON;
+        auto square = shiftPoints(createSquare(0.5), { (i % 8) * 1.0, (i / 8) * 1.0, 0 });
+        auto chain = shiftPoints(createChain(0.25, 5), { (i % 8) * 1.0 - 0.5, (i / 8) * 1.0 + 0.1 * (i % 3), 0 });
+        switch (i % 5) {
+        case 0:
+            geometryJSON = "{\"type\":\"Polygon\",\"coordinates\":[" + coordsJSON(square) + "," + coordsJSON(shiftPoints(createSquare(0.1), { (i % 8) * 1.0, (i / 8) * 1.0, 0 })) + "]}";
+            break;
+        case 1:
+            geometryJSON = "{\"type\":\"LineString\",\"coordinates\":" + coordsJSON(chain) + "}";
+            break;
+        case 2:
+            geometryJSON = "{\"type\":\"MultiPolygon\",\"coordinates\":[[" + coordsJSON(square) + "],[" + coordsJSON(shiftPoints(square, { 0, 0, 1 })) + "]]}";
+            break;
+        case 3:
+            geometryJSON = "{\"type\":\"MultiLineString\",\"coordinates\":[" + coordsJSON(chain) + "," + coordsJSON({ square[0], square[2] }) + "]}";
+            break;
+        default:
+            geometryJSON = "{\"type\":\"Point\",\"coordinates\":[0,0]}";
+            break;
+        }
+        featuresJSON += (featuresJSON.empty() ? "" : ",") + std::string("{\"type\":\"Feature\",\"geometry\":") + geometryJSON + ",\"properties\":{\"type\":" + std::to_string(i % 3) + "}}";
+    }
+    picojson::value geoJSON = parseJSON("{\"type\":\"FeatureCollection\",\"features\":[" + featuresJSON + "]}");
+    auto ruleList = RuleList::parse(parseJSON(R"R([{ "filters":[{"type":1}], "speed":2.0, "link":"endpoints" }, { "filters":[{"type":2}], "backward_speed":0.0 }])R"));
+
+    auto serializeGraph = [](const StaticGraph& graph) {
+        std::stringstream ss;
+        graph.serialize(ss);
+        return ss.str();
+    };
+
+    // Check that the graph does not depend on the number of import threads and matches feature-by-feature import
+    GraphBuilder graphBuilder = GraphBuilder(ruleList);
+    for (const picojson::value& featureDef : geoJSON.get("features").get<picojson::array>()) {
+        graphBuilder.importGeoJSONFeature(featureDef);
+    }
+    std::string data = serializeGraph(*graphBuilder.build());
+    for (unsigned int threadCount : { 1, 2, 4, 0 }) {
+        GraphBuilder parallelGraphBuilder = GraphBuilder(ruleList);
+        parallelGraphBuilder.importGeoJSONFeatureCollection(geoJSON, threadCount);
+        BOOST_CHECK(serializeGraph(*parallelGraphBuilder.build()) == data);
+    }
+
+    // Check that errors are reported
+    picojson::value invalidGeoJSON = parseJSON("{\"type\":\"FeatureCollection\",\"features\":[" + featuresJSON + ",{\"type\":\"Feature\",\"geometry\":{\"type\":\"Curve\",\"coordinates\":[]},\"properties\":{}}]}");
+    GraphBuilder invalidGraphBuilder = GraphBuilder(ruleList);
+    BOOST_CHECK_THROW(invalidGraphBuilder.importGeoJSONFeatureCollection(invalidGeoJSON, 4), std::runtime_error);
+}
+
 // Test cases for rule parsing
 BOOST_AUTO_TEST_CASE(ruleParsing) {
     auto parseRule = [](const std::string& json) -> Rule {